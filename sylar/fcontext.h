@@ -0,0 +1,28 @@
+#ifndef MYSYLAR_FCONTEXT_H
+#define MYSYLAR_FCONTEXT_H
+
+#include <stddef.h>
+
+/* 汇编实现的协程上下文切换，思路同boost.context的jump_fcontext/make_fcontext
+ * 上下文就是切出时的栈顶指针，切换时只保存和恢复被调用者保存的寄存器，不像swapcontext
+ * 那样保存信号掩码(rt_sigprocmask系统调用)和完整的浮点环境
+ * 目前支持x86_64和aarch64，编译选项FIBER_ASM_CONTEXT打开时Fiber使用该实现
+ */
+#if defined(__x86_64__) || defined(__aarch64__)
+#define SYLAR_HAS_ASM_CONTEXT 1
+#endif
+
+extern "C" {
+
+/* 保存当前上下文到*from，然后切换到to
+ * 首次切换到sylar_make_context构造的上下文时，arg作为入口函数的参数
+ */
+void sylar_jump_context(void **from, void *to, void *arg);
+
+/* 在[sp - size, sp)的栈空间上构造初始上下文并返回，切换到该上下文时执行fn(arg)，
+ * fn不能返回
+ */
+void *sylar_make_context(void *sp, size_t size, void (*fn)(void *));
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "fd_manager.h"
+#include "hook_sys_call.h"
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace sylar {
+
+FdCtx::FdCtx(int fd)
+    : m_fd(fd) {
+    init();
+}
+
+bool FdCtx::init() {
+    if (m_isInit) {
+        return true;
+    }
+
+    struct stat fd_stat;
+    if (fstat(m_fd, &fd_stat) == -1) {
+        m_isInit   = false;
+        m_isSocket = false;
+    } else {
+        m_isInit   = true;
+        m_isSocket = S_ISSOCK(fd_stat.st_mode);
+    }
+
+    //socket统一在系统层面设置为非阻塞，这里要调用原始的fcntl，避免递归进入FdManager
+    if (m_isSocket) {
+        int flags = g_sys_fcntl_func(m_fd, F_GETFL, 0);
+        if (!(flags & O_NONBLOCK)) {
+            g_sys_fcntl_func(m_fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        m_sysNonblock = true;
+    } else {
+        m_sysNonblock = false;
+    }
+
+    m_userNonblock = false;
+    return m_isInit;
+}
+
+void FdCtx::setTimeout(int type, uint64_t v) {
+    if (type == SO_RCVTIMEO) {
+        m_recvTimeout = v;
+    } else {
+        m_sendTimeout = v;
+    }
+}
+
+uint64_t FdCtx::getTimeout(int type) const {
+    if (type == SO_RCVTIMEO) {
+        return m_recvTimeout;
+    } else {
+        return m_sendTimeout;
+    }
+}
+
+FdManager::FdManager() { m_datas.resize(64); }
+
+FdCtx::ptr FdManager::get(int fd, bool auto_create) {
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        if ((int)m_datas.size() > fd) {
+            if (m_datas[fd] || !auto_create) {
+                return m_datas[fd];
+            }
+        } else if (!auto_create) {
+            return nullptr;
+        }
+    }
+
+    RWMutexType::WriteLock lock(m_mutex);
+    if ((int)m_datas.size() <= fd) {
+        m_datas.resize(fd * 1.5 + 1);
+    }
+    if (!m_datas[fd]) {
+        m_datas[fd].reset(new FdCtx(fd));
+    }
+    return m_datas[fd];
+}
+
+void FdManager::del(int fd) {
+    RWMutexType::WriteLock lock(m_mutex);
+    if (fd < 0 || (int)m_datas.size() <= fd) {
+        return;
+    }
+    m_datas[fd].reset();
+}
+
+} // namespace sylar
@@ -0,0 +1,78 @@
+#ifndef MYSYLAR_FD_MANAGER_H
+#define MYSYLAR_FD_MANAGER_H
+
+#include "singleton.h"
+#include "thread.h"
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+namespace sylar {
+
+/* 文件描述符上下文，记录hook的IO函数需要的fd信息
+ * 被管理的socket在系统层面总是非阻塞的，用户通过fcntl/ioctl设置的非阻塞标志单独记录，
+ * 用户未设置非阻塞时，hook的IO函数在fd未就绪时让出协程，模拟阻塞IO
+ */
+class FdCtx {
+public:
+    typedef std::shared_ptr<FdCtx> ptr;
+
+    FdCtx(int fd);
+
+    bool isInit() const { return m_isInit; }
+    bool isSocket() const { return m_isSocket; }
+
+    void setUserNonblock(bool v) { m_userNonblock = v; }
+    bool getUserNonblock() const { return m_userNonblock; }
+
+    void setSysNonblock(bool v) { m_sysNonblock = v; }
+    bool getSysNonblock() const { return m_sysNonblock; }
+
+    /* close时标记，等待事件的协程据此发现fd已在其他线程被关闭 */
+    void setClosed() { m_isClosed = true; }
+    bool isClosed() const { return m_isClosed; }
+
+    /* 设置/获取超时时间，单位ms，~0ull表示不超时
+     * type: SO_RCVTIMEO读超时，SO_SNDTIMEO写超时
+     */
+    void setTimeout(int type, uint64_t v);
+    uint64_t getTimeout(int type) const;
+
+private:
+    bool init();
+
+private:
+    bool m_isInit          = false; //是否初始化
+    bool m_isSocket        = false; //是否socket
+    bool m_sysNonblock     = false; //是否在系统层面设置了非阻塞
+    bool m_userNonblock    = false; //用户是否主动设置了非阻塞
+    int m_fd;                       //文件描述符
+    uint64_t m_recvTimeout = ~0ull; //读超时时间，单位ms
+    uint64_t m_sendTimeout = ~0ull; //写超时时间，单位ms
+
+    std::atomic<bool> m_isClosed{false}; //是否已被close
+};
+
+/* 文件描述符上下文管理，以fd为下标保存FdCtx */
+class FdManager {
+public:
+    typedef RWMutex RWMutexType;
+
+    FdManager();
+
+    /* 获取fd对应的上下文，auto_create为true时不存在则自动创建 */
+    FdCtx::ptr get(int fd, bool auto_create = false);
+    /* 删除fd对应的上下文，在close时调用 */
+    void del(int fd);
+
+private:
+    RWMutexType m_mutex;
+    std::vector<FdCtx::ptr> m_datas;
+};
+
+typedef Singleton<FdManager> FdMgr;
+
+} // namespace sylar
+
+#endif // MYSYLAR_FD_MANAGER_H
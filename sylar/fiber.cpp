@@ -2,8 +2,13 @@
 #include "config.h"
 #include "log.h"
 #include "macro.h"
+#include "stack_allocator.h"
 #include <atomic>
 
+#if defined(SYLAR_FIBER_ASM_CONTEXT) && !defined(SYLAR_HAS_ASM_CONTEXT)
+#error "FIBER_ASM_CONTEXT is only supported on x86_64 and aarch64"
+#endif
+
 namespace sylar {
 
 static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
@@ -23,15 +28,6 @@ static ConfigVar<uint32_t>::ptr g_fiber_stacksize =
     ConfigManager::LookUp<uint32_t>("fiber.stacksize", 1024 * 1024,
                                     "fiber stack size");
 
-class MallocStackAllocator {
-public:
-    static void *Alloc(size_t size) { return malloc(size); }
-
-    static void Dealloc(void *vp, size_t size) { return free(vp); }
-};
-
-using StackAllocator = MallocStackAllocator;
-
 uint64_t Fiber::GetFiberId() {
     if (t_fiber) {
         return t_fiber->getId();
@@ -45,13 +41,24 @@ Fiber::Fiber() {
 
     SetThis(this);
 
+#ifndef SYLAR_FIBER_ASM_CONTEXT
+    //汇编实现的主协程上下文在第一次切出时保存
     if (getcontext(&m_ctx)) {
         SYLAR_ASSERT2(false, "getcontext");
     }
+#endif
 
     ++s_fiber_count;
 }
 
+const char *Fiber::ContextBackend() {
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    return "asm";
+#else
+    return "ucontext";
+#endif
+}
+
 void Fiber::SetThis(Fiber *f) { t_fiber = f; }
 
 Fiber::ptr Fiber::GetThis() {
@@ -72,18 +79,12 @@ Fiber::Fiber(std::function<void(void *)> cb, void *arg, size_t stacksize)
     , m_arg(arg) {
     ++s_fiber_count;
     m_stacksize = stacksize ? stacksize : g_fiber_stacksize->getValue();
-    m_stack     = StackAllocator::Alloc(m_stacksize);
-
-    if (getcontext(&m_ctx)) {
-        SYLAR_ASSERT2(false, "getcontext");
-    }
+    m_allocator = StackAllocator::GetDefault();
+    m_stack     = m_allocator->alloc(m_stacksize);
+    SYLAR_ASSERT2(m_stack, "alloc fiber stack");
 
     // g_logger->setLevel(LogLevel::UNKNOWN); //调试时打开
-    m_ctx.uc_link          = nullptr;
-    m_ctx.uc_stack.ss_sp   = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
-
-    makecontext(&m_ctx, (void (*)()) & Fiber::MainFunc, 1, m_arg);
+    makeContext();
     SYLAR_LOG_DEBUG(g_logger) << "construct fibler: " << m_id;
 }
 
@@ -92,7 +93,7 @@ Fiber::~Fiber() {
     --s_fiber_count;
     if (m_stack) {
         SYLAR_ASSERT(m_state == FIBER_INIT || m_state == FIBER_TERMINATED);
-        StackAllocator::Dealloc(m_stack, m_stacksize);
+        m_allocator->dealloc(m_stack, m_stacksize);
         SYLAR_LOG_DEBUG(g_logger) << "dealloc stack: " << m_id;
     } else {                 //没有栈，说明是线程的主协程
         SYLAR_ASSERT(!m_cb); //主协程没有cb
@@ -111,6 +112,15 @@ void Fiber::reset(std::function<void(void *)> cb, void *arg) {
     SYLAR_ASSERT(m_state == FIBER_INIT || m_state == FIBER_TERMINATED);
     m_cb  = cb;
     m_arg = arg;
+    makeContext();
+    m_state = FIBER_INIT;
+}
+
+void Fiber::makeContext() {
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    m_ctx = sylar_make_context((char *)m_stack + m_stacksize, m_stacksize,
+                               &Fiber::MainFunc);
+#else
     if (getcontext(&m_ctx)) {
         SYLAR_ASSERT2(false, "getcontext");
     }
@@ -120,7 +130,7 @@ void Fiber::reset(std::function<void(void *)> cb, void *arg) {
     m_ctx.uc_stack.ss_size = m_stacksize;
 
     makecontext(&m_ctx, (void (*)()) & Fiber::MainFunc, 1, m_arg);
-    m_state = FIBER_INIT;
+#endif
 }
 
 //把目标协程和当前正在执行的协程交换，使其进行运行状态
@@ -128,22 +138,34 @@ void Fiber::resume() {
     SetThis(this);
     SYLAR_ASSERT(m_state != FIBER_RUNNING);
     m_state = FIBER_RUNNING;
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    //只有首次切入时m_arg才会作为MainFunc的参数
+    sylar_jump_context(&t_threadFiber->m_ctx, m_ctx, m_arg);
+#else
     if (swapcontext(&(t_threadFiber->m_ctx), &m_ctx)) {
         SYLAR_ASSERT2(false, "swapcontext");
     }
+#endif
+
+    //协程已切回主协程，此时才将状态设置为FIBER_PENDING。多线程调度时，协程在yield
+    //之前可能已被重新加入调度，调度器据此判断协程上下文是否已保存完毕，可以被其他线程resume
+    //线程运行完之后还会再yield一次，用于回到主协程，此时状态已为结束状态
+    if (m_state == FIBER_RUNNING) {
+        m_state = FIBER_PENDING;
+    }
 }
 
 //从当前协程切回线程的主协程
 void Fiber::yield() {
     SetThis(t_threadFiber.get());
-    //线程运行完之后还会再yield一次，用于回到主协程，此时状态已为结束状态
-    if (m_state != FIBER_TERMINATED) {
-        m_state = FIBER_PENDING;
-    }
 
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    sylar_jump_context(&m_ctx, t_threadFiber->m_ctx, nullptr);
+#else
     if (swapcontext(&m_ctx, &(t_threadFiber->m_ctx))) {
         SYLAR_ASSERT2(false, "swapcontext");
     }
+#endif
 }
 
 void Fiber::MainFunc(void *arg) {
@@ -1,13 +1,17 @@
 #ifndef MYSYLAR_FIBER_H
 #define MYSYLAR_FIBER_H
 
+#include "fcontext.h"
 #include "thread.h"
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <ucontext.h>
 
 namespace sylar {
 
+class StackAllocator;
+
 class Fiber : public std::enable_shared_from_this<Fiber> {
 public:
     typedef std::shared_ptr<Fiber> ptr;
@@ -42,7 +46,14 @@ public:
     uint64_t getId() const { return m_id; }
     State getState() const { return m_state; }
 
+private:
+    //在协程栈上构造上下文，入口为MainFunc
+    void makeContext();
+
 public:
+    //当前使用的上下文切换方式，asm或ucontext
+    static const char *ContextBackend();
+
     //设置当前正在运行的协程，即设置线程局部变量t_fiber的值
     static void SetThis(Fiber *f);
 
@@ -61,12 +72,17 @@ public:
     static uint64_t GetFiberId();
 
 private:
-    uint64_t m_id        = 0;          //协程号
-    uint32_t m_stacksize = 0;          //协程栈大小
-    State m_state        = FIBER_INIT; //协程状态
-
-    ucontext_t m_ctx;        //协程上下文
-    void *m_stack = nullptr; //协程栈
+    uint64_t m_id        = 0;           //协程号
+    uint32_t m_stacksize = 0;           //协程栈大小
+    std::atomic<State> m_state{FIBER_INIT}; //协程状态，可能被其他调度线程读取
+
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    void *m_ctx = nullptr; //协程上下文，即切出时的栈顶指针
+#else
+    ucontext_t m_ctx; //协程上下文
+#endif
+    void *m_stack               = nullptr; //协程栈
+    StackAllocator *m_allocator = nullptr; //分配栈的分配器，释放时使用同一个
 
     std::function<void(void *)> m_cb; //协程入口
     void *m_arg;                      //协程参数
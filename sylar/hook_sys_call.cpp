@@ -1,17 +1,64 @@
 #include "hook_sys_call.h"
+#include "config.h"
+#include "fd_manager.h"
 #include "fiber.h"
 #include "log.h"
 #include "scheduler.h"
 #include "sylar.h"
 #include "timer.h"
+#include <atomic>
 #include <dlfcn.h>
+#include <errno.h>
+#include <stdarg.h>
 #include <unistd.h>
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+//所有被hook的系统函数
+#define HOOK_SYS_FUNC_LIST(XX)                                                 \
+    XX(sleep)                                                                  \
+    XX(usleep)                                                                 \
+    XX(socket)                                                                 \
+    XX(connect)                                                                \
+    XX(accept)                                                                 \
+    XX(read)                                                                   \
+    XX(readv)                                                                  \
+    XX(recv)                                                                   \
+    XX(recvfrom)                                                               \
+    XX(recvmsg)                                                                \
+    XX(write)                                                                  \
+    XX(writev)                                                                 \
+    XX(send)                                                                   \
+    XX(sendto)                                                                 \
+    XX(sendmsg)                                                                \
+    XX(sendfile)                                                               \
+    XX(close)                                                                  \
+    XX(fcntl)                                                                  \
+    XX(ioctl)                                                                  \
+    XX(setsockopt)
+
+extern "C" {
+#define XX(name) name##_func_t g_sys_##name##_func = nullptr;
+HOOK_SYS_FUNC_LIST(XX)
+#undef XX
+}
+
+/* 获取原始的系统函数，其他库的全局对象构造时可能早于hook_init调用到被hook的函数，
+ * 所以每个hook函数内都要先检查一次
+ */
+#define HOOK_SYS_FUNC(name)                                                    \
+    if (!g_sys_##name##_func) {                                                \
+        g_sys_##name##_func = (name##_func_t)dlsym(RTLD_NEXT, #name);          \
+    }
+
 namespace sylar {
 
+//tcp连接超时时间，单位ms
+static ConfigVar<int>::ptr g_tcp_connect_timeout =
+    ConfigManager::LookUp("tcp.connect.timeout", 5000, "tcp connect timeout");
+
 static thread_local bool t_hook_sys_enable = false;
+static uint64_t s_connect_timeout          = -1;
 
 bool is_enable_hook_sys_call() { return t_hook_sys_enable; }
 
@@ -19,29 +66,127 @@ void enable_hook_sys_call() { t_hook_sys_enable = true; }
 
 static void hook_init() {
     // g_logger->setLevel(sylar::LogLevel::UNKNOWN); //调试时打开
+#define XX(name) HOOK_SYS_FUNC(name)
+    HOOK_SYS_FUNC_LIST(XX)
+#undef XX
 }
 struct _HookIniter {
     _HookIniter() {
         hook_init();
-        // todo：设置更多hook之前需要初始化的参数，如tcp连接超时，读写超时
+        s_connect_timeout = g_tcp_connect_timeout->getValue();
+
+        g_tcp_connect_timeout->addListener(
+            [](const int &old_value, const int &new_value) {
+                SYLAR_LOG_INFO(g_logger) << "tcp connect timeout changed from "
+                                         << old_value << " to " << new_value;
+                s_connect_timeout = new_value;
+            });
     }
 };
 static _HookIniter s_hook_initer;
 
 } // namespace sylar
 
-extern "C" {
+/* 等待IO事件的超时条件，超时定时器通过weak_ptr引用，IO先就绪时定时器回调不再生效
+ * 定时器回调和等待的协程可能在不同的调度线程上访问cancelled，所以用原子变量
+ */
+struct timer_info {
+    std::atomic<int> cancelled{0};
+};
 
-typedef unsigned int (*sleep_func_t)(unsigned int seconds);
-typedef int (*usleep_func_t)(useconds_t usec);
+/* 在调度器上等待fd的事件并让出当前协程，timeout毫秒内事件未就绪时取消等待
+ * 返回0表示事件就绪，-1表示等待失败或超时，超时时errno为timeout_errno
+ */
+static int wait_event(sylar::Scheduler *psc, sylar::FdCtx::ptr ctx, int fd,
+                      uint32_t event, uint64_t timeout, int timeout_errno) {
+    std::shared_ptr<timer_info> tinfo(new timer_info);
+    sylar::Timer::ptr timer;
+    if (timeout != (uint64_t)-1) {
+        std::weak_ptr<timer_info> winfo(tinfo);
+        timer = psc->addTimer(timeout, [winfo, psc, fd, event,
+                                        timeout_errno](void *) {
+            auto t = winfo.lock();
+            int expected = 0;
+            if (!t || !t->cancelled.compare_exchange_strong(expected,
+                                                            timeout_errno)) {
+                return;
+            }
+            psc->io_cancel(fd, event);
+        });
+    }
 
-static sleep_func_t g_sys_sleep_func   = nullptr;
-static usleep_func_t g_sys_usleep_func = nullptr;
+    sylar::Fiber::ptr self = sylar::Fiber::GetThis();
+    if (psc->io_wait(fd, event, self)) {
+        SYLAR_LOG_ERROR(g_logger)
+            << "io_wait(" << fd << ", " << event << ") failed";
+        if (timer) {
+            psc->timer_schedule(timer, EPOLL_CTL_DEL);
+        }
+        return -1;
+    }
+    /* 其他线程可能正在close该fd，close先标记关闭再取消等待，这里先登记等待再检查标记，
+     * 两者至少有一方能看到对方，避免等待登记在取消之后、fd关闭之前而永远不被唤醒
+     */
+    if (ctx->isClosed()) {
+        psc->io_cancel(fd, event);
+    }
+    self->yield();
 
-#define HOOK_SYS_FUNC(name)                                                    \
-    if (!g_sys_##name##_func) {                                                \
-        g_sys_##name##_func = (name##_func_t)dlsym(RTLD_NEXT, #name);          \
+    if (timer) {
+        psc->timer_schedule(timer, EPOLL_CTL_DEL);
+    }
+    int cancelled = tinfo->cancelled.load();
+    if (cancelled) {
+        errno = cancelled;
+        return -1;
+    }
+    return 0;
+}
+
+/* IO操作的通用hook流程
+ * 调度线程内的socket，且用户未设置非阻塞时，先以非阻塞方式调用原始函数，返回EAGAIN
+ * 时在调度器上等待fd的读/写事件并让出当前协程，事件就绪后协程被重新调度，再次调用原始
+ * 函数；其他情况直接调用原始函数
+ * fd: 文件描述符
+ * fun: 原始系统函数
+ * hook_fun_name: 函数名，用于日志
+ * event: 需要等待的事件，EPOLLIN/EPOLLOUT
+ * timeout_so: 超时类型，SO_RCVTIMEO/SO_SNDTIMEO
+ */
+template <typename OriginFun, typename... Args>
+static ssize_t do_io(int fd, OriginFun fun, const char *hook_fun_name,
+                     uint32_t event, int timeout_so, Args &&... args) {
+    if (!sylar::is_enable_hook_sys_call()) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
+    if (!ctx || !ctx->isSocket() || ctx->getUserNonblock()) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    sylar::Scheduler *psc = sylar::Scheduler::getThis();
+    uint64_t timeout      = ctx->getTimeout(timeout_so);
+    while (true) {
+        ssize_t n = fun(fd, std::forward<Args>(args)...);
+        while (n == -1 && errno == EINTR) {
+            n = fun(fd, std::forward<Args>(args)...);
+        }
+        if (n != -1 || errno != EAGAIN) {
+            return n;
+        }
+
+        //fd未就绪，等待事件并让出协程，超时返回EAGAIN，与阻塞socket的超时行为一致
+        if (wait_event(psc, ctx, fd, event, timeout, EAGAIN)) {
+            SYLAR_LOG_DEBUG(g_logger)
+                << hook_fun_name << "(" << fd << ") wait failed, errno="
+                << errno;
+            return -1;
+        }
     }
+}
+
+extern "C" {
 
 unsigned int sleep(unsigned int seconds) {
     SYLAR_LOG_DEBUG(g_logger) << "enter hooked sleep";
@@ -80,4 +225,271 @@ int usleep(useconds_t usec) {
     return 0;
 }
 
+int socket(int domain, int type, int protocol) {
+    HOOK_SYS_FUNC(socket);
+    int fd = g_sys_socket_func(domain, type, protocol);
+    if (fd == -1 || !sylar::is_enable_hook_sys_call()) {
+        return fd;
+    }
+    //调度线程内创建的socket纳入管理，并在系统层面设为非阻塞
+    sylar::FdMgr::GetInstance()->get(fd, true);
+    return fd;
+}
+
+int connect_with_timeout(int fd, const struct sockaddr *addr,
+                         socklen_t addrlen, uint64_t timeout_ms) {
+    HOOK_SYS_FUNC(connect);
+    if (!sylar::is_enable_hook_sys_call()) {
+        return g_sys_connect_func(fd, addr, addrlen);
+    }
+
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
+    if (!ctx || !ctx->isSocket() || ctx->getUserNonblock()) {
+        return g_sys_connect_func(fd, addr, addrlen);
+    }
+
+    int n = g_sys_connect_func(fd, addr, addrlen);
+    if (n == 0) {
+        return 0;
+    } else if (n != -1 || errno != EINPROGRESS) {
+        return n;
+    }
+
+    //连接建立中，等待fd可写，超时返回ETIMEDOUT
+    if (wait_event(sylar::Scheduler::getThis(), ctx, fd, EPOLLOUT, timeout_ms,
+                   ETIMEDOUT)) {
+        return -1;
+    }
+
+    int error     = 0;
+    socklen_t len = sizeof(int);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+        return -1;
+    }
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
+    return connect_with_timeout(sockfd, addr, addrlen,
+                                sylar::s_connect_timeout);
+}
+
+int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
+    HOOK_SYS_FUNC(accept);
+    int fd = do_io(s, g_sys_accept_func, "accept", EPOLLIN, SO_RCVTIMEO, addr,
+                   addrlen);
+    if (fd >= 0 && sylar::is_enable_hook_sys_call()) {
+        sylar::FdMgr::GetInstance()->get(fd, true);
+    }
+    return fd;
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    HOOK_SYS_FUNC(read);
+    return do_io(fd, g_sys_read_func, "read", EPOLLIN, SO_RCVTIMEO, buf,
+                 count);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+    HOOK_SYS_FUNC(readv);
+    return do_io(fd, g_sys_readv_func, "readv", EPOLLIN, SO_RCVTIMEO, iov,
+                 iovcnt);
+}
+
+ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+    HOOK_SYS_FUNC(recv);
+    return do_io(sockfd, g_sys_recv_func, "recv", EPOLLIN, SO_RCVTIMEO, buf,
+                 len, flags);
+}
+
+ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags,
+                 struct sockaddr *src_addr, socklen_t *addrlen) {
+    HOOK_SYS_FUNC(recvfrom);
+    return do_io(sockfd, g_sys_recvfrom_func, "recvfrom", EPOLLIN, SO_RCVTIMEO,
+                 buf, len, flags, src_addr, addrlen);
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
+    HOOK_SYS_FUNC(recvmsg);
+    return do_io(sockfd, g_sys_recvmsg_func, "recvmsg", EPOLLIN, SO_RCVTIMEO,
+                 msg, flags);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    HOOK_SYS_FUNC(write);
+    return do_io(fd, g_sys_write_func, "write", EPOLLOUT, SO_SNDTIMEO, buf,
+                 count);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    HOOK_SYS_FUNC(writev);
+    return do_io(fd, g_sys_writev_func, "writev", EPOLLOUT, SO_SNDTIMEO, iov,
+                 iovcnt);
+}
+
+ssize_t send(int s, const void *msg, size_t len, int flags) {
+    HOOK_SYS_FUNC(send);
+    return do_io(s, g_sys_send_func, "send", EPOLLOUT, SO_SNDTIMEO, msg, len,
+                 flags);
+}
+
+ssize_t sendto(int s, const void *msg, size_t len, int flags,
+               const struct sockaddr *to, socklen_t tolen) {
+    HOOK_SYS_FUNC(sendto);
+    return do_io(s, g_sys_sendto_func, "sendto", EPOLLOUT, SO_SNDTIMEO, msg,
+                 len, flags, to, tolen);
+}
+
+ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
+    HOOK_SYS_FUNC(sendmsg);
+    return do_io(s, g_sys_sendmsg_func, "sendmsg", EPOLLOUT, SO_SNDTIMEO, msg,
+                 flags);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    HOOK_SYS_FUNC(sendfile);
+    return do_io(out_fd, g_sys_sendfile_func, "sendfile", EPOLLOUT,
+                 SO_SNDTIMEO, in_fd, offset, count);
+}
+
+int close(int fd) {
+    HOOK_SYS_FUNC(close);
+    //无论是否开启hook都要删除fd上下文，避免fd被复用时使用到过期的上下文
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
+    if (ctx) {
+        //唤醒所有等待该fd的协程，它们再次调用IO函数时会得到EBADF
+        ctx->setClosed();
+        sylar::Scheduler *psc = sylar::Scheduler::getThis();
+        if (psc) {
+            psc->io_cancel_all(fd);
+        }
+        sylar::FdMgr::GetInstance()->del(fd);
+    }
+    return g_sys_close_func(fd);
+}
+
+int fcntl(int fd, int cmd, ... /* arg */) {
+    HOOK_SYS_FUNC(fcntl);
+    va_list va;
+    va_start(va, cmd);
+    switch (cmd) {
+    case F_SETFL: {
+        int arg = va_arg(va, int);
+        va_end(va);
+        /* 被管理的socket只记录用户设置的非阻塞标志，系统层面保持非阻塞 */
+        sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
+        if (ctx && ctx->isSocket()) {
+            ctx->setUserNonblock(arg & O_NONBLOCK);
+            if (ctx->getSysNonblock()) {
+                arg |= O_NONBLOCK;
+            } else {
+                arg &= ~O_NONBLOCK;
+            }
+        }
+        return g_sys_fcntl_func(fd, cmd, arg);
+    } break;
+    case F_GETFL: {
+        va_end(va);
+        int arg               = g_sys_fcntl_func(fd, cmd);
+        sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
+        if (arg == -1 || !ctx || !ctx->isSocket()) {
+            return arg;
+        }
+        //返回用户看到的非阻塞标志
+        if (ctx->getUserNonblock()) {
+            return arg | O_NONBLOCK;
+        } else {
+            return arg & ~O_NONBLOCK;
+        }
+    } break;
+    case F_DUPFD:
+    case F_DUPFD_CLOEXEC:
+    case F_SETFD:
+    case F_SETOWN:
+    case F_SETSIG:
+    case F_SETLEASE:
+    case F_NOTIFY:
+#ifdef F_SETPIPE_SZ
+    case F_SETPIPE_SZ:
+#endif
+    {
+        int arg = va_arg(va, int);
+        va_end(va);
+        return g_sys_fcntl_func(fd, cmd, arg);
+    } break;
+    case F_GETFD:
+    case F_GETOWN:
+    case F_GETSIG:
+    case F_GETLEASE:
+#ifdef F_GETPIPE_SZ
+    case F_GETPIPE_SZ:
+#endif
+    {
+        va_end(va);
+        return g_sys_fcntl_func(fd, cmd);
+    } break;
+    case F_SETLK:
+    case F_SETLKW:
+    case F_GETLK: {
+        struct flock *arg = va_arg(va, struct flock *);
+        va_end(va);
+        return g_sys_fcntl_func(fd, cmd, arg);
+    } break;
+    case F_GETOWN_EX:
+    case F_SETOWN_EX: {
+        struct f_owner_ex *arg = va_arg(va, struct f_owner_ex *);
+        va_end(va);
+        return g_sys_fcntl_func(fd, cmd, arg);
+    } break;
+    default:
+        va_end(va);
+        return g_sys_fcntl_func(fd, cmd);
+    }
+}
+
+int ioctl(int d, unsigned long int request, ...) {
+    HOOK_SYS_FUNC(ioctl);
+    va_list va;
+    va_start(va, request);
+    void *arg = va_arg(va, void *);
+    va_end(va);
+
+    if (request == FIONBIO) {
+        //与fcntl(F_SETFL)一致，只记录用户设置的非阻塞标志
+        sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(d);
+        if (ctx && ctx->isSocket()) {
+            ctx->setUserNonblock(!!*(int *)arg);
+            if (ctx->getSysNonblock()) {
+                return 0;
+            }
+        }
+    }
+    return g_sys_ioctl_func(d, request, arg);
+}
+
+int setsockopt(int sockfd, int level, int optname, const void *optval,
+               socklen_t optlen) {
+    HOOK_SYS_FUNC(setsockopt);
+    if (!sylar::is_enable_hook_sys_call()) {
+        return g_sys_setsockopt_func(sockfd, level, optname, optval, optlen);
+    }
+
+    //记录用户设置的读写超时，由hook的IO函数实现超时，系统层面的超时对非阻塞socket无效
+    if (level == SOL_SOCKET &&
+        (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO)) {
+        sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(sockfd);
+        if (ctx && optval && optlen >= sizeof(timeval)) {
+            const timeval *v = (const timeval *)optval;
+            uint64_t ms      = v->tv_sec * 1000 + v->tv_usec / 1000;
+            //与系统一致，0表示不超时
+            ctx->setTimeout(optname, ms ? ms : (uint64_t)-1);
+        }
+    }
+    return g_sys_setsockopt_func(sockfd, level, optname, optval, optlen);
+}
+
 } // end extern "C"
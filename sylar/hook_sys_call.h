@@ -1,5 +1,13 @@
 #ifndef MYSYLAR_HOOK_SYS_CALL_H
 #define MYSYLAR_HOOK_SYS_CALL_H
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 namespace sylar {
@@ -7,9 +15,90 @@ bool is_enable_hook_sys_call();
 void enable_hook_sys_call();
 }; // namespace sylar
 
+/* 被hook的系统函数，调度线程内socket的IO在未就绪时让出当前协程，就绪后再恢复执行，
+ * 原始的系统函数保存在g_sys_xxx_func中
+ */
 extern "C" {
+
+// sleep
+typedef unsigned int (*sleep_func_t)(unsigned int seconds);
+extern sleep_func_t g_sys_sleep_func;
+
+typedef int (*usleep_func_t)(useconds_t usec);
+extern usleep_func_t g_sys_usleep_func;
+
+// socket
+typedef int (*socket_func_t)(int domain, int type, int protocol);
+extern socket_func_t g_sys_socket_func;
+
+typedef int (*connect_func_t)(int sockfd, const struct sockaddr *addr,
+                              socklen_t addrlen);
+extern connect_func_t g_sys_connect_func;
+
+typedef int (*accept_func_t)(int s, struct sockaddr *addr, socklen_t *addrlen);
+extern accept_func_t g_sys_accept_func;
+
+// read
+typedef ssize_t (*read_func_t)(int fd, void *buf, size_t count);
+extern read_func_t g_sys_read_func;
+
+typedef ssize_t (*readv_func_t)(int fd, const struct iovec *iov, int iovcnt);
+extern readv_func_t g_sys_readv_func;
+
+typedef ssize_t (*recv_func_t)(int sockfd, void *buf, size_t len, int flags);
+extern recv_func_t g_sys_recv_func;
+
+typedef ssize_t (*recvfrom_func_t)(int sockfd, void *buf, size_t len,
+                                   int flags, struct sockaddr *src_addr,
+                                   socklen_t *addrlen);
+extern recvfrom_func_t g_sys_recvfrom_func;
+
+typedef ssize_t (*recvmsg_func_t)(int sockfd, struct msghdr *msg, int flags);
+extern recvmsg_func_t g_sys_recvmsg_func;
+
+// write
+typedef ssize_t (*write_func_t)(int fd, const void *buf, size_t count);
+extern write_func_t g_sys_write_func;
+
+typedef ssize_t (*writev_func_t)(int fd, const struct iovec *iov, int iovcnt);
+extern writev_func_t g_sys_writev_func;
+
+typedef ssize_t (*send_func_t)(int s, const void *msg, size_t len, int flags);
+extern send_func_t g_sys_send_func;
+
+typedef ssize_t (*sendto_func_t)(int s, const void *msg, size_t len, int flags,
+                                 const struct sockaddr *to, socklen_t tolen);
+extern sendto_func_t g_sys_sendto_func;
+
+typedef ssize_t (*sendmsg_func_t)(int s, const struct msghdr *msg, int flags);
+extern sendmsg_func_t g_sys_sendmsg_func;
+
+typedef ssize_t (*sendfile_func_t)(int out_fd, int in_fd, off_t *offset,
+                                   size_t count);
+extern sendfile_func_t g_sys_sendfile_func;
+
+// fd
+typedef int (*close_func_t)(int fd);
+extern close_func_t g_sys_close_func;
+
+typedef int (*fcntl_func_t)(int fd, int cmd, ... /* arg */);
+extern fcntl_func_t g_sys_fcntl_func;
+
+typedef int (*ioctl_func_t)(int d, unsigned long int request, ...);
+extern ioctl_func_t g_sys_ioctl_func;
+
+typedef int (*setsockopt_func_t)(int sockfd, int level, int optname,
+                                 const void *optval, socklen_t optlen);
+extern setsockopt_func_t g_sys_setsockopt_func;
+
 unsigned int sleep(unsigned int seconds);
 int usleep(useconds_t usec);
+
+/* 带超时的connect，timeout_ms为-1时不超时，超时返回-1，errno为ETIMEDOUT
+ * hook的connect使用配置项tcp.connect.timeout作为超时时间
+ */
+int connect_with_timeout(int fd, const struct sockaddr *addr,
+                         socklen_t addrlen, uint64_t timeout_ms);
 }
 
-#endif
\ No newline at end of file
+#endif
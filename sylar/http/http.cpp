@@ -60,15 +60,105 @@ HttpRequest::HttpRequest(uint8_t version, bool close)
     , m_close(close)
     , m_path("/") {}
 
+void HttpRequest::reset() {
+    m_method  = HttpMethod::GET;
+    m_version = 0x11;
+    m_close   = true;
+    m_path    = "/";
+    m_query.clear();
+    m_fragment.clear();
+    m_body.clear();
+    m_bodyStream.reset();
+    m_headers.clear();
+    m_headerViews.clear();
+    m_buffer.reset();
+    m_params.clear();
+    m_cookies.clear();
+    m_pathParams.clear();
+}
+
 std::shared_ptr<HttpResponse> HttpRequest::createResponse() {
     HttpResponse::ptr rsp(new HttpResponse(getVersion(), isClose()));
     return rsp;
 }
 
+/* 忽略大小写的FNV-1a哈希，只用于快速排除，相等时再用strncasecmp比较 */
+static uint32_t HashHeaderName(const char *name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (uint8_t)(name[i] | 0x20);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* 删除零拷贝解析的同名头部 */
+static void EraseHeaderView(HttpRequest::HeaderViews &views,
+                            const std::string &key) {
+    uint32_t hash = HashHeaderName(key.c_str(), key.size());
+    for (auto it = views.begin(); it != views.end();) {
+        if (it->hash == hash && it->name.size() == key.size() &&
+            strncasecmp(it->name.data(), key.c_str(), key.size()) == 0) {
+            it = views.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void HttpRequest::materializeHeaders() const {
+    for (auto &i : m_headerViews) {
+        m_headers[std::string(i.name.data(), i.name.size())] =
+            std::string(i.value.data(), i.value.size());
+    }
+    m_headerViews.clear();
+}
+
+const HttpRequest::MapType &HttpRequest::getHeaders() const {
+    materializeHeaders();
+    return m_headers;
+}
+
+void HttpRequest::addHeaderView(const char *name, size_t nlen,
+                                const char *value, size_t vlen) {
+    if (m_headerViews.empty()) {
+        m_headerViews.reserve(16);
+    }
+    HeaderView view;
+    view.hash  = HashHeaderName(name, nlen);
+    view.name  = boost::string_view(name, nlen);
+    view.value = boost::string_view(value, vlen);
+    m_headerViews.push_back(view);
+}
+
+bool HttpRequest::findHeader(const boost::string_view &key,
+                             boost::string_view &val) const {
+    /* map中一般只有少量修改过的头部，直接遍历比较，避免构造string */
+    for (auto &i : m_headers) {
+        if (i.first.size() == key.size() &&
+            strncasecmp(i.first.data(), key.data(), key.size()) == 0) {
+            val = i.second;
+            return true;
+        }
+    }
+    if (m_headerViews.empty()) {
+        return false;
+    }
+    uint32_t hash = HashHeaderName(key.data(), key.size());
+    for (auto it = m_headerViews.rbegin(); it != m_headerViews.rend(); ++it) {
+        if (it->hash == hash && it->name.size() == key.size() &&
+            strncasecmp(it->name.data(), key.data(), key.size()) == 0) {
+            val = it->value;
+            return true;
+        }
+    }
+    return false;
+}
+
 std::string HttpRequest::getHeader(const std::string &key,
                                    const std::string &def) const {
-    auto it = m_headers.find(key);
-    return it == m_headers.end() ? def : it->second;
+    boost::string_view val;
+    return findHeader(key, val) ? std::string(val.data(), val.size()) : def;
 }
 
 std::string HttpRequest::getParam(const std::string &key,
@@ -83,7 +173,14 @@ std::string HttpRequest::getCookie(const std::string &key,
     return it == m_cookies.end() ? def : it->second;
 }
 
+std::string HttpRequest::getPathParam(const std::string &key,
+                                      const std::string &def) {
+    auto it = m_pathParams.find(key);
+    return it == m_pathParams.end() ? def : it->second;
+}
+
 void HttpRequest::setHeader(const std::string &key, const std::string &val) {
+    EraseHeaderView(m_headerViews, key);
     m_headers[key] = val;
 }
 
@@ -94,16 +191,24 @@ void HttpRequest::setParam(const std::string &key, const std::string &val) {
 void HttpRequest::setCookie(const std::string &key, const std::string &val) {
     m_cookies[key] = val;
 }
-void HttpRequest::delHeader(const std::string &key) { m_headers.erase(key); }
+
+void HttpRequest::setPathParam(const std::string &key,
+                               const std::string &val) {
+    m_pathParams[key] = val;
+}
+void HttpRequest::delHeader(const std::string &key) {
+    EraseHeaderView(m_headerViews, key);
+    m_headers.erase(key);
+}
 void HttpRequest::delParam(const std::string &key) { m_params.erase(key); }
 void HttpRequest::delCookie(const std::string &key) { m_cookies.erase(key); }
 bool HttpRequest::hasHeader(const std::string &key, std::string *val) {
-    auto it = m_headers.find(key);
-    if (it == m_headers.end()) {
+    boost::string_view v;
+    if (!findHeader(key, v)) {
         return false;
     }
     if (val) {
-        *val = it->second;
+        val->assign(v.data(), v.size());
     }
     return true;
 }
@@ -136,7 +241,7 @@ std::string HttpRequest::toString() const {
 
 std::ostream &HttpRequest::dump(std::ostream &os) const {
     os << HttpMethodToString(m_method) << " " << m_path
-       << (m_query.empty() ? "" : "?") << m_fragment << " HTTP/"
+       << (m_query.empty() ? "" : "?") << m_query << " HTTP/"
        << ((uint32_t)(m_version >> 4)) << "." << ((uint32_t)(m_version & 0xf))
        << "\r\n";
 
@@ -148,6 +253,13 @@ std::ostream &HttpRequest::dump(std::ostream &os) const {
         }
         os << i.first << ": " << i.second << "\r\n";
     }
+    for (auto &i : m_headerViews) {
+        if (i.name.size() == 10 &&
+            strncasecmp(i.name.data(), "connection", 10) == 0) {
+            continue;
+        }
+        os << i.name << ": " << i.value << "\r\n";
+    }
 
     if (!m_body.empty()) {
         os << "content-length: " << m_body.size() << "\r\n\r\n" << m_body;
@@ -161,7 +273,8 @@ std::ostream &HttpRequest::dump(std::ostream &os) const {
 HttpResponse::HttpResponse(uint8_t version, bool close)
     : m_status(HttpStatus::OK)
     , m_version(version)
-    , m_close(close) {}
+    , m_close(close)
+    , m_chunked(false) {}
 
 std::string HttpResponse::getHeader(const std::string &key,
                                     const std::string &def) const {
@@ -182,24 +295,189 @@ std::string HttpResponse::toString() const {
 }
 
 std::ostream &HttpResponse::dump(std::ostream &os) const {
-    os << "HTTP/" << ((uint32_t)(m_version >> 4)) << "."
-       << ((uint32_t)(m_version & 0xf)) << " " << (uint32_t)m_status << " "
-       << (m_reason.empty() ? HttpStatusToString(m_status) : m_reason)
-       << "\r\n";
+    dumpHead(os);
+    if (m_chunked) {
+        if (!m_body.empty()) {
+            os << std::hex << m_body.size() << std::dec << "\r\n" << m_body
+               << "\r\n";
+        }
+        os << "0\r\n\r\n";
+    } else {
+        os << m_body;
+    }
+    return os;
+}
+
+std::ostream &HttpResponse::dumpHead(std::ostream &os) const {
+    std::string buf;
+    appendHead(buf);
+    return os << buf;
+}
 
+/* 按十进制追加无符号整数 */
+static void AppendUInt(std::string &buf, uint64_t v) {
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *p   = end;
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    buf.append(p, end - p);
+}
+
+#define STATUS_LINE(version, code, msg)                                        \
+    boost::string_view("HTTP/" #version " " #code " " #msg "\r\n",            \
+                       sizeof("HTTP/" #version " " #code " " #msg "\r\n") - 1)
+
+/* 预先生成的HTTP/1.0和HTTP/1.1的状态行，其他版本和未知的状态码返回空 */
+static boost::string_view HttpStatusLine(uint8_t version, HttpStatus s) {
+    if (version != 0x10 && version != 0x11) {
+        return boost::string_view();
+    }
+    switch (s) {
+#define XX(code, name, msg)                                                    \
+    case HttpStatus::name:                                                     \
+        return version == 0x11 ? STATUS_LINE(1.1, code, msg)                   \
+                               : STATUS_LINE(1.0, code, msg);
+        HTTP_STATUS_MAP(XX)
+#undef XX
+
+    default:
+        return boost::string_view();
+    }
+}
+
+#undef STATUS_LINE
+
+static const char *s_http_days[]   = {"Sun", "Mon", "Tue", "Wed",
+                                      "Thu", "Fri", "Sat"};
+static const char *s_http_months[] = {"Jan", "Feb", "Mar", "Apr",
+                                      "May", "Jun", "Jul", "Aug",
+                                      "Sep", "Oct", "Nov", "Dec"};
+
+/* 按RFC 7231的IMF-fixdate格式化时间，前面加上prefix，返回写入的长度 */
+static int FormatHttpDate(time_t t, const char *prefix, char *buf,
+                          size_t size) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return snprintf(buf, size, "%s%s, %02d %s %04d %02d:%02d:%02d GMT", prefix,
+                    s_http_days[tm.tm_wday], tm.tm_mday,
+                    s_http_months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour,
+                    tm.tm_min, tm.tm_sec);
+}
+
+std::string HttpDateToString(time_t t) {
+    char buf[64];
+    return std::string(buf, FormatHttpDate(t, "", buf, sizeof(buf)));
+}
+
+time_t StringToHttpDate(const std::string &s) {
+    char day[4];
+    char month[4];
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(s.c_str(), "%3s, %2d %3s %4d %2d:%2d:%2d GMT", day,
+               &tm.tm_mday, month, &tm.tm_year, &tm.tm_hour, &tm.tm_min,
+               &tm.tm_sec) != 7) {
+        return -1;
+    }
+    tm.tm_mon = -1;
+    for (int i = 0; i < 12; ++i) {
+        if (strcmp(month, s_http_months[i]) == 0) {
+            tm.tm_mon = i;
+            break;
+        }
+    }
+    if (tm.tm_mon < 0) {
+        return -1;
+    }
+    tm.tm_year -= 1900;
+    return timegm(&tm);
+}
+
+/* 追加当前时间的Date头部(RFC 7231)，每个线程缓存格式化的结果，每秒最多格式化一次，
+ * 各线程之间不需要同步
+ */
+static void AppendDate(std::string &buf) {
+    static thread_local time_t t_second = -1;
+    static thread_local char t_date[64];
+    static thread_local size_t t_length = 0;
+
+    time_t now = time(nullptr);
+    if (now != t_second) {
+        t_length = FormatHttpDate(now, "date: ", t_date, sizeof(t_date) - 2);
+        t_date[t_length++] = '\r';
+        t_date[t_length++] = '\n';
+        t_second           = now;
+    }
+    buf.append(t_date, t_length);
+}
+
+void HttpResponse::appendHead(std::string &buf) const {
+    boost::string_view line;
+    if (m_reason.empty()) {
+        line = HttpStatusLine(m_version, m_status);
+    }
+    if (!line.empty()) {
+        buf.append(line.data(), line.size());
+    } else {
+        buf.append("HTTP/");
+        buf.push_back('0' + (m_version >> 4));
+        buf.push_back('.');
+        buf.push_back('0' + (m_version & 0xf));
+        buf.push_back(' ');
+        AppendUInt(buf, (uint32_t)m_status);
+        buf.push_back(' ');
+        if (m_reason.empty()) {
+            buf.append(HttpStatusToString(m_status));
+        } else {
+            buf.append(m_reason);
+        }
+        buf.append("\r\n");
+    }
+
+    bool has_date   = false;
+    bool has_length = false;
     for (auto &i : m_headers) {
-        if (strcasecmp(i.first.c_str(), "connection") == 0) {
+        if (i.first.size() == 10 &&
+            strcasecmp(i.first.c_str(), "connection") == 0) {
             continue;
         }
-        os << i.first << ": " << i.second << "\r\n";
+        if (i.first.size() == 4 && strcasecmp(i.first.c_str(), "date") == 0) {
+            has_date = true;
+        } else if (i.first.size() == 14 &&
+                   strcasecmp(i.first.c_str(), "content-length") == 0) {
+            //分块编码的响应不能同时带有content-length(RFC 7230 3.3.3)
+            if (m_chunked) {
+                continue;
+            }
+            has_length = true;
+        } else if (m_chunked && i.first.size() == 17 &&
+                   strcasecmp(i.first.c_str(), "transfer-encoding") == 0) {
+            //下面统一添加
+            continue;
+        }
+        buf.append(i.first).append(": ").append(i.second).append("\r\n");
     }
-    os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
-    if (!m_body.empty()) {
-        os << "content-length: " << m_body.size() << "\r\n\r\n" << m_body;
-    } else {
-        os << "\r\n";
+    //没有设置Date头部时使用当前时间
+    if (!has_date) {
+        AppendDate(buf);
     }
-    return os;
+    buf.append(m_close ? "connection: close\r\n" : "connection: keep-alive\r\n");
+    //没有消息体时也要带上content-length: 0，否则保持连接的客户端无法判断响应结束，
+    //1xx、204、304响应没有消息体
+    uint32_t status = (uint32_t)m_status;
+    if (m_chunked) {
+        buf.append("transfer-encoding: chunked\r\n");
+    } else if (!has_length &&
+               (!m_body.empty() || (status >= 200 && status != 204 &&
+                                    status != 304))) {
+        buf.append("content-length: ");
+        AppendUInt(buf, m_body.size());
+        buf.append("\r\n");
+    }
+    buf.append("\r\n");
 }
 
 std::ostream &operator<<(std::ostream &os, const HttpRequest &req) {
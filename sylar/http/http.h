@@ -1,8 +1,10 @@
 #ifndef MYSYLAR_HTTP_H
 #define MYSYLAR_HTTP_H
 
+#include "sylar/stream.h"
 #include "sylar/sylar.h"
 #include <boost/lexical_cast.hpp>
+#include <boost/utility/string_view.hpp>
 #include <iostream>
 #include <map>
 #include <sstream>
@@ -136,6 +138,9 @@ HttpMethod StringToHttpMethod(const std::string &m);
 HttpMethod CharsToHttpMethod(const char *m);
 const char *HttpMethodToString(const HttpMethod &m);
 const char *HttpStatusToString(const HttpStatus &s);
+/* 按RFC 7231的格式转换时间，如"Sun, 06 Nov 1994 08:49:37 GMT"，解析失败返回-1 */
+std::string HttpDateToString(time_t t);
+time_t StringToHttpDate(const std::string &s);
 
 struct CaseInsensitiveLess {
     //用于map模板类的忽略大小写比较字符串
@@ -186,35 +191,60 @@ public:
     typedef std::shared_ptr<HttpRequest> ptr;
     typedef std::map<std::string, std::string, CaseInsensitiveLess> MapType;
 
+    /* 零拷贝解析的头部，name和value指向接收缓冲区 */
+    struct HeaderView {
+        uint32_t hash; // name忽略大小写的哈希值
+        boost::string_view name;
+        boost::string_view value;
+    };
+    typedef std::vector<HeaderView> HeaderViews;
+
     HttpRequest(uint8_t version = 0x11, bool close = true);
+    /* 恢复为默认构造的状态，保留已申请的内存，用于连接上复用请求对象 */
+    void reset();
     std::shared_ptr<HttpResponse> createResponse();
     HttpMethod getMethod() const { return m_method; }
     uint8_t getVersion() const { return m_version; }
     const std::string &getPath() const { return m_path; }
     const std::string &getQuery() const { return m_query; }
     const std::string &getBody() const { return m_body; }
-    const MapType &getHeaders() const { return m_headers; }
+    /* 先调用materializeHeaders将零拷贝解析的头部拷贝到map中 */
+    const MapType &getHeaders() const;
     const MapType &getParams() const { return m_params; }
     const MapType &getCookies() const { return m_cookies; }
+    /* 路由匹配得到的路径参数，如"/user/:id"中的id，通配符匹配的部分为"*" */
+    const MapType &getPathParams() const { return m_pathParams; }
     void setMethod(HttpMethod v) { m_method = v; }
     void setVersion(uint8_t v) { m_version = v; }
     void setPath(const std::string &v) { m_path = v; }
     void setQuery(const std::string &v) { m_query = v; }
     void setFragment(const std::string &v) { m_fragment = v; }
     void setBody(const std::string &v) { m_body = v; }
+    /* 流式读取的消息体，消息体较大未读入body时由HttpSession设置，为nullptr表示消息体
+     * 已全部在body中
+     */
+    Stream::ptr getBodyStream() const { return m_bodyStream; }
+    void setBodyStream(Stream::ptr v) { m_bodyStream = v; }
     bool isClose() const { return m_close; }
     void setClose(bool v) { m_close = v; }
-    void setHeaders(const MapType &v) { m_headers = v; }
+    void setHeaders(const MapType &v) {
+        m_headers = v;
+        m_headerViews.clear();
+    }
     void setParams(const MapType &v) { m_params = v; }
     void setCookies(const MapType &v) { m_cookies = v; }
+    void setPathParams(const MapType &v) { m_pathParams = v; }
 
     std::string getHeader(const std::string &key,
                           const std::string &def = "") const;
     std::string getParam(const std::string &key, const std::string &def = "");
     std::string getCookie(const std::string &key, const std::string &def = "");
+    std::string getPathParam(const std::string &key,
+                             const std::string &def = "");
     void setHeader(const std::string &key, const std::string &val);
     void setParam(const std::string &key, const std::string &val);
     void setCookie(const std::string &key, const std::string &val);
+    void setPathParam(const std::string &key, const std::string &val);
     void delHeader(const std::string &key);
     void delParam(const std::string &key);
     void delCookie(const std::string &key);
@@ -222,14 +252,44 @@ public:
     bool hasParam(const std::string &key, std::string *val = nullptr);
     bool hasCookie(const std::string &key, std::string *val = nullptr);
 
+    /* 保持接收缓冲区，零拷贝解析的头部指向其中的数据 */
+    void setBuffer(std::shared_ptr<char> v) { m_buffer = v; }
+    /* 添加零拷贝解析的头部，数据需要在请求的生命周期内有效 */
+    void addHeaderView(const char *name, size_t nlen, const char *value,
+                       size_t vlen);
+    void clearHeaderViews() { m_headerViews.clear(); }
+    const HeaderViews &getHeaderViews() const { return m_headerViews; }
+    /* 将零拷贝解析的头部拷贝到map中并清空，之后不再依赖接收缓冲区。头部的内容不变，
+     * 所以是const的，但会修改内部存储，不能与同一个请求上的其他调用并发
+     */
+    void materializeHeaders() const;
+    /* 查找头部，不拷贝，先查找map再查找零拷贝解析的头部，重复的头部取最后一个，
+     * 返回的值在请求的生命周期内且头部未修改时有效
+     */
+    bool findHeader(const boost::string_view &key,
+                    boost::string_view &val) const;
+
     template <class T>
     bool checkGetHeaderAs(const std::string &key, T &val, const T &def = T()) {
-        return checkGetAs(m_headers, key, val, def);
+        boost::string_view v;
+        if (!findHeader(key, v)) {
+            val = def;
+            return false;
+        }
+        try {
+            val = boost::lexical_cast<T>(v);
+            return true;
+        } catch (...) {
+            val = def;
+        }
+        return false;
     }
 
     template <class T>
     T getHeaderAs(const std::string &key, const T &def = T()) {
-        return getAs(m_headers, key, def);
+        T val;
+        checkGetHeaderAs(key, val, def);
+        return val;
     }
 
     template <class T>
@@ -242,6 +302,17 @@ public:
         return getAs(m_params, key, def);
     }
 
+    template <class T>
+    bool checkGetPathParamAs(const std::string &key, T &val,
+                             const T &def = T()) {
+        return checkGetAs(m_pathParams, key, val, def);
+    }
+
+    template <class T>
+    T getPathParamAs(const std::string &key, const T &def = T()) {
+        return getAs(m_pathParams, key, def);
+    }
+
     template <class T>
     bool checkGetCookieAs(const std::string &key, T &val, const T &def = T()) {
         return checkGetAs(m_cookies, key, val, def);
@@ -256,16 +327,20 @@ public:
     std::string toString() const;
 
 private:
-    HttpMethod m_method;    // HTTP方法
-    uint8_t m_version;      // HTTP版本
-    bool m_close;           //是否自动关闭
-    std::string m_path;     //请求路径
-    std::string m_query;    //请求参数
-    std::string m_fragment; //请求fragment
-    std::string m_body;     //请求消息体
-    MapType m_headers;      //请求头部map
-    MapType m_params;       //请求参数map
-    MapType m_cookies;      //请求cookie map
+    HttpMethod m_method;               // HTTP方法
+    uint8_t m_version;                 // HTTP版本
+    bool m_close;                      //是否自动关闭
+    std::string m_path;                //请求路径
+    std::string m_query;               //请求参数
+    std::string m_fragment;            //请求fragment
+    std::string m_body;                //请求消息体
+    Stream::ptr m_bodyStream;          //流式读取的请求消息体
+    mutable MapType m_headers;         //请求头部map
+    mutable HeaderViews m_headerViews; //零拷贝解析的请求头部
+    std::shared_ptr<char> m_buffer;    //零拷贝解析时的接收缓冲区
+    MapType m_params;                  //请求参数map
+    MapType m_cookies;                 //请求cookie map
+    MapType m_pathParams;              //路由匹配得到的路径参数
 };
 
 class HttpResponse {
@@ -286,6 +361,9 @@ public:
     void setHeaders(const MapType &v) { m_headers = v; }
     bool isClose() const { return m_close; }
     void setClose(bool v) { m_close = v; }
+    /* 是否使用分块编码，为true时不输出content-length，消息体作为一个块输出 */
+    bool isChunked() const { return m_chunked; }
+    void setChunked(bool v) { m_chunked = v; }
     std::string getHeader(const std::string &key,
                           const std::string &def = "") const;
     void setHeader(const std::string &key, const std::string &val);
@@ -301,12 +379,17 @@ public:
     }
 
     std::ostream &dump(std::ostream &os) const;
+    /* 只输出状态行和头部，以空行结束 */
+    std::ostream &dumpHead(std::ostream &os) const;
+    /* 将状态行和头部追加到buf末尾，不经过ostream，buf可以复用以避免内存分配 */
+    void appendHead(std::string &buf) const;
     std::string toString() const;
 
 private:
     HttpStatus m_status;  //响应状态
     uint8_t m_version;    //版本
     bool m_close;         //是否自动关闭
+    bool m_chunked;       //是否使用分块编码
     std::string m_body;   //响应消息体
     std::string m_reason; //响应原因码
     MapType m_headers;    //响应头部map
@@ -0,0 +1,533 @@
+#include "http_connection.h"
+#include "sylar/log.h"
+#include "sylar/util.h"
+#include <string.h>
+#include <unistd.h>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+//连接池的连接数达到上限时，检查是否有连接可用的间隔，单位ms
+static const uint64_t POOL_WAIT_INTERVAL = 1;
+
+/* 解析http://host[:port][/path][?query][#fragment]，fragment被忽略 */
+static bool ParseUrl(const std::string &url, std::string &host, uint16_t &port,
+                     std::string &path, std::string &query) {
+    if (strncasecmp(url.c_str(), "http://", 7) != 0) {
+        return false;
+    }
+    size_t end = std::min(url.find_first_of("/?#", 7), url.size());
+    host       = url.substr(7, end - 7);
+    port       = 80;
+    size_t colon = host.rfind(':');
+    if (colon != std::string::npos) {
+        char *e         = nullptr;
+        unsigned long v = strtoul(host.c_str() + colon + 1, &e, 10);
+        if (*e || v == 0 || v > 65535) {
+            return false;
+        }
+        port = v;
+        host.erase(colon);
+    }
+    if (host.empty() || host.find('@') != std::string::npos) {
+        return false;
+    }
+    std::string rest = url.substr(end, url.find('#', end) - end);
+    size_t pos       = rest.find('?');
+    path             = rest.substr(0, pos);
+    query = pos == std::string::npos ? "" : rest.substr(pos + 1);
+    if (path.empty()) {
+        path = "/";
+    }
+    return true;
+}
+
+/* 幂等的请求重复发送不影响结果，复用的连接被关闭时可以重试 */
+static bool IsIdempotent(HttpMethod method) {
+    switch (method) {
+    case HttpMethod::GET:
+    case HttpMethod::HEAD:
+    case HttpMethod::PUT:
+    case HttpMethod::DELETE:
+    case HttpMethod::OPTIONS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::string HttpResult::toString() const {
+    std::stringstream ss;
+    ss << "[HttpResult result=" << (int)result << " error=" << error
+       << " response=" << (response ? response->toString() : "nullptr")
+       << "]";
+    return ss.str();
+}
+
+HttpConnection::HttpConnection(Socket::ptr sock, bool owner)
+    : SocketStream(sock, owner)
+    , m_buffer(HttpResponseParser::GetHttpResponseBufferSize() + 1, '\0')
+    , m_length(0)
+    , m_requests(0)
+    , m_lastUse(0)
+    , m_timeout(-1)
+    , m_peerClosed(false) {}
+
+HttpConnection::~HttpConnection() {}
+
+void HttpConnection::setTimeout(uint64_t timeout_ms) {
+    if (m_timeout != timeout_ms) {
+        getSocket()->setRecvTimeout(timeout_ms);
+        getSocket()->setSendTimeout(timeout_ms);
+        m_timeout = timeout_ms;
+    }
+}
+
+int HttpConnection::sendRequest(HttpRequest::ptr req) {
+    ++m_requests;
+    std::string data = req->toString();
+    return writeFixSize(data.c_str(), data.size());
+}
+
+int HttpConnection::fill() {
+    int rt = read(&m_buffer[m_length], m_buffer.size() - 1 - m_length);
+    if (rt > 0) {
+        m_length += rt;
+    } else if (rt == 0) {
+        //连接被关闭，清除hook的read等待时留下的EAGAIN，避免被当作超时
+        errno = 0;
+    }
+    return rt;
+}
+
+void HttpConnection::consume(size_t length) {
+    memmove(&m_buffer[0], &m_buffer[length], m_length - length);
+    m_length -= length;
+}
+
+size_t HttpConnection::waitLine() {
+    while (true) {
+        const char *p = (const char *)memchr(m_buffer.data(), '\n', m_length);
+        if (p) {
+            return p - m_buffer.data() + 1;
+        }
+        if (m_length == m_buffer.size() - 1) {
+            SYLAR_LOG_WARN(g_logger) << "http response line too long";
+            return 0;
+        }
+        if (fill() <= 0) {
+            return 0;
+        }
+    }
+}
+
+bool HttpConnection::readBody(std::string &body, uint64_t length) {
+    size_t n = std::min<uint64_t>(m_length, length);
+    body.append(m_buffer.data(), n);
+    consume(n);
+    length -= n;
+    if (length > 0) {
+        size_t offset = body.size();
+        body.resize(offset + length);
+        if (readFixsize(&body[offset], length) <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HttpConnection::readChunkedBody(HttpResponseParser::ptr parser,
+                                     std::string &body) {
+    uint64_t max_size = HttpResponseParser::GetHttpResponseMaxBodySize();
+    const httpclient_parser &cp = parser->getParser();
+    while (true) {
+        //块大小行完整收到后再解析
+        if (!waitLine()) {
+            return false;
+        }
+        m_buffer[m_length] = '\0';
+        m_length -= parser->execute(&m_buffer[0], m_length, true);
+        if (parser->hasError() || !parser->isFinished()) {
+            SYLAR_LOG_WARN(g_logger) << "invalid http response chunk header";
+            return false;
+        }
+        if (cp.chunks_done) {
+            break;
+        }
+        if (cp.content_len < 0 || body.size() + cp.content_len > max_size) {
+            SYLAR_LOG_WARN(g_logger) << "http response body too large";
+            return false;
+        }
+        if (!readBody(body, cp.content_len)) {
+            return false;
+        }
+        //块数据之后的CRLF
+        size_t len = waitLine();
+        if (len == 0 || len > 2) {
+            return false;
+        }
+        consume(len);
+    }
+
+    //忽略trailer，直到空行
+    while (true) {
+        size_t len = waitLine();
+        if (len == 0) {
+            return false;
+        }
+        bool empty = len == 1 || (len == 2 && m_buffer[0] == '\r');
+        consume(len);
+        if (empty) {
+            return true;
+        }
+    }
+}
+
+HttpResponse::ptr HttpConnection::recvResponse(bool head) {
+    m_peerClosed = false;
+    //收到完整的头部后再解析
+    while (!memmem(m_buffer.data(), m_length, "\r\n\r\n", 4)) {
+        if (m_length == m_buffer.size() - 1) {
+            SYLAR_LOG_WARN(g_logger) << "http response head too large";
+            close();
+            return nullptr;
+        }
+        int rt = fill();
+        if (rt <= 0) {
+            //复用的连接已被对方关闭
+            m_peerClosed = m_length == 0 && (rt == 0 || errno == ECONNRESET);
+            int err      = errno;
+            close();
+            errno = err;
+            return nullptr;
+        }
+    }
+
+    HttpResponseParser::ptr parser(new HttpResponseParser);
+    m_buffer[m_length] = '\0';
+    m_length -= parser->execute(&m_buffer[0], m_length, false);
+    if (parser->hasError() || !parser->isFinished()) {
+        SYLAR_LOG_WARN(g_logger) << "invalid http response";
+        close();
+        return nullptr;
+    }
+
+    HttpResponse::ptr rsp = parser->getData();
+    //HTTP/1.0默认关闭连接，HTTP/1.1默认保持连接
+    std::string conn = rsp->getHeader("connection");
+    bool close_conn  = rsp->getVersion() == 0x10
+                           ? strcasecmp(conn.c_str(), "keep-alive") != 0
+                           : strcasecmp(conn.c_str(), "close") == 0;
+
+    uint64_t max_size = HttpResponseParser::GetHttpResponseMaxBodySize();
+    int status        = (int)rsp->getStatus();
+    uint64_t length   = 0;
+    std::string body;
+    bool ok = true;
+    if (head || status / 100 == 1 || status == 204 || status == 304) {
+        //没有消息体
+    } else if (parser->getParser().chunked) {
+        ok = readChunkedBody(parser, body);
+    } else if (rsp->checkGetHeaderAs<uint64_t>("content-length", length)) {
+        if (length > max_size) {
+            SYLAR_LOG_WARN(g_logger) << "http response body too large";
+            ok = false;
+        } else {
+            ok = readBody(body, length);
+        }
+    } else {
+        //没有Content-Length时读到连接关闭
+        close_conn = true;
+        while (ok) {
+            body.append(m_buffer.data(), m_length);
+            m_length = 0;
+            int rt   = fill();
+            ok       = rt >= 0 && body.size() + m_length <= max_size;
+            if (rt == 0) {
+                break;
+            }
+        }
+    }
+    if (!ok) {
+        int err = errno;
+        close();
+        errno = err;
+        return nullptr;
+    }
+    rsp->setBody(body);
+    rsp->setClose(close_conn);
+    return rsp;
+}
+
+HttpResult::ptr HttpConnection::request(HttpRequest::ptr req) {
+    if (sendRequest(req) <= 0) {
+        return std::make_shared<HttpResult>(
+            HttpResult::Error::SEND_FAIL, nullptr,
+            "send request fail, errno=" + std::to_string(errno) +
+                " errstr=" + strerror(errno));
+    }
+    HttpResponse::ptr rsp = recvResponse(req->getMethod() == HttpMethod::HEAD);
+    if (!rsp) {
+        //hook的read超时时errno为EAGAIN
+        if (errno == EAGAIN || errno == ETIMEDOUT) {
+            return std::make_shared<HttpResult>(
+                HttpResult::Error::TIMEOUT, nullptr,
+                "recv response timeout " + std::to_string(m_timeout) + "ms");
+        }
+        return std::make_shared<HttpResult>(
+            HttpResult::Error::RECV_FAIL, nullptr,
+            "recv response fail, errno=" + std::to_string(errno) +
+                " errstr=" + strerror(errno));
+    }
+    return std::make_shared<HttpResult>(HttpResult::Error::OK, rsp, "ok");
+}
+
+HttpResult::ptr HttpConnection::DoGet(const std::string &url,
+                                      uint64_t timeout_ms,
+                                      const MapType &headers,
+                                      const std::string &body) {
+    return DoRequest(HttpMethod::GET, url, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnection::DoPost(const std::string &url,
+                                       uint64_t timeout_ms,
+                                       const MapType &headers,
+                                       const std::string &body) {
+    return DoRequest(HttpMethod::POST, url, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnection::DoRequest(HttpMethod method,
+                                          const std::string &url,
+                                          uint64_t timeout_ms,
+                                          const MapType &headers,
+                                          const std::string &body) {
+    std::string host;
+    uint16_t port = 80;
+    std::string path;
+    std::string query;
+    if (!ParseUrl(url, host, port, path, query)) {
+        return std::make_shared<HttpResult>(HttpResult::Error::INVALID_URL,
+                                            nullptr, "invalid url: " + url);
+    }
+    IPAddress::ptr addr = Address::LookupAnyIPAddress(host);
+    if (!addr) {
+        return std::make_shared<HttpResult>(HttpResult::Error::INVALID_HOST,
+                                            nullptr, "invalid host: " + host);
+    }
+    addr->setPort(port);
+
+    HttpRequest::ptr req(new HttpRequest);
+    req->setMethod(method);
+    req->setPath(path);
+    req->setQuery(query);
+    req->setHeader("Host",
+                   port == 80 ? host : host + ":" + std::to_string(port));
+    for (auto &i : headers) {
+        req->setHeader(i.first, i.second);
+    }
+    req->setBody(body);
+    return DoRequest(req, addr, timeout_ms);
+}
+
+HttpResult::ptr HttpConnection::DoRequest(HttpRequest::ptr req,
+                                          Address::ptr addr,
+                                          uint64_t timeout_ms) {
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    if (!sock->connect(addr, timeout_ms)) {
+        return std::make_shared<HttpResult>(
+            HttpResult::Error::CONNECT_FAIL, nullptr,
+            "connect fail: " + addr->toString());
+    }
+    HttpConnection::ptr conn(new HttpConnection(sock));
+    conn->setTimeout(timeout_ms);
+    //连接只使用一次
+    req->setClose(true);
+    return conn->request(req);
+}
+
+HttpConnectionPool::HttpConnectionPool(const std::string &host, uint16_t port,
+                                       uint32_t max_size,
+                                       uint64_t idle_timeout,
+                                       uint32_t max_request)
+    : m_host(host)
+    , m_port(port)
+    , m_maxSize(max_size)
+    , m_idleTimeout(idle_timeout)
+    , m_maxRequest(max_request)
+    , m_total(0)
+    , m_connects(0) {}
+
+HttpResult::ptr HttpConnectionPool::doGet(
+    const std::string &path, uint64_t timeout_ms,
+    const HttpConnection::MapType &headers, const std::string &body) {
+    return doRequest(HttpMethod::GET, path, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnectionPool::doPost(
+    const std::string &path, uint64_t timeout_ms,
+    const HttpConnection::MapType &headers, const std::string &body) {
+    return doRequest(HttpMethod::POST, path, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnectionPool::doRequest(
+    HttpMethod method, const std::string &path, uint64_t timeout_ms,
+    const HttpConnection::MapType &headers, const std::string &body) {
+    HttpRequest::ptr req(new HttpRequest);
+    size_t pos = path.find('?');
+    req->setMethod(method);
+    req->setPath(path.substr(0, pos));
+    if (pos != std::string::npos) {
+        req->setQuery(path.substr(pos + 1));
+    }
+    for (auto &i : headers) {
+        req->setHeader(i.first, i.second);
+    }
+    req->setBody(body);
+    return doRequest(req, timeout_ms);
+}
+
+HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req,
+                                              uint64_t timeout_ms) {
+    if (!req->hasHeader("Host")) {
+        req->setHeader("Host", m_port == 80
+                                   ? m_host
+                                   : m_host + ":" + std::to_string(m_port));
+    }
+    req->setClose(false);
+    for (int i = 0;; ++i) {
+        bool reused = false;
+        HttpResult::ptr result;
+        HttpConnection::ptr conn = getConnection(timeout_ms, reused, result);
+        if (!conn) {
+            return result;
+        }
+        result = conn->request(req);
+        bool ok = result->result == HttpResult::Error::OK;
+        releaseConnection(conn, !ok || result->response->isClose());
+        if (ok) {
+            return result;
+        }
+        /* 复用的连接可能已被服务器关闭，换用新的连接重试一次。发送失败时服务器没有收到
+         * 完整的请求；收到响应前连接被关闭时请求可能已被处理，只重试幂等的请求
+         */
+        if (i == 0 && reused &&
+            (result->result == HttpResult::Error::SEND_FAIL ||
+             (conn->isPeerClosed() && IsIdempotent(req->getMethod())))) {
+            continue;
+        }
+        return result;
+    }
+}
+
+size_t HttpConnectionPool::getIdleCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_conns.size();
+}
+
+uint32_t HttpConnectionPool::getConnectionCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_total;
+}
+
+HttpConnection::ptr HttpConnectionPool::getConnection(uint64_t timeout_ms,
+                                                      bool &reused,
+                                                      HttpResult::ptr &error) {
+    uint64_t begin = sylar::GetCurrentMS();
+    std::list<HttpConnection::ptr> expired; //在锁外关闭
+    IPAddress::ptr addr;
+    HttpConnection::ptr conn;
+    while (true) {
+        uint64_t now = sylar::GetCurrentMS();
+        {
+            MutexType::Lock lock(m_mutex);
+            //最近使用的在后，最后一个已超时时全部超时
+            if (!m_conns.empty() &&
+                now - m_conns.back()->m_lastUse >= m_idleTimeout) {
+                m_total -= m_conns.size();
+                expired.splice(expired.end(), m_conns);
+            }
+            if (!m_conns.empty()) {
+                conn = m_conns.back();
+                m_conns.pop_back();
+                break;
+            }
+            //没有空闲连接，未达到上限时先占用一个连接数再在锁外建立连接
+            if (!m_maxSize || m_total < m_maxSize) {
+                ++m_total;
+                addr = m_addr;
+                break;
+            }
+        }
+        /* 连接数达到上限，定时检查是否有连接用完，不在放回连接时唤醒，hook的usleep只让出
+         * 当前协程
+         */
+        if (now - begin >= timeout_ms) {
+            error = std::make_shared<HttpResult>(
+                HttpResult::Error::POOL_GET_CONNECTION, nullptr,
+                "wait for pool connection timeout " +
+                    std::to_string(timeout_ms) + "ms");
+            return nullptr;
+        }
+        usleep(POOL_WAIT_INTERVAL * 1000);
+    }
+    if (conn) {
+        reused = true;
+        conn->setTimeout(timeout_ms);
+        return conn;
+    }
+
+    if (!addr) {
+        addr = Address::LookupAnyIPAddress(m_host);
+        if (!addr) {
+            MutexType::Lock lock(m_mutex);
+            --m_total;
+            error = std::make_shared<HttpResult>(
+                HttpResult::Error::INVALID_HOST, nullptr,
+                "invalid host: " + m_host);
+            return nullptr;
+        }
+        addr->setPort(m_port);
+        MutexType::Lock lock(m_mutex);
+        m_addr = addr;
+    }
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    if (!sock->connect(addr, timeout_ms)) {
+        //下次重新解析
+        MutexType::Lock lock(m_mutex);
+        m_addr.reset();
+        --m_total;
+        error = std::make_shared<HttpResult>(
+            HttpResult::Error::CONNECT_FAIL, nullptr,
+            "connect fail: " + addr->toString());
+        return nullptr;
+    }
+    ++m_connects;
+    reused = false;
+    conn.reset(new HttpConnection(sock));
+    conn->setTimeout(timeout_ms);
+    return conn;
+}
+
+void HttpConnectionPool::releaseConnection(HttpConnection::ptr conn,
+                                           bool close) {
+    uint64_t now    = sylar::GetCurrentMS();
+    conn->m_lastUse = now;
+    std::list<HttpConnection::ptr> expired; //在锁外关闭
+    MutexType::Lock lock(m_mutex);
+    if (close || (m_maxRequest && conn->m_requests >= m_maxRequest)) {
+        --m_total;
+        return;
+    }
+    m_conns.push_back(conn);
+    while (!m_conns.empty() &&
+           now - m_conns.front()->m_lastUse >= m_idleTimeout) {
+        expired.push_back(m_conns.front());
+        m_conns.pop_front();
+        --m_total;
+    }
+}
+
+} // namespace http
+} // namespace sylar
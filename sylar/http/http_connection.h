@@ -0,0 +1,179 @@
+#ifndef MYSYLAR_HTTP_CONNECTION_H
+#define MYSYLAR_HTTP_CONNECTION_H
+
+#include "http.h"
+#include "http_parser.h"
+#include "sylar/socket_stream.h"
+#include "sylar/thread.h"
+#include <atomic>
+#include <list>
+
+namespace sylar {
+namespace http {
+
+/* HTTP请求的结果，result不为OK时response为nullptr */
+struct HttpResult {
+    typedef std::shared_ptr<HttpResult> ptr;
+    enum class Error {
+        OK = 0,
+        INVALID_URL,         //不支持的url，只支持http
+        INVALID_HOST,        //域名解析失败
+        CONNECT_FAIL,        //连接失败或超时
+        SEND_FAIL,           //发送请求失败
+        RECV_FAIL,           //接收响应失败或响应格式错误
+        TIMEOUT,             //接收响应超时
+        POOL_GET_CONNECTION, //连接池获取连接失败
+    };
+
+    HttpResult(Error _result, HttpResponse::ptr _response,
+               const std::string &_error)
+        : result(_result)
+        , response(_response)
+        , error(_error) {}
+
+    Error result;
+    HttpResponse::ptr response;
+    std::string error;
+
+    std::string toString() const;
+};
+
+class HttpConnectionPool;
+
+/* HTTP客户端连接，基于hook的socket，在协程中使用时IO不阻塞线程 */
+class HttpConnection : public SocketStream {
+    friend class HttpConnectionPool;
+
+public:
+    typedef std::shared_ptr<HttpConnection> ptr;
+    typedef std::map<std::string, std::string, CaseInsensitiveLess> MapType;
+
+    HttpConnection(Socket::ptr sock, bool owner = true);
+    ~HttpConnection();
+
+    /* 发送请求，成功返回大于0 */
+    int sendRequest(HttpRequest::ptr req);
+    /* 接收一个响应，消息体按Content-Length、分块编码或直到连接关闭读入body，
+     * head为true时(HEAD请求的响应)没有消息体，失败返回nullptr并关闭连接
+     * 消息体超过http.response.max_body_size时失败
+     */
+    HttpResponse::ptr recvResponse(bool head = false);
+    /* 上一次recvResponse是否因为对方在发送任何数据前关闭连接而失败 */
+    bool isPeerClosed() const { return m_peerClosed; }
+    /* 已发送的请求数 */
+    uint64_t getRequestCount() const { return m_requests; }
+
+    /* 对url发送请求，每次创建新的连接，timeout_ms为连接、发送和接收的超时时间
+     * url格式为http://host[:port][/path][?query]
+     */
+    static HttpResult::ptr DoGet(const std::string &url, uint64_t timeout_ms,
+                                 const MapType &headers = MapType(),
+                                 const std::string &body = "");
+    static HttpResult::ptr DoPost(const std::string &url, uint64_t timeout_ms,
+                                  const MapType &headers = MapType(),
+                                  const std::string &body = "");
+    static HttpResult::ptr DoRequest(HttpMethod method, const std::string &url,
+                                     uint64_t timeout_ms,
+                                     const MapType &headers = MapType(),
+                                     const std::string &body = "");
+    /* 连接addr发送请求，请求需要已设置Host头部 */
+    static HttpResult::ptr DoRequest(HttpRequest::ptr req, Address::ptr addr,
+                                     uint64_t timeout_ms);
+
+private:
+    /* 发送请求并接收响应 */
+    HttpResult::ptr request(HttpRequest::ptr req);
+    /* 设置读写超时，与当前值相同时不重复设置 */
+    void setTimeout(uint64_t timeout_ms);
+    /* 从socket读取数据追加到缓冲区，返回read的结果，连接关闭时errno为0 */
+    int fill();
+    /* 丢弃缓冲区开头length字节 */
+    void consume(size_t length);
+    /* 等待缓冲区中有以'\n'结束的一行，返回行的长度(包括'\n')，失败返回0 */
+    size_t waitLine();
+    /* 读取length字节的消息体追加到body */
+    bool readBody(std::string &body, uint64_t length);
+    /* 读取分块编码的消息体，最后一个块之后的trailer被忽略 */
+    bool readChunkedBody(HttpResponseParser::ptr parser, std::string &body);
+
+private:
+    std::string m_buffer; //接收缓冲区，大小为http.response.buffer_size + 1
+    size_t m_length;      //缓冲区中未处理数据的长度，数据从缓冲区开头开始
+    uint64_t m_requests;  //已发送的请求数
+    uint64_t m_lastUse;   //最后一次使用的时间，单位ms
+    uint64_t m_timeout;   //当前设置的读写超时
+    bool m_peerClosed;    //上一次接收时对方是否在响应开始前关闭连接
+};
+
+/* 同一主机的HTTP连接池，请求完成后保持连接(keep-alive)供之后的请求复用
+ * 没有空闲连接时创建新的连接，正在使用的和空闲的连接总数最多为max_size，达到上限时等待
+ * 其他请求用完连接，超过请求的超时时间返回POOL_GET_CONNECTION
+ * 空闲超过idle_timeout的连接不再使用。复用的连接发送失败，或幂等的请求(GET、HEAD、PUT、
+ * DELETE、OPTIONS)在收到响应前连接被对方关闭时(服务器已关闭空闲连接)，换用新的连接重试
+ * 一次；POST等非幂等的请求可能已被服务器处理，不重试
+ */
+class HttpConnectionPool {
+public:
+    typedef std::shared_ptr<HttpConnectionPool> ptr;
+    typedef Mutex MutexType;
+
+    /* host: 主机名或IP，同时作为Host头部
+     * max_size: 最多同时存在的连接数，包括正在使用的和空闲的，为0时不限制
+     * idle_timeout: 空闲连接的超时时间，单位ms
+     * max_request: 每个连接最多发送的请求数，为0时不限制
+     */
+    HttpConnectionPool(const std::string &host, uint16_t port,
+                       uint32_t max_size, uint64_t idle_timeout,
+                       uint32_t max_request = 0);
+
+    /* path可以带query，如"/api?id=1" */
+    HttpResult::ptr doGet(const std::string &path, uint64_t timeout_ms,
+                          const HttpConnection::MapType &headers =
+                              HttpConnection::MapType(),
+                          const std::string &body = "");
+    HttpResult::ptr doPost(const std::string &path, uint64_t timeout_ms,
+                           const HttpConnection::MapType &headers =
+                               HttpConnection::MapType(),
+                           const std::string &body = "");
+    HttpResult::ptr doRequest(HttpMethod method, const std::string &path,
+                              uint64_t timeout_ms,
+                              const HttpConnection::MapType &headers =
+                                  HttpConnection::MapType(),
+                              const std::string &body = "");
+    /* 发送请求，没有Host头部时设置为host，请求的close被忽略 */
+    HttpResult::ptr doRequest(HttpRequest::ptr req, uint64_t timeout_ms);
+
+    /* 空闲连接数 */
+    size_t getIdleCount();
+    /* 当前连接数，包括正在使用的和空闲的 */
+    uint32_t getConnectionCount();
+    /* 累计建立的连接数 */
+    uint64_t getConnectCount() const { return m_connects; }
+
+private:
+    /* 获取空闲连接，没有时创建新的连接，连接数达到上限时等待最多timeout_ms，
+     * reused返回是否为复用的连接
+     */
+    HttpConnection::ptr getConnection(uint64_t timeout_ms, bool &reused,
+                                      HttpResult::ptr &error);
+    /* 请求完成后放回连接池，close为true或达到请求数上限时关闭连接，连接数减一 */
+    void releaseConnection(HttpConnection::ptr conn, bool close);
+
+private:
+    std::string m_host;
+    uint16_t m_port;
+    uint32_t m_maxSize;
+    uint64_t m_idleTimeout;
+    uint32_t m_maxRequest;
+
+    MutexType m_mutex;
+    IPAddress::ptr m_addr;                  //解析得到的地址，连接失败时重新解析
+    std::list<HttpConnection::ptr> m_conns; //空闲连接，最近使用的在后
+    uint32_t m_total;                       //当前连接数，包括正在使用的
+    std::atomic<uint64_t> m_connects;       //累计建立的连接数
+};
+
+} // namespace http
+} // namespace sylar
+
+#endif
@@ -15,6 +15,15 @@ static sylar::ConfigVar<uint64_t>::ptr g_http_request_max_body_size =
     sylar::ConfigManager::LookUp("http.request.max_body_size",
         (uint64_t)(64*1024*1024), "http request max body size");
 
+//消息体不超过该值时读入body，超过时通过HttpRequest::getBodyStream()流式读取
+static sylar::ConfigVar<uint64_t>::ptr g_http_request_body_buffer_size =
+    sylar::ConfigManager::LookUp("http.request.body_buffer_size",
+        (uint64_t)(64*1024), "http request body buffer size");
+
+static sylar::ConfigVar<bool>::ptr g_http_request_zero_copy =
+    sylar::ConfigManager::LookUp("http.request.zero_copy", true,
+        "http request zero copy header parsing");
+
 static sylar::ConfigVar<uint64_t>::ptr g_http_response_buffer_size = 
     sylar::ConfigManager::LookUp("http.response.buffer_size", 
         (uint64_t)(4*1024), "http response buffer size");
@@ -26,6 +35,8 @@ static sylar::ConfigVar<uint64_t>::ptr g_http_response_max_body_size =
 
 static uint64_t s_http_request_buffer_size = 0;
 static uint64_t s_http_request_max_body_size = 0;
+static uint64_t s_http_request_body_buffer_size = 0;
+static bool s_http_request_zero_copy = true;
 static uint64_t s_http_response_buffer_size = 0;
 static uint64_t s_http_response_max_body_size = 0;
 
@@ -37,6 +48,14 @@ uint64_t HttpRequestParser::GetHttpRequestMaxBodySize() {
     return s_http_request_max_body_size;
 }
 
+uint64_t HttpRequestParser::GetHttpRequestBodyBufferSize() {
+    return s_http_request_body_buffer_size;
+}
+
+bool HttpRequestParser::GetHttpRequestZeroCopy() {
+    return s_http_request_zero_copy;
+}
+
 uint64_t HttpResponseParser::GetHttpResponseBufferSize() {
     return s_http_response_buffer_size;
 }
@@ -50,6 +69,8 @@ struct _RequestSizeIniter {
     _RequestSizeIniter() {
         s_http_request_buffer_size = g_http_request_buffer_size->getValue();
         s_http_request_max_body_size = g_http_request_max_body_size->getValue();
+        s_http_request_body_buffer_size = g_http_request_body_buffer_size->getValue();
+        s_http_request_zero_copy = g_http_request_zero_copy->getValue();
         s_http_response_buffer_size = g_http_response_buffer_size->getValue();
         s_http_response_max_body_size = g_http_response_max_body_size->getValue();
 
@@ -63,6 +84,16 @@ struct _RequestSizeIniter {
                 s_http_request_max_body_size = nv;
         });
 
+        g_http_request_body_buffer_size->addListener(
+            [](const uint64_t &ov, const uint64_t &nv){
+                s_http_request_body_buffer_size = nv;
+        });
+
+        g_http_request_zero_copy->addListener(
+            [](const bool &ov, const bool &nv){
+                s_http_request_zero_copy = nv;
+        });
+
         g_http_response_buffer_size->addListener(
             [](const uint64_t &ov, const uint64_t &nv){
                 s_http_response_buffer_size = nv;
@@ -133,12 +164,17 @@ void on_request_http_field(void *data, const char *field, size_t flen,
         SYLAR_LOG_WARN(g_logger) << "invalid http request filed length == 0";
         return;
     }
+    if(parser->isZeroCopy()) {
+        parser->getData()->addHeaderView(field, flen, value, vlen);
+        return;
+    }
     parser->getData()->setHeader(std::string(field, flen)
                                 , std::string(value, vlen));
 }
 
-HttpRequestParser::HttpRequestParser()
-    : m_error(0) {
+HttpRequestParser::HttpRequestParser(bool zero_copy)
+    : m_error(0)
+    , m_zeroCopy(zero_copy) {
     m_data.reset(new sylar::http::HttpRequest);
     http_parser_init(&m_parser);
     m_parser.request_method = on_request_method;
@@ -158,11 +194,29 @@ uint64_t HttpRequestParser::getContentLength() {
 
 //返回实际解析的长度，并将data中已解析的数据移除
 size_t HttpRequestParser::excute(char *data, size_t len) {
+    if(m_zeroCopy) {
+        //解析器每次调用都会重置标记位置，跨两次调用的字段无法定位，请求头一般一次就能
+        //收完，未收完时从头重新解析
+        http_parser_init(&m_parser);
+        m_data->clearHeaderViews();
+        m_error = 0;
+        return http_parser_execute(&m_parser, data, len, 0);
+    }
     size_t offset = http_parser_execute(&m_parser, data, len, 0);
     memmove(data, data + offset, (len - offset));
     return offset;
 }
 
+void HttpRequestParser::reset() {
+    http_parser_init(&m_parser);
+    m_error = 0;
+    if(m_data.use_count() == 1) {
+        m_data->reset();
+    } else {
+        m_data.reset(new sylar::http::HttpRequest);
+    }
+}
+
 int HttpRequestParser::isFinished() {
     return http_parser_finish(&m_parser);
 }
@@ -230,9 +284,11 @@ HttpResponseParser::HttpResponseParser()
 }
 
 size_t HttpResponseParser::execute(char *data, size_t len, bool chunk) {
+    //解析块大小行时忽略块扩展参数，不作为头部
     if(chunk) {
         httpclient_parser_init(&m_parser);
     }
+    m_parser.http_field = chunk ? nullptr : on_response_http_field;
     size_t offset = httpclient_parser_execute(&m_parser, data, len, 0);
     memmove(data, data + offset, (len - offset));
     return offset;
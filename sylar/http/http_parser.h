@@ -11,25 +11,35 @@ namespace http {
 class HttpRequestParser{
 public:
     typedef std::shared_ptr<HttpRequestParser> ptr;
-    HttpRequestParser();
+    /* zero_copy: 零拷贝模式，头部不拷贝，以string_view的形式指向data，调用者需要保证
+     * data在请求的生命周期内有效且不被移动，通常通过HttpRequest::setBuffer保持
+     */
+    HttpRequestParser(bool zero_copy = false);
 
     //解析协议，返回实际解析的长度，并且将已解析的数据移除
+    //零拷贝模式下不移除已解析的数据，data为目前收到的全部数据，每次从头解析
     size_t excute(char *data, size_t len);
+    //重置解析状态以解析下一个请求，上一个请求不再被引用时复用请求对象
+    void reset();
     int isFinished();
     int hasError();
     HttpRequest::ptr getData() const {return m_data;}
     void setError(int v) {m_error = v;}
     uint64_t getContentLength();
     const http_parser& getParser() const {return m_parser;}
+    bool isZeroCopy() const {return m_zeroCopy;}
 
 public:
     static uint64_t GetHttpRequestBufferSize();
     static uint64_t GetHttpRequestMaxBodySize();
+    static uint64_t GetHttpRequestBodyBufferSize();
+    static bool GetHttpRequestZeroCopy();
 
 private:
     http_parser m_parser;
     HttpRequest::ptr m_data;
     int m_error; //1000:invalid method, 1001:invalid version, 1002:invalid field
+    bool m_zeroCopy;
 };
 
 class HttpResponseParser{
@@ -37,6 +47,10 @@ public:
     typedef std::shared_ptr<HttpResponseParser> ptr;
     HttpResponseParser();
 
+    /* 解析响应头部，chunk为true时解析一个块大小行，大小通过getParser().content_len获取，
+     * 最后一个块时getParser().chunks_done为1。data[len]需要为'\0'，返回解析的长度，并且
+     * 将已解析的数据移除
+     */
     size_t execute(char *data, size_t len, bool chunk);
     int isFinished();
     int hasError();
@@ -6,12 +6,20 @@ namespace http {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
-HttpServer::HttpServer(bool keepalive)
-    : m_isKeepalive(keepalive)
+HttpServer::HttpServer(bool keepalive, Scheduler *worker,
+                       Scheduler *accept_worker)
+    : TcpServer(worker, accept_worker)
+    , m_isKeepalive(keepalive)
     , m_dispatch(new ServletDispatch) {}
 
 void HttpServer::handleClient(Socket::ptr client) {
     HttpSession::ptr session(new HttpSession(client));
+    //等待第一个请求期间连接是空闲的，收到请求数据后由会话标记为忙
+    ClientState::ptr state = getClientState(client);
+    if (state) {
+        session->setClientState(state);
+        state->setIdle();
+    }
     do {
         HttpRequest::ptr req = session->recvRequest();
         if (!req) {
@@ -21,18 +29,30 @@ void HttpServer::handleClient(Socket::ptr client) {
                 << " keepalive=" << m_isKeepalive;
             break;
         }
-        HttpResponse::ptr rsp(new HttpResponse(
-            req->getVersion(), req->isClose() || !m_isKeepalive));
+        //服务器停止排空时处理完当前请求后关闭连接，通知客户端不再复用
+        bool close = req->isClose() || !m_isKeepalive || isStop();
+        HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), close));
         rsp->setHeader("Server", getName());
 
         NotFoundServlet::ptr slt(new NotFoundServlet);
 
         m_dispatch->handle(req, rsp, session);
 
-        session->sendResponse(rsp);
-        if (!m_isKeepalive || req->isClose()) {
+        //发送失败时响应可能只发送了一部分，连接不能再复用
+        if (session->sendResponse(rsp) <= 0) {
+            SYLAR_LOG_WARN(g_logger)
+                << "send http response fail, errno=" << errno
+                << " errstr=" << strerror(errno) << " client: " << *client;
+            break;
+        }
+        //servlet也可以要求关闭连接
+        if (close || rsp->isClose()) {
             break;
         }
+        //等待下一个请求期间服务器停止时，不用等到排空超时
+        if (state) {
+            state->setIdle();
+        }
     } while (true);
     session->close();
 }
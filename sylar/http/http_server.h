@@ -12,7 +12,9 @@ class HttpServer : public TcpServer {
 public:
     typedef std::shared_ptr<HttpServer> ptr;
 
-    HttpServer(bool keepalive = false);
+    /* worker/accept_worker: 见TcpServer，为nullptr时自己创建 */
+    HttpServer(bool keepalive = false, Scheduler *worker = nullptr,
+               Scheduler *accept_worker = nullptr);
 
     ServletDispatch::ptr getServletDispatch() const { return m_dispatch; }
     void setServletDispatch(ServletDispatch::ptr v) { m_dispatch = v; }
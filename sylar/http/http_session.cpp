@@ -1,74 +1,507 @@
 #include "http_session.h"
 #include "http_parser.h"
+#include "sylar/log.h"
 
 namespace sylar {
 namespace http {
 
-HttpSession::HttpSession(Socket::ptr sock, bool owner)
-    : SocketStream(sock, owner) {}
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
-HttpRequest::ptr HttpSession::recvRequest() {
-    HttpRequestParser::ptr parser(new HttpRequestParser);
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
+HttpBodyStream::HttpBodyStream(HttpSession *session, uint64_t length,
+                               bool chunked)
+    : m_session(session)
+    , m_remaining(chunked ? 0 : length)
+    , m_total(0)
+    , m_chunks(0)
+    , m_chunked(chunked)
+    , m_done(false)
+    , m_closed(false)
+    , m_pendingOffset(0) {}
 
-    std::shared_ptr<char> buffer(new char[buff_size],
-                                 [](char *ptr) { delete[] ptr; });
-    char *data = buffer.get();
-    int offset = 0;
+int HttpBodyStream::read(void *buffer, size_t length) {
+    if (m_closed) {
+        return m_session ? 0 : -1;
+    }
+    return readData(buffer, length);
+}
 
-    do {
-        int len = read(data + offset, buff_size - offset);
+int HttpBodyStream::readData(void *buffer, size_t length) {
+    if (!m_session) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    if (m_pendingOffset < m_pending.size()) {
+        size_t n = std::min(length, m_pending.size() - m_pendingOffset);
+        memcpy(buffer, &m_pending[m_pendingOffset], n);
+        m_pendingOffset += n;
+        return n;
+    }
+    if (m_chunked && m_remaining == 0 && !m_done) {
+        if (!readChunkHeader()) {
+            m_session = nullptr;
+            return -1;
+        }
+    }
+    if (m_remaining == 0) {
+        return 0;
+    }
+    int rt =
+        m_session->readBody(buffer, std::min<uint64_t>(length, m_remaining));
+    if (rt > 0) {
+        m_remaining -= rt;
+    }
+    return rt;
+}
+
+bool HttpBodyStream::readChunkHeader() {
+    std::string line;
+    //块数据之后的CRLF
+    if (m_chunks > 0 && (!m_session->readLine(line) || !line.empty())) {
+        return false;
+    }
+    if (!m_session->readLine(line) || line.empty() || !isxdigit(line[0])) {
+        return false;
+    }
+    char *end     = nullptr;
+    uint64_t size = strtoull(line.c_str(), &end, 16);
+    //块大小之后可以有扩展参数，忽略
+    if (*end && *end != ';' && *end != ' ' && *end != '\t') {
+        return false;
+    }
+    ++m_chunks;
+    if (size == 0) {
+        do {
+            if (!m_session->readLine(line)) {
+                return false;
+            }
+        } while (!line.empty());
+        m_done = true;
+        return true;
+    }
+    m_total += size;
+    if (size > HttpRequestParser::GetHttpRequestMaxBodySize() ||
+        m_total > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+        SYLAR_LOG_WARN(g_logger)
+            << "http chunked request body too large, length=" << m_total;
+        return false;
+    }
+    m_remaining = size;
+    return true;
+}
+
+int HttpBodyStream::read(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> iovs;
+    ba->getWriteBuffers(iovs, length);
+    if (iovs.empty()) {
+        return 0;
+    }
+    int rt = read(iovs[0].iov_base, iovs[0].iov_len);
+    if (rt > 0) {
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
+int HttpBodyStream::write(const void *buffer, size_t length) { return -1; }
+
+int HttpBodyStream::write(ByteArray::ptr ba, size_t length) { return -1; }
+
+void HttpBodyStream::close() { m_closed = true; }
+
+bool HttpBodyStream::skip() {
+    char buf[4096];
+    int rt = 0;
+    while ((rt = readData(buf, sizeof(buf))) > 0) {
+    }
+    return rt == 0 && isFinished();
+}
+
+HttpChunkedWriter::HttpChunkedWriter(HttpSession *session)
+    : m_session(session)
+    , m_finished(false)
+    , m_error(0) {}
+
+int HttpChunkedWriter::read(void *buffer, size_t length) { return -1; }
+
+int HttpChunkedWriter::read(ByteArray::ptr ba, size_t length) { return -1; }
+
+int HttpChunkedWriter::write(const void *buffer, size_t length) {
+    if (length == 0) {
+        return (!m_session || m_finished || m_error) ? -1 : 0;
+    }
+    iovec iovs[3];
+    iovs[1].iov_base = (void *)buffer;
+    iovs[1].iov_len  = length;
+    return writeChunk(iovs, 3, length);
+}
+
+int HttpChunkedWriter::write(ByteArray::ptr ba, size_t length) {
+    //第一块和最后一块留给块大小行和结尾的CRLF
+    std::vector<iovec> iovs(1);
+    uint64_t size = ba->getReadBuffers(iovs, length);
+    if (size == 0) {
+        return (!m_session || m_finished || m_error) ? -1 : 0;
+    }
+    iovs.resize(iovs.size() + 1);
+    int rt = writeChunk(&iovs[0], iovs.size(), size);
+    if (rt > 0) {
+        ba->setPosition(ba->getPosition() + size);
+    }
+    return rt;
+}
+
+int HttpChunkedWriter::writeChunk(iovec *iovs, size_t count, size_t length) {
+    if (!m_session || m_finished || m_error) {
+        return -1;
+    }
+    //块大小行、数据、结尾的CRLF通过一次writev发送
+    char head[32];
+    iovs[0].iov_base         = head;
+    iovs[0].iov_len          = snprintf(head, sizeof(head), "%zx\r\n", length);
+    iovs[count - 1].iov_base = (void *)"\r\n";
+    iovs[count - 1].iov_len  = 2;
+    if (m_session->writevFixSize(iovs, count) <= 0) {
+        m_error = -1;
+        return -1;
+    }
+    return length;
+}
+
+void HttpChunkedWriter::close() { finish(); }
+
+int HttpChunkedWriter::finish() {
+    if (!m_session || m_error) {
+        return -1;
+    }
+    if (m_finished) {
+        return 1;
+    }
+    m_finished = true;
+    if (m_session->writeFixSize("0\r\n\r\n", 5) <= 0) {
+        m_error = -1;
+        return -1;
+    }
+    return 1;
+}
+
+HttpSession::HttpSession(Socket::ptr sock, bool owner)
+    : SocketStream(sock, owner)
+    , m_parser(new HttpRequestParser(
+          HttpRequestParser::GetHttpRequestZeroCopy()))
+    , m_bufferSize(HttpRequestParser::GetHttpRequestBufferSize())
+    , m_begin(0)
+    , m_end(0)
+    , m_sent(false)
+    , m_sentResult(0) {}
+
+HttpSession::~HttpSession() {
+    if (m_body) {
+        m_body->detach();
+    }
+    if (m_writer) {
+        m_writer->detach();
+    }
+}
+
+bool HttpSession::readLine(std::string &line) {
+    while (true) {
+        char *data = m_buffer.get();
+        char *pos =
+            (char *)memmem(data + m_begin, m_end - m_begin, "\r\n", 2);
+        if (pos) {
+            line.assign(data + m_begin, pos - data - m_begin);
+            m_begin = pos - data + 2;
+            return true;
+        }
+        if (m_end == m_bufferSize) {
+            if (m_begin == 0) {
+                return false;
+            }
+            compactBuffer();
+            continue;
+        }
+        int len = read(data + m_end, m_bufferSize - m_end);
         if (len <= 0) {
+            return false;
+        }
+        m_end += len;
+    }
+}
+
+int HttpSession::readBody(void *buffer, size_t length) {
+    if (m_begin < m_end) {
+        size_t n = std::min(length, m_end - m_begin);
+        memcpy(buffer, m_buffer.get() + m_begin, n);
+        m_begin += n;
+        return n;
+    }
+    //缓冲区中没有数据时直接读到调用者的内存中，避免多一次拷贝
+    return read(buffer, length);
+}
+
+void HttpSession::compactBuffer() {
+    size_t left = m_end - m_begin;
+    if (!m_buffer || m_buffer.use_count() > 1) {
+        std::shared_ptr<char> buffer(new char[m_bufferSize],
+                                     [](char *ptr) { delete[] ptr; });
+        if (left) {
+            memcpy(buffer.get(), m_buffer.get() + m_begin, left);
+        }
+        m_buffer = buffer;
+    } else if (m_begin && left) {
+        memmove(m_buffer.get(), m_buffer.get() + m_begin, left);
+    }
+    m_begin = 0;
+    m_end   = left;
+}
+
+HttpRequest::ptr HttpSession::recvRequest() {
+    //丢弃上一个请求未读取的消息体
+    if (m_body) {
+        bool ok = m_body->skip();
+        m_body->detach();
+        m_body.reset();
+        if (!ok) {
             close();
             return nullptr;
         }
-        len += offset;
-        size_t nparse = parser->excute(data, len);
-        if (parser->hasError()) {
+    }
+
+    //先重置解析器，释放其对上一个请求的引用，再判断缓冲区能否复用
+    m_parser->reset();
+    compactBuffer();
+
+    bool zero_copy = m_parser->isZeroCopy();
+    char *data     = m_buffer.get();
+    size_t nparse  = 0; //零拷贝模式下请求头的长度
+    size_t scanned = 0; //已查找过请求头结束标记的长度
+
+    /* 缓冲区中可能已经有上一次读到的下一个请求的数据，先解析再读取。解析器每次调用都会
+     * 重置标记位置，不支持字段跨两次调用，收到完整的请求头之后再解析
+     */
+    while (true) {
+        //缓冲区中已有请求数据，排空时等待这个请求处理完
+        if (m_end && m_state) {
+            m_state->setBusy();
+        }
+        if (memmem(data + scanned, m_end - scanned, "\r\n\r\n", 4)) {
+            size_t n = m_parser->excute(data, m_end);
+            if (m_parser->hasError() || !m_parser->isFinished()) {
+                close();
+                return nullptr;
+            }
+            //非零拷贝模式下已解析的数据被移除
+            if (zero_copy) {
+                nparse = n;
+            } else {
+                m_end -= n;
+            }
+            break;
+        }
+        scanned = m_end > 3 ? m_end - 3 : 0;
+        if (m_end == m_bufferSize) {
             close();
             return nullptr;
         }
-        offset = len - nparse;
-        if (offset == (int)buff_size) {
+        int len = read(data + m_end, m_bufferSize - m_end);
+        if (len <= 0) {
             close();
             return nullptr;
         }
-        if (parser->isFinished()) {
-            break;
+        m_end += len;
+    }
+
+    //请求头之后的数据为消息体的开始部分，消息体之后的数据属于下一个请求
+    HttpRequest::ptr req = m_parser->getData();
+    m_begin              = zero_copy ? nparse : 0;
+    if (zero_copy) {
+        req->setBuffer(m_buffer);
+    }
+
+    boost::string_view te;
+    if (req->findHeader("transfer-encoding", te)) {
+        if (!recvChunkedBody(req, te)) {
+            close();
+            return nullptr;
         }
-    } while (true);
+        return checkClose(req);
+    }
 
-    int64_t length = parser->getContentLength();
-    if (length > 0) {
+    uint64_t length = m_parser->getContentLength();
+    if (length > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+        SYLAR_LOG_WARN(g_logger) << "http request body too large, length="
+                                 << length;
+        close();
+        return nullptr;
+    }
+    if (length > HttpRequestParser::GetHttpRequestBodyBufferSize()) {
+        m_body.reset(new HttpBodyStream(this, length));
+        req->setBodyStream(m_body);
+    } else if (length > 0) {
         std::string body;
         body.resize(length);
 
-        int len = 0;
-        if (length >= offset) {
-            memcpy(&body[0], data, offset);
-            len = offset;
-        } else {
-            memcpy(&body[0], data, length);
-            len = length;
-        }
-        length -= offset;
-        if (length > 0) {
-            if (readFixsize(&body[len], length) <= 0) {
+        size_t copied = std::min((size_t)length, m_end - m_begin);
+        memcpy(&body[0], data + m_begin, copied);
+        m_begin += copied;
+        if (length > copied) {
+            if (readFixsize(&body[copied], length - copied) <= 0) {
                 close();
                 return nullptr;
             }
         }
-        parser->getData()->setBody(body);
+        req->setBody(body);
+    }
+    return checkClose(req);
+}
+
+bool HttpSession::recvChunkedBody(HttpRequest::ptr req,
+                                  const boost::string_view &te) {
+    //只支持最后一个编码为chunked，同时带有Content-Length的请求可能被前后端解析成
+    //不同的边界，直接拒绝
+    boost::string_view cl;
+    if (te.size() < 7 ||
+        strncasecmp(te.data() + te.size() - 7, "chunked", 7) != 0 ||
+        req->findHeader("content-length", cl)) {
+        SYLAR_LOG_WARN(g_logger) << "unsupported http request transfer-encoding="
+                                 << te;
+        return false;
     }
 
-    return parser->getData();
+    //先读入body，不超过http.request.body_buffer_size时与定长的消息体一样放在body中，
+    //否则已读出的部分作为流的开始部分
+    HttpBodyStream::ptr stream(new HttpBodyStream(this, 0, true));
+    uint64_t limit = HttpRequestParser::GetHttpRequestBodyBufferSize();
+    std::string body;
+    int rt = 0;
+    do {
+        size_t size = body.size();
+        body.resize(size + 4096);
+        rt = stream->read(&body[size], 4096);
+        body.resize(size + std::max(rt, 0));
+    } while (rt > 0 && body.size() <= limit);
+    if (rt < 0 || (rt == 0 && !stream->isFinished())) {
+        return false;
+    }
+    if (rt == 0) {
+        req->setBody(body);
+    } else {
+        stream->setPending(std::move(body));
+        m_body = stream;
+        req->setBodyStream(stream);
+    }
+    return true;
+}
+
+HttpRequest::ptr HttpSession::checkClose(HttpRequest::ptr req) {
+    // HTTP/1.1默认保持连接，HTTP/1.0需要显式指定keep-alive
+    boost::string_view conn;
+    req->findHeader("connection", conn);
+    if (req->getVersion() == 0x11) {
+        req->setClose(conn.size() == 5 &&
+                      strncasecmp(conn.data(), "close", 5) == 0);
+    } else {
+        req->setClose(!(conn.size() == 10 &&
+                        strncasecmp(conn.data(), "keep-alive", 10) == 0));
+    }
+    return req;
 }
 
 int HttpSession::sendResponse(HttpResponse::ptr rsp) {
-    std::stringstream ss;
-    ss << *rsp;
-    std::string data = ss.str();
-    return writeFixSize(data.c_str(), data.size());
+    if (m_writer) {
+        int rt = m_writer->finish();
+        m_writer->detach();
+        m_writer.reset();
+        return rt;
+    }
+    if (m_sent) {
+        m_sent = false;
+        return m_sentResult;
+    }
+    //头部写入复用的缓冲区，消息体不拷贝，通过一次writev发送
+    m_sendBuffer.clear();
+    rsp->appendHead(m_sendBuffer);
+    const std::string &body = rsp->getBody();
+    iovec iovs[3];
+    size_t count = 1;
+    if (rsp->isChunked()) {
+        //消息体作为一个块，之后是最后一个块
+        if (!body.empty()) {
+            char size[32];
+            m_sendBuffer.append(size, snprintf(size, sizeof(size), "%zx\r\n",
+                                               body.size()));
+            iovs[1].iov_base = (void *)body.c_str();
+            iovs[1].iov_len  = body.size();
+            iovs[2].iov_base = (void *)"\r\n0\r\n\r\n";
+            iovs[2].iov_len  = 7;
+            count            = 3;
+        } else {
+            m_sendBuffer.append("0\r\n\r\n");
+        }
+    } else if (!body.empty()) {
+        iovs[1].iov_base = (void *)body.c_str();
+        iovs[1].iov_len  = body.size();
+        count            = 2;
+    }
+    iovs[0].iov_base = &m_sendBuffer[0];
+    iovs[0].iov_len  = m_sendBuffer.size();
+    return writevFixSize(iovs, count);
+}
+
+HttpChunkedWriter::ptr
+HttpSession::beginChunkedResponse(HttpResponse::ptr rsp) {
+    if (rsp->getVersion() < 0x11) {
+        return nullptr;
+    }
+    rsp->setChunked(true);
+    m_sendBuffer.clear();
+    rsp->appendHead(m_sendBuffer);
+    m_writer.reset(new HttpChunkedWriter(this));
+    if (writeFixSize(m_sendBuffer.c_str(), m_sendBuffer.size()) <= 0) {
+        m_writer->detach();
+    }
+    return m_writer;
+}
+
+int64_t HttpSession::sendFileResponse(HttpResponse::ptr rsp, int fd,
+                                      uint64_t offset, uint64_t length) {
+    rsp->setChunked(false);
+    rsp->setBody("");
+    rsp->setHeader("Content-Length", std::to_string(length));
+    m_sendBuffer.clear();
+    rsp->appendHead(m_sendBuffer);
+    m_sent       = true;
+    m_sentResult = -1;
+
+    //较小的文件读到头部之后一起发送，比多一次sendfile系统调用更快
+    if (length <= SMALL_FILE_SIZE) {
+        size_t head = m_sendBuffer.size();
+        m_sendBuffer.resize(head + length);
+        if (length && pread(fd, &m_sendBuffer[head], length, offset) !=
+                          (ssize_t)length) {
+            return -1;
+        }
+        int rt = writeFixSize(m_sendBuffer.c_str(), m_sendBuffer.size());
+        m_sentResult = rt > 0 ? 1 : -1;
+        return rt;
+    }
+
+    //头部带MSG_MORE发送，与文件的开始部分合并为同一个TCP段
+    size_t sent  = 0;
+    while (sent < m_sendBuffer.size()) {
+        int rt = getSocket()->send(m_sendBuffer.c_str() + sent,
+                                   m_sendBuffer.size() - sent,
+                                   MSG_MORE);
+        if (rt <= 0) {
+            return rt;
+        }
+        sent += rt;
+    }
+    int64_t rt   = sendFile(fd, offset, length);
+    m_sentResult = rt > 0 ? 1 : -1;
+    return rt;
 }
 
 } // namespace http
@@ -2,18 +2,159 @@
 #define MYSYLAR_HTTP_SESSION_H
 
 #include "http.h"
+#include "http_parser.h"
 #include "sylar/socket_stream.h"
+#include "sylar/tcp_server.h"
 
 namespace sylar {
 namespace http {
 
+class HttpSession;
+
+/* 流式读取的请求消息体，先读取会话缓冲区中已收到的部分，再直接从socket读取，读完
+ * Content-Length字节或分块编码的最后一个块后返回0。只能在会话接收下一个请求之前使用，
+ * 之后未读取的部分被丢弃
+ */
+class HttpBodyStream : public Stream {
+public:
+    typedef std::shared_ptr<HttpBodyStream> ptr;
+
+    /* chunked为true时按分块编码解码，忽略length */
+    HttpBodyStream(HttpSession *session, uint64_t length, bool chunked = false);
+
+    virtual int read(void *buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+    /* 消息体只读，写入返回-1 */
+    virtual int write(const void *buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+    /* 不关闭连接，之后的读取返回0，未读取的部分在接收下一个请求前丢弃 */
+    virtual void close() override;
+
+    /* 定长时为剩余未读取的字节数，分块编码时为当前块剩余的字节数 */
+    uint64_t getRemaining() const { return m_remaining; }
+    bool isChunked() const { return m_chunked; }
+    /* 是否已读完整个消息体 */
+    bool isFinished() const { return m_chunked ? m_done : m_remaining == 0; }
+    /* 读取并丢弃剩余的消息体，成功返回true */
+    bool skip();
+    /* 与会话分离，之后的读取返回-1 */
+    void detach() { m_session = nullptr; }
+    /* 设置已从会话中读出的消息体开始部分，之后的读取先返回这部分数据 */
+    void setPending(std::string &&v) {
+        m_pending       = std::move(v);
+        m_pendingOffset = 0;
+    }
+
+private:
+    /* 读取消息体，不受close影响 */
+    int readData(void *buffer, size_t length);
+    /* 读取下一个块的大小行，最后一个块之后读取并忽略trailer，格式错误或消息体超过
+     * http.request.max_body_size时返回false
+     */
+    bool readChunkHeader();
+
+private:
+    HttpSession *m_session;
+    uint64_t m_remaining;    //定长时为剩余字节数，分块编码时为当前块剩余字节数
+    uint64_t m_total;        //分块编码时已收到的块数据总长度
+    uint64_t m_chunks;       //分块编码时已读取的块个数
+    bool m_chunked;          //是否为分块编码
+    bool m_done;             //分块编码时是否已读到最后一个块
+    bool m_closed;           //是否已调用close
+    std::string m_pending;   //已读出的消息体开始部分
+    size_t m_pendingOffset;  //m_pending中已返回的长度
+};
+
+/* 分块编码的响应消息体，每次写入作为一个块发送，close时发送最后一个块 */
+class HttpChunkedWriter : public Stream {
+public:
+    typedef std::shared_ptr<HttpChunkedWriter> ptr;
+
+    HttpChunkedWriter(HttpSession *session);
+
+    /* 响应只写，读取返回-1 */
+    virtual int read(void *buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+    /* 发送一个块，成功返回length，长度为0时不发送 */
+    virtual int write(const void *buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+    /* 发送最后一个块，不关闭连接 */
+    virtual void close() override;
+
+    /* 发送最后一个块，只发送一次，成功返回大于0 */
+    int finish();
+    bool isFinished() const { return m_finished; }
+    /* 与会话分离，之后的写入返回-1 */
+    void detach() { m_session = nullptr; }
+
+private:
+    /* 将iovs[1]到iovs[count-2]共length字节的数据作为一个块发送，iovs[0]和
+     * iovs[count-1]用于块大小行和结尾的CRLF
+     */
+    int writeChunk(iovec *iovs, size_t count, size_t length);
+
+private:
+    HttpSession *m_session;
+    bool m_finished; //是否已发送最后一个块
+    int m_error;     //发送失败时为-1
+};
+
 class HttpSession : public SocketStream {
+    friend class HttpBodyStream;
+
 public:
     typedef std::shared_ptr<HttpSession> ptr;
+    /* 不超过该大小的文件读到头部之后，通过一次系统调用发送 */
+    static const uint64_t SMALL_FILE_SIZE = 16 * 1024;
 
     HttpSession(Socket::ptr sock, bool owner = true);
+    ~HttpSession();
+    /* 接收一个请求，多读到的数据保留在缓冲区中作为下一个请求的开始，支持流水线请求
+     * 消息体不超过http.request.body_buffer_size时读入请求的body，否则通过请求的
+     * getBodyStream()流式读取，超过http.request.max_body_size时关闭连接
+     */
     HttpRequest::ptr recvRequest();
+    /* 发送响应，已通过beginChunkedResponse开始发送时只发送最后一个块 */
     int sendResponse(HttpResponse::ptr rsp);
+    /* 以分块编码开始发送响应，立即发送状态行和头部，之后通过返回的流发送消息体，servlet
+     * 返回后由sendResponse发送最后一个块。HTTP/1.0不支持分块编码，返回nullptr，调用者
+     * 应改为设置响应的body
+     */
+    HttpChunkedWriter::ptr beginChunkedResponse(HttpResponse::ptr rsp);
+    /* 发送响应，消息体为文件fd中从offset开始的length字节，超过SMALL_FILE_SIZE时通过
+     * sendfile发送，忽略响应的body。servlet返回后sendResponse不再发送，返回这里的结果
+     */
+    int64_t sendFileResponse(HttpResponse::ptr rsp, int fd, uint64_t offset,
+                             uint64_t length);
+    /* 连接的处理状态，设置后recvRequest收到请求数据时标记连接为忙 */
+    void setClientState(ClientState::ptr v) { m_state = v; }
+
+private:
+    /* 读取消息体，先读取缓冲区中剩余的数据，再从socket读取 */
+    int readBody(void *buffer, size_t length);
+    /* 接收分块编码的消息体，te为Transfer-Encoding头部的值 */
+    bool recvChunkedBody(HttpRequest::ptr req, const boost::string_view &te);
+    /* 根据版本和Connection头部设置请求是否关闭连接 */
+    HttpRequest::ptr checkClose(HttpRequest::ptr req);
+    /* 读取一行，不包括行尾的CRLF，行超过缓冲区大小或连接断开时返回false */
+    bool readLine(std::string &line);
+    /* 丢弃已处理的数据，剩余数据移到缓冲区开头，缓冲区仍被上一个请求引用时(零拷贝的
+     * 头部指向其中)换用新的缓冲区
+     */
+    void compactBuffer();
+
+private:
+    HttpRequestParser::ptr m_parser; //解析器，每个请求重置后复用
+    std::shared_ptr<char> m_buffer;  //接收缓冲区，整个连接复用
+    size_t m_bufferSize;             //缓冲区大小
+    size_t m_begin;                  //未处理数据的开始位置
+    size_t m_end;                    //未处理数据的结束位置
+    HttpBodyStream::ptr m_body;      //当前请求流式读取的消息体
+    HttpChunkedWriter::ptr m_writer; //当前分块编码发送的响应
+    std::string m_sendBuffer;        //响应头部的发送缓冲区，整个连接复用
+    bool m_sent;                     //当前响应是否已通过sendFileResponse发送
+    int m_sentResult;                //sendFileResponse的结果
+    ClientState::ptr m_state;        //连接的处理状态，可以为空
 };
 
 } // namespace http
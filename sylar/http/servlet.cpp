@@ -1,8 +1,194 @@
 #include "servlet.h"
+#include "sylar/log.h"
 #include <fnmatch.h>
 
 namespace sylar {
 namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static const std::string s_any_name = "*";
+
+/* 模式是否可以加入路由树，只允许末尾有'*' */
+static bool IsPrefixGlob(const std::string &uri) {
+    size_t pos = uri.find_first_of("*?[\\");
+    return pos != std::string::npos && pos == uri.size() - 1 && uri[pos] == '*';
+}
+
+RouteTree::RouteTree()
+    : m_root(new Node) {}
+
+RouteTree::RouteTree(const RouteTree &rhs)
+    : m_root(clone(rhs.m_root.get())) {}
+
+RouteTree &RouteTree::operator=(const RouteTree &rhs) {
+    if (this != &rhs) {
+        m_root.reset(clone(rhs.m_root.get()));
+    }
+    return *this;
+}
+
+RouteTree::Node *RouteTree::clone(const Node *node) {
+    Node *rt      = new Node;
+    rt->path      = node->path;
+    rt->indices   = node->indices;
+    rt->paramName = node->paramName;
+    rt->servlet   = node->servlet;
+    rt->any       = node->any;
+    for (auto &i : node->children) {
+        rt->children.emplace_back(clone(i.get()));
+    }
+    if (node->param) {
+        rt->param.reset(clone(node->param.get()));
+    }
+    return rt;
+}
+
+bool RouteTree::add(const std::string &pattern, Servlet::ptr slt,
+                    bool wildcard) {
+    Servlet::ptr *s = slot(pattern, wildcard, true);
+    if (!s) {
+        return false;
+    }
+    *s = slt;
+    return true;
+}
+
+void RouteTree::del(const std::string &pattern, bool wildcard) {
+    Servlet::ptr *s = slot(pattern, wildcard, false);
+    if (s) {
+        s->reset();
+    }
+}
+
+Servlet::ptr RouteTree::get(const std::string &pattern, bool wildcard) const {
+    //create为false时不修改路由树
+    Servlet::ptr *s =
+        const_cast<RouteTree *>(this)->slot(pattern, wildcard, false);
+    return s ? *s : nullptr;
+}
+
+Servlet::ptr *RouteTree::slot(const std::string &pattern, bool wildcard,
+                              bool create) {
+    Node *node = m_root.get();
+    size_t n   = pattern.size();
+    bool any   = wildcard && n > 0 && pattern[n - 1] == '*';
+    if (any) {
+        --n;
+    }
+    size_t pos = 0;
+    while (pos < n) {
+        //以':'开头的路径段为参数
+        if (pattern[pos] == ':' && (pos == 0 || pattern[pos - 1] == '/')) {
+            size_t end = std::min(pattern.find('/', pos), n);
+            std::string name = pattern.substr(pos + 1, end - pos - 1);
+            if (!node->param) {
+                if (!create) {
+                    return nullptr;
+                }
+                node->param.reset(new Node);
+                node->param->paramName = name;
+            } else if (node->param->paramName != name) {
+                return nullptr;
+            }
+            node = node->param.get();
+            pos  = end;
+            continue;
+        }
+        size_t end = pos + 1;
+        while (end < n && !(pattern[end] == ':' && pattern[end - 1] == '/')) {
+            ++end;
+        }
+        node = insertStatic(node, pattern, pos, end, create);
+        if (!node) {
+            return nullptr;
+        }
+        pos = end;
+    }
+    return any ? &node->any : &node->servlet;
+}
+
+RouteTree::Node *RouteTree::insertStatic(Node *node,
+                                         const std::string &pattern,
+                                         size_t pos, size_t end, bool create) {
+    while (pos < end) {
+        size_t i = node->indices.find(pattern[pos]);
+        if (i == std::string::npos) {
+            if (!create) {
+                return nullptr;
+            }
+            Node *child = new Node;
+            child->path = pattern.substr(pos, end - pos);
+            node->indices.push_back(pattern[pos]);
+            node->children.emplace_back(child);
+            return child;
+        }
+        Node *child = node->children[i].get();
+        size_t len  = 1;
+        while (len < child->path.size() && pos + len < end &&
+               child->path[len] == pattern[pos + len]) {
+            ++len;
+        }
+        if (len < child->path.size()) {
+            if (!create) {
+                return nullptr;
+            }
+            //公共前缀拆分为新的节点
+            std::unique_ptr<Node> mid(new Node);
+            mid->path = child->path.substr(0, len);
+            child->path.erase(0, len);
+            mid->indices.push_back(child->path[0]);
+            mid->children.push_back(std::move(node->children[i]));
+            node->children[i] = std::move(mid);
+            child             = node->children[i].get();
+        }
+        node = child;
+        pos += len;
+    }
+    return node;
+}
+
+const Servlet::ptr *RouteTree::match(const std::string &path,
+                                     Params &params) const {
+    return match(m_root.get(), path, 0, params);
+}
+
+const Servlet::ptr *RouteTree::match(const Node *node, const std::string &path,
+                                     size_t pos, Params &params) {
+    if (pos == path.size() && node->servlet) {
+        return &node->servlet;
+    }
+    if (pos < path.size()) {
+        size_t i = node->indices.find(path[pos]);
+        if (i != std::string::npos) {
+            const Node *child = node->children[i].get();
+            if (path.compare(pos, child->path.size(), child->path) == 0) {
+                const Servlet::ptr *rt =
+                    match(child, path, pos + child->path.size(), params);
+                if (rt) {
+                    return rt;
+                }
+            }
+        }
+        if (node->param && path[pos] != '/') {
+            size_t end = std::min(path.find('/', pos), path.size());
+            const Servlet::ptr *rt = match(node->param.get(), path, end, params);
+            if (rt) {
+                params.push_back(
+                    Param(&node->param->paramName,
+                          boost::string_view(path.data() + pos, end - pos)));
+                return rt;
+            }
+        }
+    }
+    if (node->any) {
+        params.push_back(Param(&s_any_name,
+                               boost::string_view(path.data() + pos,
+                                                  path.size() - pos)));
+        return &node->any;
+    }
+    return nullptr;
+}
 FunctionServlet::FunctionServlet(callback cb)
     : Servlet("FunctionServlet")
     , m_cb(cb) {}
@@ -32,41 +218,112 @@ int32_t NotFoundServlet::handle(HttpRequest::ptr request,
 }
 
 ServletDispatch::ServletDispatch()
-    : Servlet("ServletDispatch") {
-    m_default.reset(new NotFoundServlet);
+    : Servlet("ServletDispatch")
+    , m_table(new RouteTable)
+    , m_epoch(0) {
+    for (auto &i : m_readers) {
+        i.count[0] = 0;
+        i.count[1] = 0;
+    }
+    m_table.load()->def.reset(new NotFoundServlet);
+}
+
+ServletDispatch::~ServletDispatch() {
+    delete m_table.load();
+    for (auto &i : m_retired) {
+        delete i.table;
+    }
+}
+
+ServletDispatch::ReadGuard::ReadGuard(ServletDispatch *dispatch) {
+    static thread_local size_t s_slot = sylar::GetThreadId() % READER_SLOTS;
+    /* 先登记再读取路由表，读到旧路由表的读者一定在旧路由表被替换之前已经登记。读取纪元
+     * 后可能被挂起，登记的奇偶不一定是当前纪元的，所以写者要等两种奇偶的读者数都降为0
+     */
+    uint64_t epoch = dispatch->m_epoch.load();
+    m_count        = &dispatch->m_readers[s_slot].count[epoch & 1];
+    m_count->fetch_add(1);
+    m_table = dispatch->m_table.load();
+}
+
+ServletDispatch::ReadGuard::~ReadGuard() { m_count->fetch_sub(1); }
+
+void ServletDispatch::update(std::function<void(RouteTable &)> cb) {
+    MutexType::Lock lock(m_mutex);
+    RouteTable *old   = m_table.load();
+    RouteTable *table = new RouteTable(*old);
+    cb(*table);
+    m_table.store(table);
+    //之后的读者登记到新纪元的奇偶上，使旧纪元的读者数能够降为0
+    m_epoch.fetch_add(1);
+    m_retired.push_back(RetiredTable{old, {false, false}});
+
+    /* 使用旧路由表的读者在替换前已登记，登记一直保持到读取结束。替换之后某个时刻奇偶为
+     * i的读者数为0，说明登记在i上的这些读者都已结束，两种奇偶都观察到0后才能释放
+     */
+    uint64_t readers[2] = {0, 0};
+    for (auto &i : m_readers) {
+        readers[0] += i.count[0].load();
+        readers[1] += i.count[1].load();
+    }
+    for (auto it = m_retired.begin(); it != m_retired.end();) {
+        for (int i = 0; i < 2; ++i) {
+            it->drained[i] = it->drained[i] || readers[i] == 0;
+        }
+        if (it->drained[0] && it->drained[1]) {
+            delete it->table;
+            it = m_retired.erase(it);
+        } else {
+            ++it;
+        }
+    }
 }
 
 int32_t ServletDispatch::handle(HttpRequest::ptr request,
                                 HttpResponse::ptr response,
                                 HttpSession::ptr session) {
-    auto slt = getMatchedServlet(request->getPath());
-    if (slt) {
-        slt->handle(request, response, session);
+    ReadGuard guard(this);
+    const Servlet::ptr *slt =
+        match(guard.table(), request->getPath(), request);
+    if (*slt) {
+        (*slt)->handle(request, response, session);
     }
 
     return 0;
 }
 
 void ServletDispatch::addServlet(const std::string &uri, Servlet::ptr slt) {
-    RWMutexType::WriteLock lock(m_mutex);
-    m_datas[uri] = slt;
+    update([&uri, &slt](RouteTable &table) {
+        if (!table.routes.add(uri, slt, false)) {
+            SYLAR_LOG_ERROR(g_logger) << "addServlet " << uri
+                                      << " fail, conflicting parameter name";
+        }
+    });
 }
 
 void ServletDispatch::addServlet(const std::string &uri,
                                  FunctionServlet::callback cb) {
-    RWMutexType::WriteLock lock(m_mutex);
-    m_datas[uri].reset(new FunctionServlet(cb));
+    addServlet(uri, FunctionServlet::ptr(new FunctionServlet(cb)));
 }
 
 void ServletDispatch::addGlobServlet(const std::string &uri, Servlet::ptr slt) {
-    RWMutexType::WriteLock lock(m_mutex);
-    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
-        if (it->first == uri) {
-            m_globs.erase(it);
-            break;
+    update([&uri, &slt](RouteTable &table) {
+        if (IsPrefixGlob(uri)) {
+            if (!table.routes.add(uri, slt, true)) {
+                SYLAR_LOG_ERROR(g_logger)
+                    << "addGlobServlet " << uri
+                    << " fail, conflicting parameter name";
+            }
+            return;
         }
-    }
-    m_globs.push_back(std::make_pair(uri, slt));
+        for (auto it = table.globs.begin(); it != table.globs.end(); ++it) {
+            if (it->first == uri) {
+                table.globs.erase(it);
+                break;
+            }
+        }
+        table.globs.push_back(std::make_pair(uri, slt));
+    });
 }
 
 void ServletDispatch::addGlobServlet(const std::string &uri,
@@ -75,29 +332,45 @@ void ServletDispatch::addGlobServlet(const std::string &uri,
 }
 
 void ServletDispatch::delServlet(const std::string &uri) {
-    RWMutexType::WriteLock lock(m_mutex);
-    m_datas.erase(uri);
+    update([&uri](RouteTable &table) { table.routes.del(uri, false); });
 }
 
 void ServletDispatch::delGlobServlet(const std::string &uri) {
-    RWMutexType::WriteLock lock(m_mutex);
-    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
-        if (it->first == uri) {
-            m_globs.erase(it);
-            break;
+    update([&uri](RouteTable &table) {
+        if (IsPrefixGlob(uri)) {
+            table.routes.del(uri, true);
+            return;
         }
-    }
+        for (auto it = table.globs.begin(); it != table.globs.end(); ++it) {
+            if (it->first == uri) {
+                table.globs.erase(it);
+                break;
+            }
+        }
+    });
+}
+
+void ServletDispatch::setDefault(Servlet::ptr v) {
+    update([&v](RouteTable &table) { table.def = v; });
+}
+
+Servlet::ptr ServletDispatch::getDefault() {
+    ReadGuard guard(this);
+    return guard.table()->def;
 }
 
 Servlet::ptr ServletDispatch::getServlet(const std::string &uri) {
-    RWMutexType::ReadLock lock(m_mutex);
-    auto it = m_datas.find(uri);
-    return it == m_datas.end() ? nullptr : it->second;
+    ReadGuard guard(this);
+    return guard.table()->routes.get(uri, false);
 }
 
 Servlet::ptr ServletDispatch::getGlobServlet(const std::string &uri) {
-    RWMutexType::ReadLock lock(m_mutex);
-    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
+    ReadGuard guard(this);
+    const RouteTable *table = guard.table();
+    if (IsPrefixGlob(uri)) {
+        return table->routes.get(uri, true);
+    }
+    for (auto it = table->globs.begin(); it != table->globs.end(); ++it) {
         if (it->first == uri) {
             return it->second;
         }
@@ -106,24 +379,37 @@ Servlet::ptr ServletDispatch::getGlobServlet(const std::string &uri) {
     return nullptr;
 }
 
-Servlet::ptr ServletDispatch::getMatchedServlet(const std::string &uri) {
-    RWMutexType::ReadLock lock(m_mutex);
+Servlet::ptr ServletDispatch::getMatchedServlet(const std::string &uri,
+                                                HttpRequest::ptr request) {
+    ReadGuard guard(this);
+    return *match(guard.table(), uri, request);
+}
 
-    //精确匹配
-    auto mit = m_datas.find(uri);
-    if (mit != m_datas.end()) {
-        return mit->second;
+const Servlet::ptr *ServletDispatch::match(const RouteTable *table,
+                                           const std::string &uri,
+                                           HttpRequest::ptr request) {
+    //路由树匹配，参数数组在线程内复用
+    static thread_local RouteTree::Params params;
+    params.clear();
+    const Servlet::ptr *slt = table->routes.match(uri, params);
+    if (slt) {
+        if (request) {
+            for (auto &i : params) {
+                request->setPathParam(*i.first, i.second.to_string());
+            }
+        }
+        return slt;
     }
 
     //模糊匹配
-    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
+    for (auto it = table->globs.begin(); it != table->globs.end(); ++it) {
         if (!fnmatch(it->first.c_str(), uri.c_str(), 0)) {
-            return it->second;
+            return &it->second;
         }
     }
 
     //默认
-    return m_default;
+    return &table->def;
 }
 
 } // namespace http
@@ -4,7 +4,9 @@
 #include "http.h"
 #include "http_session.h"
 #include "sylar/thread.h"
+#include <atomic>
 #include <functional>
+#include <list>
 #include <memory>
 #include <unordered_map>
 #include <vector>
@@ -54,43 +56,145 @@ public:
                            HttpSession::ptr session) override;
 };
 
+//压缩前缀树(radix tree)路由，按路径长度查找，与路由数量无关
+//模式支持静态路径"/api/users"、参数"/user/:id/profile"(:id匹配一个非空的路径段)
+//和末尾的通配符"/static/*"(匹配剩余的任意字符，可以为空或包含'/')
+//匹配优先级为静态 > 参数 > 通配符，不匹配时回溯
+class RouteTree {
+public:
+    /* 匹配得到的参数名和值，值指向匹配的路径，通配符的参数名为"*" */
+    typedef std::pair<const std::string *, boost::string_view> Param;
+    typedef std::vector<Param> Params;
+
+    RouteTree();
+    /* 深拷贝，用于写时复制 */
+    RouteTree(const RouteTree &rhs);
+    RouteTree &operator=(const RouteTree &rhs);
+
+    /* 添加路由，wildcard为false时'*'作为普通字符，已存在时替换
+     * 同一位置的参数名不一致时返回false
+     */
+    bool add(const std::string &pattern, Servlet::ptr slt, bool wildcard);
+    /* 删除路由，只清除servlet，不删除节点 */
+    void del(const std::string &pattern, bool wildcard);
+    /* 获取模式对应的servlet */
+    Servlet::ptr get(const std::string &pattern, bool wildcard) const;
+
+    /* 匹配路径，params按从后往前的顺序追加参数，不匹配时返回nullptr */
+    const Servlet::ptr *match(const std::string &path, Params &params) const;
+
+private:
+    struct Node {
+        std::string path;                            //压缩的静态路径
+        std::string indices;                         //各静态子节点path的首字符
+        std::vector<std::unique_ptr<Node>> children; //静态子节点
+        std::unique_ptr<Node> param;                 //参数子节点
+        std::string paramName;                       //参数子节点的参数名
+        Servlet::ptr servlet;                        //在此结束的路由
+        Servlet::ptr any;                            //此后为通配符的路由
+    };
+
+    static Node *clone(const Node *node);
+    /* 模式对应的servlet位置，create为true时创建不存在的节点 */
+    Servlet::ptr *slot(const std::string &pattern, bool wildcard, bool create);
+    /* 在node下查找或插入静态路径pattern[pos, end)，返回路径结束的节点 */
+    static Node *insertStatic(Node *node, const std::string &pattern,
+                              size_t pos, size_t end, bool create);
+    static const Servlet::ptr *match(const Node *node, const std::string &path,
+                                     size_t pos, Params &params);
+
+private:
+    std::unique_ptr<Node> m_root;
+};
+
+/* 路由表不可修改，修改时复制一份新的路由表再原子地替换(RCU)
+ * 读取时不加锁也不修改路由表和servlet的引用计数，只在当前线程对应的计数槽上
+ * 登记所在的纪元，替换下来的旧路由表在其纪元的读者全部结束后释放
+ */
 class ServletDispatch : public Servlet {
 public:
     typedef std::shared_ptr<ServletDispatch> ptr;
-    typedef RWMutex RWMutexType;
+    typedef Mutex MutexType;
 
     ServletDispatch();
+    ~ServletDispatch();
     virtual int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
                            HttpSession::ptr session) override;
 
+    /* uri中以':'开头的路径段为参数，如"/user/:id"，参数值通过
+     * HttpRequest::getPathParam获取
+     */
     void addServlet(const std::string &uri, Servlet::ptr slt);
     void addServlet(const std::string &uri, FunctionServlet::callback cb);
 
+    /* 只在末尾有'*'的模式加入路由树，按前缀匹配，其余的模式(含'?'、'['或中间的'*')
+     * 在路由树不匹配时依次使用fnmatch匹配
+     */
     void addGlobServlet(const std::string &uri, Servlet::ptr slt);
     void addGlobServlet(const std::string &uri, FunctionServlet::callback cb);
 
     void delServlet(const std::string &uri);
     void delGlobServlet(const std::string &uri);
 
-    void setDefault(Servlet::ptr v) { m_default = v; }
-    Servlet::ptr getDefault() const { return m_default; }
+    void setDefault(Servlet::ptr v);
+    Servlet::ptr getDefault();
 
     Servlet::ptr getServlet(const std::string &uri);
     Servlet::ptr getGlobServlet(const std::string &uri);
 
-    //优先精准匹配，其次模糊匹配，最后返回默认
-    Servlet::ptr getMatchedServlet(const std::string &uri);
+    //优先路由树匹配(静态 > 参数 > 通配符)，其次fnmatch模糊匹配，最后返回默认
+    //request不为空时设置匹配得到的路径参数
+    Servlet::ptr getMatchedServlet(const std::string &uri,
+                                   HttpRequest::ptr request = nullptr);
 
 private:
-    RWMutexType m_mutex;
-
-    //精准匹配servlet map, uri(sylar/xxx) -> servlet
-    std::unordered_map<std::string, Servlet::ptr> m_datas;
+    /* 路由表快照，发布后不再修改 */
+    struct RouteTable {
+        //精准匹配、参数和前缀匹配的路由树
+        RouteTree routes;
+        //不能加入路由树的模糊匹配servlet, uri(sylar/*.html) -> servlet
+        std::vector<std::pair<std::string, Servlet::ptr>> globs;
+        Servlet::ptr def;
+    };
+
+    /* 读者计数槽，按线程id分配，每个槽占一个cache line，下标为纪元的奇偶 */
+    struct ReaderSlot {
+        std::atomic<uint64_t> count[2];
+        char pad[64 - 2 * sizeof(std::atomic<uint64_t>)];
+    };
+    static const size_t READER_SLOTS = 64;
+
+    /* 已被替换的旧路由表，drained[i]表示替换之后已观察到纪元奇偶为i的读者数为0 */
+    struct RetiredTable {
+        RouteTable *table;
+        bool drained[2];
+    };
+
+    /* 读取期间保持路由表不被释放 */
+    class ReadGuard {
+    public:
+        ReadGuard(ServletDispatch *dispatch);
+        ~ReadGuard();
+        const RouteTable *table() const { return m_table; }
+
+    private:
+        std::atomic<uint64_t> *m_count;
+        const RouteTable *m_table;
+    };
+
+    /* 复制当前路由表，修改后发布，并释放可以释放的旧路由表 */
+    void update(std::function<void(RouteTable &)> cb);
+    /* 在table中匹配uri，request不为空时设置路径参数 */
+    static const Servlet::ptr *match(const RouteTable *table,
+                                     const std::string &uri,
+                                     HttpRequest::ptr request);
 
-    //模糊匹配servlet, uri(sylar/*) -> servlet
-    std::vector<std::pair<std::string, Servlet::ptr>> m_globs;
-
-    Servlet::ptr m_default;
+private:
+    MutexType m_mutex; //只由写者使用
+    std::atomic<RouteTable *> m_table;
+    std::atomic<uint64_t> m_epoch;
+    ReaderSlot m_readers[READER_SLOTS];
+    std::list<RetiredTable> m_retired; //等待释放的旧路由表
 };
 
 } // namespace http
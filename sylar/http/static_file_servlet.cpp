@@ -0,0 +1,340 @@
+#include "static_file_servlet.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/util.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_static_file_cache_size =
+    sylar::ConfigManager::LookUp("http.static_file.cache_size", (uint32_t)1024,
+                                 "static file servlet max cached files");
+
+static sylar::ConfigVar<uint32_t>::ptr g_static_file_check_interval =
+    sylar::ConfigManager::LookUp("http.static_file.check_interval",
+                                 (uint32_t)1000,
+                                 "static file servlet re-stat interval ms");
+
+static const struct {
+    const char *ext;
+    const char *type;
+} s_content_types[] = {
+    {"html", "text/html"},
+    {"htm", "text/html"},
+    {"css", "text/css"},
+    {"js", "application/javascript"},
+    {"json", "application/json"},
+    {"txt", "text/plain"},
+    {"xml", "text/xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"svg", "image/svg+xml"},
+    {"ico", "image/x-icon"},
+    {"pdf", "application/pdf"},
+    {"wasm", "application/wasm"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"mp4", "video/mp4"},
+};
+
+static const char *GetContentType(const std::string &path) {
+    size_t pos = path.rfind('.');
+    if (pos != std::string::npos && path.find('/', pos) == std::string::npos) {
+        const char *ext = path.c_str() + pos + 1;
+        for (auto &i : s_content_types) {
+            if (strcasecmp(ext, i.ext) == 0) {
+                return i.type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+/* 路径中不能有".."，避免访问root之外的文件 */
+static bool IsSafePath(const std::string &path) {
+    size_t begin = 0;
+    while (begin <= path.size()) {
+        size_t end = path.find('/', begin);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        if (end - begin == 2 && path.compare(begin, 2, "..") == 0) {
+            return false;
+        }
+        begin = end + 1;
+    }
+    return path.find('\0') == std::string::npos;
+}
+
+/* If-None-Match是否匹配，值为"*"或逗号分隔的多个ETag，使用弱比较 */
+static bool MatchETag(const std::string &header, const std::string &etag) {
+    size_t begin = 0;
+    while (begin < header.size()) {
+        size_t end = header.find(',', begin);
+        if (end == std::string::npos) {
+            end = header.size();
+        }
+        size_t b = header.find_first_not_of(" \t", begin);
+        size_t e = header.find_last_not_of(" \t", end - 1);
+        if (b != std::string::npos && b < end && e >= b) {
+            if (header.compare(b, 2, "W/") == 0) {
+                b += 2;
+            }
+            if ((e - b + 1 == 1 && header[b] == '*') ||
+                header.compare(b, e - b + 1, etag) == 0) {
+                return true;
+            }
+        }
+        begin = end + 1;
+    }
+    return false;
+}
+
+/* 解析Range头部，只支持单个范围
+ * 返回1表示有效的范围，0表示忽略Range返回整个文件，-1表示范围不能满足
+ */
+static int ParseRange(const std::string &range, uint64_t size,
+                      uint64_t &offset, uint64_t &length) {
+    if (range.compare(0, 6, "bytes=") != 0 ||
+        range.find(',') != std::string::npos) {
+        return 0;
+    }
+    const char *p = range.c_str() + 6;
+    const char *dash = strchr(p, '-');
+    if (!dash) {
+        return 0;
+    }
+    char *end = nullptr;
+    if (dash == p) {
+        //最后n个字节
+        if (!isdigit(dash[1])) {
+            return 0;
+        }
+        uint64_t n = strtoull(dash + 1, &end, 10);
+        if (*end) {
+            return 0;
+        }
+        if (n == 0 || size == 0) {
+            return -1;
+        }
+        length = std::min(n, size);
+        offset = size - length;
+        return 1;
+    }
+    if (!isdigit(*p)) {
+        return 0;
+    }
+    uint64_t first = strtoull(p, &end, 10);
+    if (end != dash) {
+        return 0;
+    }
+    uint64_t last = size ? size - 1 : 0;
+    if (dash[1]) {
+        if (!isdigit(dash[1])) {
+            return 0;
+        }
+        last = strtoull(dash + 1, &end, 10);
+        if (*end || last < first) {
+            return 0;
+        }
+        last = std::min(last, size ? size - 1 : 0);
+    }
+    if (first >= size) {
+        return -1;
+    }
+    offset = first;
+    length = last - first + 1;
+    return 1;
+}
+
+StaticFileServlet::FileInfo::~FileInfo() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+StaticFileServlet::StaticFileServlet(const std::string &prefix,
+                                     const std::string &root)
+    : Servlet("StaticFileServlet")
+    , m_prefix(prefix)
+    , m_root(root) {}
+
+size_t StaticFileServlet::getCacheSize() {
+    Mutex::Lock lock(m_mutex);
+    return m_cache.size();
+}
+
+StaticFileServlet::FileInfo::ptr
+StaticFileServlet::getFile(const std::string &path) {
+    uint64_t now = sylar::GetCurrentMS();
+    FileInfo::ptr info;
+    {
+        Mutex::Lock lock(m_mutex);
+        auto it = m_cache.find(path);
+        if (it != m_cache.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            info = it->second->second;
+            if (now - info->checkTime < g_static_file_check_interval->getValue()) {
+                return info;
+            }
+        }
+    }
+
+    //缓存过期时重新stat，文件未修改时继续使用
+    std::string full = m_root + "/" + path;
+    struct stat st;
+    if (stat(full.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        Mutex::Lock lock(m_mutex);
+        auto it = m_cache.find(path);
+        if (it != m_cache.end()) {
+            m_lru.erase(it->second);
+            m_cache.erase(it);
+        }
+        return nullptr;
+    }
+    if (info && info->ino == st.st_ino && info->size == (uint64_t)st.st_size &&
+        info->mtime == st.st_mtime) {
+        //info被缓存共享，其他线程在锁内读取checkTime
+        Mutex::Lock lock(m_mutex);
+        info->checkTime = now;
+        return info;
+    }
+    return openFile(path);
+}
+
+StaticFileServlet::FileInfo::ptr
+StaticFileServlet::openFile(const std::string &path) {
+    std::string full = m_root + "/" + path;
+    int fd           = ::open(full.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        SYLAR_LOG_DEBUG(g_logger) << "open " << full << " fail, errno=" << errno
+                                  << " errstr=" << strerror(errno);
+        return nullptr;
+    }
+    FileInfo::ptr info(new FileInfo);
+    info->fd = fd;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return nullptr;
+    }
+    info->size      = st.st_size;
+    info->mtime     = st.st_mtime;
+    info->ino       = st.st_ino;
+    info->checkTime = sylar::GetCurrentMS();
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)info->mtime,
+             (unsigned long)info->size);
+    info->etag         = etag;
+    info->lastModified = HttpDateToString(info->mtime);
+    info->contentType  = GetContentType(path);
+
+    Mutex::Lock lock(m_mutex);
+    auto it = m_cache.find(path);
+    if (it != m_cache.end()) {
+        m_lru.erase(it->second);
+    }
+    m_lru.push_front(std::make_pair(path, info));
+    m_cache[path] = m_lru.begin();
+    //被淘汰的文件在正在发送的请求结束后关闭
+    while (m_cache.size() > g_static_file_cache_size->getValue()) {
+        m_cache.erase(m_lru.back().first);
+        m_lru.pop_back();
+    }
+    return info;
+}
+
+int32_t StaticFileServlet::handle(HttpRequest::ptr request,
+                                  HttpResponse::ptr response,
+                                  HttpSession::ptr session) {
+    HttpMethod method = request->getMethod();
+    if (method != HttpMethod::GET && method != HttpMethod::HEAD) {
+        response->setStatus(HttpStatus::METHOD_NOT_ALLOWED);
+        response->setHeader("Allow", "GET, HEAD");
+        return 0;
+    }
+    const std::string &uri = request->getPath();
+    if (uri.compare(0, m_prefix.size(), m_prefix) != 0) {
+        response->setStatus(HttpStatus::NOT_FOUND);
+        return 0;
+    }
+    std::string path = uri.substr(m_prefix.size());
+    if (!IsSafePath(path)) {
+        response->setStatus(HttpStatus::FORBIDDEN);
+        return 0;
+    }
+    if (path.empty() || path.back() == '/') {
+        path += "index.html";
+    }
+    FileInfo::ptr file = getFile(path);
+    if (!file) {
+        response->setStatus(HttpStatus::NOT_FOUND);
+        return 0;
+    }
+
+    response->setHeader("Content-Type", file->contentType);
+    response->setHeader("Last-Modified", file->lastModified);
+    response->setHeader("ETag", file->etag);
+    response->setHeader("Accept-Ranges", "bytes");
+
+    //条件请求，有If-None-Match时忽略If-Modified-Since
+    boost::string_view inm;
+    boost::string_view ims;
+    bool not_modified = false;
+    if (request->findHeader("If-None-Match", inm)) {
+        not_modified = MatchETag(inm.to_string(), file->etag);
+    } else if (request->findHeader("If-Modified-Since", ims)) {
+        time_t t     = StringToHttpDate(ims.to_string());
+        not_modified = t != -1 && file->mtime <= t;
+    }
+    if (not_modified) {
+        response->setStatus(HttpStatus::NOT_MODIFIED);
+        return 0;
+    }
+
+    uint64_t offset = 0;
+    uint64_t length = file->size;
+    boost::string_view range;
+    boost::string_view if_range;
+    //If-Range与当前文件不一致时忽略Range，返回整个文件
+    if (request->findHeader("Range", range) &&
+        (!request->findHeader("If-Range", if_range) ||
+         if_range == file->etag || if_range == file->lastModified)) {
+        int rt = ParseRange(range.to_string(), file->size, offset, length);
+        if (rt < 0) {
+            response->setStatus(HttpStatus::RANGE_NOT_SATISFIABLE);
+            response->setHeader("Content-Range",
+                                "bytes */" + std::to_string(file->size));
+            return 0;
+        }
+        if (rt > 0) {
+            response->setStatus(HttpStatus::PARTIAL_CONTENT);
+            response->setHeader("Content-Range",
+                                "bytes " + std::to_string(offset) + "-" +
+                                    std::to_string(offset + length - 1) + "/" +
+                                    std::to_string(file->size));
+        }
+    }
+
+    if (method == HttpMethod::HEAD) {
+        response->setHeader("Content-Length", std::to_string(length));
+        return 0;
+    }
+    if (session->sendFileResponse(response, file->fd, offset, length) <= 0) {
+        //响应可能只发送了一部分，连接不能再复用
+        SYLAR_LOG_DEBUG(g_logger) << "send " << path << " fail, errno="
+                                  << errno << " errstr=" << strerror(errno);
+        response->setClose(true);
+        return -1;
+    }
+    return 0;
+}
+
+} // namespace http
+} // namespace sylar
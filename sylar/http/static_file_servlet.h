@@ -0,0 +1,65 @@
+#ifndef MYSYLAR_STATIC_FILE_SERVLET_H
+#define MYSYLAR_STATIC_FILE_SERVLET_H
+
+#include "servlet.h"
+#include <list>
+#include <sys/types.h>
+
+namespace sylar {
+namespace http {
+
+/* 静态文件servlet，将uri前缀映射到目录，文件内容通过sendfile发送，不经过用户态拷贝
+ * 支持GET/HEAD、单个Range、If-None-Match/If-Modified-Since条件请求
+ * 打开的fd和stat结果保存在LRU缓存中，缓存的文件每隔http.static_file.check_interval
+ * 重新stat一次，文件被修改或替换时重新打开
+ */
+class StaticFileServlet : public Servlet {
+public:
+    typedef std::shared_ptr<StaticFileServlet> ptr;
+
+    /* 缓存的文件，fd在不再被引用时关闭，多个请求通过sendfile的offset参数共用一个fd */
+    struct FileInfo {
+        typedef std::shared_ptr<FileInfo> ptr;
+        ~FileInfo();
+
+        int fd;
+        uint64_t size;
+        time_t mtime;
+        ino_t ino;
+        uint64_t checkTime;       //上次stat的时间，单位ms，加入缓存后在锁内读写
+        std::string etag;         //"mtime-size"，与nginx的格式相同
+        std::string lastModified; //RFC 7231格式的修改时间
+        const char *contentType;
+    };
+
+    /* prefix: uri前缀，如"/static/"，请求路径去掉前缀后为相对root的文件路径
+     * root: 文件所在的目录
+     */
+    StaticFileServlet(const std::string &prefix, const std::string &root);
+
+    virtual int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                           HttpSession::ptr session) override;
+
+    /* 获取相对root的文件，优先使用缓存，不存在或不是普通文件时返回nullptr */
+    FileInfo::ptr getFile(const std::string &path);
+    /* 缓存的文件个数 */
+    size_t getCacheSize();
+
+private:
+    /* 打开文件并加入缓存，缓存超过上限时淘汰最久未使用的 */
+    FileInfo::ptr openFile(const std::string &path);
+
+private:
+    typedef std::list<std::pair<std::string, FileInfo::ptr>> LruList;
+
+    std::string m_prefix;
+    std::string m_root;
+    Mutex m_mutex;
+    LruList m_lru; //最近使用的在前
+    std::unordered_map<std::string, LruList::iterator> m_cache;
+};
+
+} // namespace http
+} // namespace sylar
+
+#endif
\ No newline at end of file
@@ -1,9 +1,14 @@
 #include "log.h"
 #include "config.h"
 #include <ctime>
+#include <fcntl.h>
 #include <functional>
 #include <iostream>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
 #include <tuple>
+#include <unistd.h>
 
 namespace sylar {
 
@@ -47,7 +52,256 @@ LogLevel::Level LogLevel::FromString(const std::string &str) {
 #undef XX
 }
 
-LogEvent::LogEvent(std::shared_ptr<Logger> logger, sylar::LogLevel::Level level,
+namespace {
+
+/* 把std::ostream的输出写入当前的LogStream */
+class LogStreamBuf : public std::streambuf {
+public:
+    LogStream *target = nullptr;
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            char ch = traits_type::to_char_type(c);
+            target->append(&ch, 1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        target->append(s, n);
+        return n;
+    }
+};
+
+struct LogOstream {
+    LogOstream()
+        : os(&buf) {}
+
+    LogStreamBuf buf;
+    std::ostream os;
+};
+
+//std::ostream默认的格式
+static const std::ios_base::fmtflags DEFAULT_FLAGS =
+    std::ios_base::skipws | std::ios_base::dec;
+
+} // namespace
+
+//每个线程一个，避免每条日志构造std::ostream
+static thread_local LogOstream t_log_ostream;
+
+//两位数字的查找表
+static const char s_digits[] = "00010203040506070809"
+                               "10111213141516171819"
+                               "20212223242526272829"
+                               "30313233343536373839"
+                               "40414243444546474849"
+                               "50515253545556575859"
+                               "60616263646566676869"
+                               "70717273747576777879"
+                               "80818283848586878889"
+                               "90919293949596979899";
+
+/* 从end向前写入v的十进制表示，返回起始位置 */
+static char *format_uint(unsigned long long v, char *end) {
+    char *p = end;
+    while (v >= 100) {
+        unsigned idx = (v % 100) * 2;
+        v /= 100;
+        *--p = s_digits[idx + 1];
+        *--p = s_digits[idx];
+    }
+    if (v >= 10) {
+        unsigned idx = v * 2;
+        *--p         = s_digits[idx + 1];
+        *--p         = s_digits[idx];
+    } else {
+        *--p = '0' + v;
+    }
+    return p;
+}
+
+LogStream::LogStream()
+    : m_data(m_inline)
+    , m_size(0)
+    , m_capacity(INLINE_SIZE)
+    , m_fmtChanged(false)
+    , m_prevTarget(nullptr)
+    , m_flags(DEFAULT_FLAGS)
+    , m_precision(6)
+    , m_width(0)
+    , m_fill(' ') {}
+
+LogStream::~LogStream() {
+    if (m_data != m_inline) {
+        delete[] m_data;
+    }
+}
+
+void LogStream::reserve(size_t len) {
+    if (m_size + len <= m_capacity) {
+        return;
+    }
+    size_t capacity = m_capacity * 2;
+    while (capacity < m_size + len) {
+        capacity *= 2;
+    }
+    char *data = new char[capacity];
+    memcpy(data, m_data, m_size);
+    if (m_data != m_inline) {
+        delete[] m_data;
+    }
+    m_data     = data;
+    m_capacity = capacity;
+}
+
+void LogStream::append(const char *data, size_t len) {
+    reserve(len);
+    memcpy(m_data + m_size, data, len);
+    m_size += len;
+}
+
+void LogStream::saveFormat(const std::ostream &os) {
+    m_flags     = os.flags();
+    m_precision = os.precision();
+    m_width     = os.width();
+    m_fill      = os.fill();
+}
+
+void LogStream::loadFormat(std::ostream &os) const {
+    os.flags(m_flags);
+    os.precision(m_precision);
+    os.width(m_width);
+    os.fill(m_fill);
+}
+
+/* 没有输出对象时线程共享的std::ostream保持默认的格式 */
+std::ostream &LogStream::beginOstream() {
+    std::ostream &os = t_log_ostream.os;
+    m_prevTarget     = t_log_ostream.buf.target;
+    if (m_prevTarget) {
+        //在operator<<中嵌套写日志，先保存外层日志的格式
+        m_prevTarget->saveFormat(os);
+        loadFormat(os);
+    } else if (m_fmtChanged) {
+        loadFormat(os);
+    }
+    t_log_ostream.buf.target = this;
+    return os;
+}
+
+void LogStream::endOstream() {
+    std::ostream &os = t_log_ostream.os;
+    if (!os) {
+        os.clear();
+    }
+    //格式被修改后数值也交给std::ostream输出
+    if (os.flags() != DEFAULT_FLAGS || os.precision() != 6 ||
+        os.width() != 0 || os.fill() != ' ') {
+        m_fmtChanged = true;
+    }
+    if (m_fmtChanged) {
+        saveFormat(os);
+    }
+    if (m_prevTarget) {
+        m_prevTarget->loadFormat(os);
+    } else if (m_fmtChanged) {
+        os.flags(DEFAULT_FLAGS);
+        os.precision(6);
+        os.width(0);
+        os.fill(' ');
+    }
+    t_log_ostream.buf.target = m_prevTarget;
+}
+
+LogStream &LogStream::operator<<(bool v) {
+    if (m_fmtChanged) {
+        beginOstream() << v;
+        endOstream();
+        return *this;
+    }
+    return *this << (v ? '1' : '0');
+}
+
+LogStream &LogStream::operator<<(long long v) {
+    if (m_fmtChanged) {
+        beginOstream() << v;
+        endOstream();
+        return *this;
+    }
+    char buf[32];
+    char *end = buf + sizeof(buf);
+    char *p   = format_uint(v < 0 ? 0 - (unsigned long long)v : v, end);
+    if (v < 0) {
+        *--p = '-';
+    }
+    append(p, end - p);
+    return *this;
+}
+
+LogStream &LogStream::operator<<(unsigned long long v) {
+    if (m_fmtChanged) {
+        beginOstream() << v;
+        endOstream();
+        return *this;
+    }
+    char buf[32];
+    char *end = buf + sizeof(buf);
+    char *p   = format_uint(v, end);
+    append(p, end - p);
+    return *this;
+}
+
+LogStream &LogStream::operator<<(double v) {
+    if (m_fmtChanged) {
+        beginOstream() << v;
+        endOstream();
+        return *this;
+    }
+    //与std::ostream默认的格式相同
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%g", v);
+    append(buf, len);
+    return *this;
+}
+
+LogStream &LogStream::operator<<(const char *v) {
+    if (v) {
+        append(v, strlen(v));
+    }
+    return *this;
+}
+
+LogStream &LogStream::operator<<(std::ostream &(*pf)(std::ostream &)) {
+    pf(beginOstream());
+    endOstream();
+    return *this;
+}
+
+LogStream &LogStream::operator<<(std::ios_base &(*pf)(std::ios_base &)) {
+    pf(beginOstream());
+    endOstream();
+    return *this;
+}
+
+void LogStream::format(const char *fmt, va_list al) {
+    va_list copy;
+    va_copy(copy, al);
+    size_t avail = m_capacity - m_size;
+    int len      = vsnprintf(m_data + m_size, avail, fmt, copy);
+    va_end(copy);
+    if (len < 0) {
+        return;
+    }
+    if ((size_t)len >= avail) {
+        reserve(len + 1);
+        vsnprintf(m_data + m_size, len + 1, fmt, al);
+    }
+    m_size += len;
+}
+
+LogEvent::LogEvent(Logger *logger, sylar::LogLevel::Level level,
                    const char *file, int32_t line, uint32_t elapse,
                    uint32_t thread_id, uint32_t fiber_id, uint64_t time)
     : m_file(file)
@@ -66,20 +320,26 @@ void LogEvent::format(const char *fmt, ...) {
     va_end(al);
 }
 
-void LogEvent::format(const char *fmt, va_list al) {
-    char *buf = nullptr;
-    int len   = vasprintf(&buf, fmt, al);
-    if (len != -1) {
-        m_ss << std::string(buf, len);
-        free(buf);
+void LogEvent::format(const char *fmt, va_list al) { m_ss.format(fmt, al); }
+
+const LogStream &LogEvent::getFormatted(LogFormatter *formatter) {
+    if (m_formattedBy != formatter) {
+        m_formatted.clear();
+        formatter->format(m_formatted, m_logger, m_level, *this);
+        m_formattedBy = formatter;
     }
+    return m_formatted;
 }
 
-LogEventWrap::LogEventWrap(sylar::LogEvent::ptr e)
-    : m_event(e) {}
+LogEventWrap::LogEventWrap(const std::shared_ptr<Logger> &logger,
+                           LogLevel::Level level, const char *file,
+                           int32_t line, uint32_t elapse, uint32_t thread_id,
+                           uint32_t fiber_id, uint64_t time)
+    : m_event(logger.get(), level, file, line, elapse, thread_id, fiber_id,
+              time) {}
 
 LogEventWrap::~LogEventWrap() {
-    m_event->getLogger()->log(m_event->getLevel(), m_event);
+    m_event.getLogger()->log(m_event.getLevel(), m_event);
 }
 
 LogFormatter::LogFormatter(const std::string &pattern)
@@ -91,17 +351,17 @@ LogFormatter::LogFormatter(const std::string &pattern)
 class MessageFormatItem : public LogFormatter::FormatItem {
 public:
     MessageFormatItem(const std::string &str = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getContent();
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
+        os.append(event.getContent().data(), event.getContent().size());
     }
 };
 
 class LevelFormatItem : public LogFormatter::FormatItem {
 public:
     LevelFormatItem(const std::string &str = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
         os << LogLevel::ToString(level);
     }
 };
@@ -109,78 +369,83 @@ public:
 class ElapseFormatItem : public LogFormatter::FormatItem {
 public:
     ElapseFormatItem(const std::string &str = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getElapse();
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
+        os << event.getElapse();
     }
 };
 
 class NameFormatItem : public LogFormatter::FormatItem {
 public:
     NameFormatItem(const std::string &str = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getLogger()->getName();
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
+        os << event.getLogger()->getName();
     }
 };
 
 class ThreadIdFormatItem : public LogFormatter::FormatItem {
 public:
     ThreadIdFormatItem(const std::string &str = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getThreadId();
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
+        os << event.getThreadId();
     }
 };
 
 class FiberIdFormatItem : public LogFormatter::FormatItem {
 public:
     FiberIdFormatItem(const std::string &str = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getFiberId();
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
+        os << event.getFiberId();
     }
 };
 
 class DateTimeFormatItem : public LogFormatter::FormatItem {
 public:
     DateTimeFormatItem(const std::string &format = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
-        struct tm tm;
-        std::string format = "%Y-%m-%d %H:%M:%S";
-        time_t time        = event->getTime();
-        localtime_r(&time, &tm);
-        char buf[64];
-        strftime(buf, sizeof(buf), format.c_str(), &tm);
-        os << buf;
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
+        //同一秒内的日志复用上一次的结果
+        static thread_local time_t t_time = -1;
+        static thread_local char t_buf[64];
+        static thread_local size_t t_len = 0;
+        time_t time                      = event.getTime();
+        if (time != t_time) {
+            struct tm tm;
+            localtime_r(&time, &tm);
+            t_len  = strftime(t_buf, sizeof(t_buf), "%Y-%m-%d %H:%M:%S", &tm);
+            t_time = time;
+        }
+        os.append(t_buf, t_len);
     }
 };
 
 class FilenameFormatItem : public LogFormatter::FormatItem {
 public:
     FilenameFormatItem(const std::string &str = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getFile();
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
+        os << event.getFile();
     }
 };
 
 class LineFormatItem : public LogFormatter::FormatItem {
 public:
     LineFormatItem(const std::string &str = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getLine();
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
+        os << event.getLine();
     }
 };
 
 class NewLineFormatItem : public LogFormatter::FormatItem {
 public:
     NewLineFormatItem(const std::string &str = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
-        os << std::endl;
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
+        os << '\n';
     }
 };
 
@@ -189,8 +454,8 @@ public:
     StringFormatItem(const std::string &str)
         : m_string(str) {}
 
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
         os << m_string;
     }
 
@@ -201,9 +466,9 @@ private:
 class TabFormatItem : public LogFormatter::FormatItem {
 public:
     TabFormatItem(const std::string &str = "") {}
-    void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                LogLevel::Level level, LogEvent::ptr event) override {
-        os << "\t";
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event) override {
+        os << '\t';
     }
 };
 
@@ -278,19 +543,18 @@ LogFormatter::ptr LogAppender::getFormatter() {
     return m_formatter;
 }
 
-std::string LogFormatter::format(std::shared_ptr<Logger> logger,
-                                 LogLevel::Level level, LogEvent::ptr event) {
-    std::stringstream ss;
+void LogFormatter::format(LogStream &os, Logger *logger, LogLevel::Level level,
+                          const LogEvent &event) {
     for (auto &i : m_items) {
-        i->format(ss, logger, level, event);
+        i->format(os, logger, level, event);
     }
-    return ss.str();
 }
 
-void StdoutLogAppender::log(Logger::ptr logger, LogLevel::Level level,
-                            LogEvent::ptr event) {
+void StdoutLogAppender::log(Logger *logger, LogLevel::Level level,
+                            LogEvent &event) {
     if (level >= LogAppender::m_level) {
-        std::cout << LogAppender::m_formatter->format(logger, level, event);
+        const LogStream &str = event.getFormatted(m_formatter.get());
+        std::cout.write(str.data(), str.size());
     }
 }
 
@@ -323,8 +587,8 @@ FileLogAppender::FileLogAppender(const std::string &filename)
     reopen();
 }
 
-void FileLogAppender::log(Logger::ptr logger, LogLevel::Level level,
-                          LogEvent::ptr event) {
+void FileLogAppender::log(Logger *logger, LogLevel::Level level,
+                          LogEvent &event) {
 
     if (level >= LogAppender::m_level) {
         uint64_t now = time(0);
@@ -333,8 +597,9 @@ void FileLogAppender::log(Logger::ptr logger, LogLevel::Level level,
             reopen();
             m_lastTime = now;
         }
+        const LogStream &str = event.getFormatted(m_formatter.get());
         MutexType::Lock lock(m_mutex);
-        m_filestream << LogAppender::m_formatter->format(logger, level, event);
+        m_filestream.write(str.data(), str.size());
     }
 }
 
@@ -354,6 +619,289 @@ std::string FileLogAppender::toYamlString() {
     return ss.str();
 }
 
+/* 单生产者单消费者的环形缓冲区，生产者是所属线程，消费者是持有m_writeMutex的线程
+ * head和tail只增不减，下标为对容量取模
+ */
+struct AsyncFileLogAppender::Ring {
+    Ring(uint64_t _id, uint32_t size)
+        : id(_id)
+        , buf(new char[size]) {}
+
+    uint64_t id;                     //所属appender
+    std::unique_ptr<char[]> buf;     //容量为m_bufferSize
+    std::atomic<bool> closed{false}; //所属线程已退出或appender已析构
+    char pad0[64];
+    std::atomic<uint64_t> head{0}; //生产者写入位置
+    char pad1[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> tail{0}; //消费者读取位置
+};
+
+static std::atomic<uint64_t> s_async_appender_id{0};
+
+const char *AsyncFileLogAppender::PolicyToString(OverflowPolicy policy) {
+    switch (policy) {
+    case DROP:
+        return "drop";
+    case DROP_DEBUG:
+        return "drop_debug";
+    default:
+        return "block";
+    }
+}
+
+AsyncFileLogAppender::OverflowPolicy
+AsyncFileLogAppender::PolicyFromString(const std::string &str) {
+    if (str == "drop") {
+        return DROP;
+    }
+    if (str == "drop_debug") {
+        return DROP_DEBUG;
+    }
+    return BLOCK;
+}
+
+AsyncFileLogAppender::AsyncFileLogAppender(const std::string &filename,
+                                           OverflowPolicy policy,
+                                           uint32_t buffer_size,
+                                           uint32_t flush_interval)
+    : m_filename(filename)
+    , m_policy(policy)
+    , m_bufferSize(4096)
+    , m_flushInterval(flush_interval)
+    , m_id(++s_async_appender_id) {
+    while (m_bufferSize < buffer_size) {
+        m_bufferSize <<= 1;
+    }
+    for (auto &i : m_dropped) {
+        i = 0;
+    }
+    reopen();
+    m_lastTime = time(0);
+    m_eventFd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_thread.reset(new Thread(std::bind(&AsyncFileLogAppender::run, this),
+                              "async_log"));
+}
+
+AsyncFileLogAppender::~AsyncFileLogAppender() {
+    m_stopping = true;
+    eventfd_write(m_eventFd, 1);
+    m_thread->join();
+    {
+        Mutex::Lock lock(m_writeMutex);
+        drain();
+    }
+    //线程中缓存的缓冲区在下一次查找时清除
+    for (auto &i : m_rings) {
+        i->closed = true;
+    }
+    close(m_eventFd);
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+AsyncFileLogAppender::Ring *AsyncFileLogAppender::getRing() {
+    static thread_local std::vector<std::shared_ptr<Ring>> t_rings;
+    /* 查找的同时清除已析构的appender的缓冲区，避免配置重新加载后旧的缓冲区一直留在
+     * 线程中，线程中同时使用的异步appender很少，遍历的开销可以忽略
+     */
+    Ring *found = nullptr;
+    for (size_t i = 0; i < t_rings.size();) {
+        if (t_rings[i]->closed) {
+            t_rings[i] = t_rings.back();
+            t_rings.pop_back();
+            continue;
+        }
+        if (t_rings[i]->id == m_id) {
+            found = t_rings[i].get();
+        }
+        ++i;
+    }
+    if (found) {
+        return found;
+    }
+
+    //线程退出时标记缓冲区，刷新线程取出剩余数据后删除
+    struct Closer {
+        ~Closer() {
+            for (auto &i : t_rings) {
+                i->closed = true;
+            }
+        }
+    };
+    static thread_local Closer t_closer;
+    (void)t_closer;
+
+    std::shared_ptr<Ring> ring(new Ring(m_id, m_bufferSize));
+    t_rings.push_back(ring);
+    Mutex::Lock lock(m_ringMutex);
+    m_rings.push_back(ring);
+    return ring.get();
+}
+
+void AsyncFileLogAppender::log(Logger *logger, LogLevel::Level level,
+                               LogEvent &event) {
+    if (level < LogAppender::m_level) {
+        return;
+    }
+    const LogStream &str = event.getFormatted(m_formatter.get());
+    uint64_t len         = str.size();
+    if (len > m_bufferSize) {
+        //超过缓冲区大小的日志直接写入
+        Mutex::Lock lock(m_writeMutex);
+        drain();
+        write(str.data(), len);
+        return;
+    }
+
+    Ring *ring    = getRing();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t used = head - ring->tail.load(std::memory_order_acquire);
+    uint64_t limit = m_bufferSize;
+    if (m_policy == DROP_DEBUG && level <= LogLevel::DEBUG) {
+        limit = m_bufferSize / 4 * 3;
+    }
+    if (used + len > limit) {
+        if (m_policy == DROP || limit < m_bufferSize) {
+            ++m_dropped[level];
+            notify();
+            return;
+        }
+        /* 不等待刷新线程，由当前线程取出所有缓冲区的数据后直接写入，本线程之前的日志先
+         * 写出，顺序不变。当前线程持有Logger的读锁，等待的时间只有一次写入，不会使修改
+         * Logger的线程长时间拿不到写锁
+         */
+        Mutex::Lock lock(m_writeMutex);
+        drain();
+        write(str.data(), len);
+        return;
+    }
+
+    size_t pos   = head & (m_bufferSize - 1);
+    size_t first = std::min<size_t>(len, m_bufferSize - pos);
+    memcpy(&ring->buf[pos], str.data(), first);
+    memcpy(&ring->buf[0], str.data() + first, len - first);
+    ring->head.store(head + len, std::memory_order_release);
+
+    if (used + len >= m_bufferSize / 2) {
+        notify();
+    }
+}
+
+void AsyncFileLogAppender::notify() {
+    //已有未处理的唤醒时不再写eventfd
+    if (!m_notified.exchange(true)) {
+        eventfd_write(m_eventFd, 1);
+    }
+}
+
+void AsyncFileLogAppender::run() {
+    struct pollfd pfd;
+    pfd.fd     = m_eventFd;
+    pfd.events = POLLIN;
+    while (!m_stopping) {
+        poll(&pfd, 1, m_flushInterval);
+        eventfd_t value;
+        eventfd_read(m_eventFd, &value);
+        m_notified = false;
+
+        Mutex::Lock lock(m_writeMutex);
+        uint64_t now = time(0);
+        //每一秒重新打开一次文件，保证在日志文件被删除的情况下可以重新创建文件
+        if (now != m_lastTime) {
+            reopen();
+            m_lastTime = now;
+        }
+        drain();
+    }
+}
+
+void AsyncFileLogAppender::drain() {
+    m_batch.clear();
+    {
+        Mutex::Lock lock(m_ringMutex);
+        for (auto it = m_rings.begin(); it != m_rings.end();) {
+            Ring *ring = it->get();
+            //先读closed，之后的head包含线程退出前写入的全部数据
+            bool closed   = ring->closed;
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            if (head != tail) {
+                size_t pos   = tail & (m_bufferSize - 1);
+                size_t len   = head - tail;
+                size_t first = std::min<size_t>(len, m_bufferSize - pos);
+                m_batch.append(&ring->buf[pos], first);
+                m_batch.append(&ring->buf[0], len - first);
+                ring->tail.store(head, std::memory_order_release);
+            }
+            if (closed) {
+                it = m_rings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    write(m_batch.c_str(), m_batch.size());
+}
+
+void AsyncFileLogAppender::write(const char *data, size_t len) {
+    while (len > 0 && m_fd >= 0) {
+        ssize_t rt = ::write(m_fd, data, len);
+        if (rt < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cout << "AsyncFileLogAppender write file=" << m_filename
+                      << " fail, errno=" << errno << " errstr=" << strerror(errno)
+                      << std::endl;
+            return;
+        }
+        data += rt;
+        len -= rt;
+    }
+}
+
+bool AsyncFileLogAppender::reopen() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+    m_fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                0644);
+    return m_fd >= 0;
+}
+
+void AsyncFileLogAppender::flush() {
+    Mutex::Lock lock(m_writeMutex);
+    drain();
+}
+
+uint64_t AsyncFileLogAppender::getDropped() const {
+    uint64_t dropped = 0;
+    for (auto &i : m_dropped) {
+        dropped += i;
+    }
+    return dropped;
+}
+
+std::string AsyncFileLogAppender::toYamlString() {
+    MutexType::Lock lock(m_mutex);
+    YAML::Node node;
+    node["type"]           = "AsyncFileLogAppender";
+    node["file"]           = m_filename;
+    node["overflow"]       = PolicyToString(m_policy);
+    node["buffer_size"]    = m_bufferSize;
+    node["flush_interval"] = m_flushInterval;
+    if (m_level != LogLevel::UNKNOWN) {
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    if (m_formatter) {
+        node["formatter"] = m_formatter->getPattern();
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
 Logger::Logger(const std::string &name)
     : m_name(name)
     , m_level(LogLevel::DEBUG) {
@@ -363,13 +911,13 @@ Logger::Logger(const std::string &name)
 }
 
 // 某个logger没有appender时，使用root logger进行输出 ？？
-void Logger::log(LogLevel::Level level, LogEvent::ptr event) {
+void Logger::log(LogLevel::Level level, LogEvent &event) {
     if (level > m_level) {
-        MutexType::Lock lock(m_mutex);
-        auto self = shared_from_this();
+        //只读取appender列表，各appender自己加锁，不同线程可以同时格式化和输出
+        MutexType::ReadLock lock(m_mutex);
         if (!m_appenders.empty()) {
             for (auto &i : m_appenders) {
-                i->log(self, level, event);
+                i->log(this, level, event);
             }
         } else if (m_root) {
             m_root->log(level, event);
@@ -377,18 +925,18 @@ void Logger::log(LogLevel::Level level, LogEvent::ptr event) {
     }
 }
 
-void Logger::debug(sylar::LogEvent::ptr event) { log(LogLevel::DEBUG, event); }
+void Logger::debug(sylar::LogEvent &event) { log(LogLevel::DEBUG, event); }
 
-void Logger::info(sylar::LogEvent::ptr event) { log(LogLevel::INFO, event); }
+void Logger::info(sylar::LogEvent &event) { log(LogLevel::INFO, event); }
 
-void Logger::warn(sylar::LogEvent::ptr event) { log(LogLevel::WARN, event); }
+void Logger::warn(sylar::LogEvent &event) { log(LogLevel::WARN, event); }
 
-void Logger::error(sylar::LogEvent::ptr event) { log(LogLevel::ERROR, event); }
+void Logger::error(sylar::LogEvent &event) { log(LogLevel::ERROR, event); }
 
-void Logger::fatal(sylar::LogEvent::ptr event) { log(LogLevel::FATAL, event); }
+void Logger::fatal(sylar::LogEvent &event) { log(LogLevel::FATAL, event); }
 
 void Logger::addAppender(sylar::LogAppender::ptr appender) {
-    MutexType::Lock lock(m_mutex);
+    MutexType::WriteLock lock(m_mutex);
     if (!appender->getFormatter()) {
         appender->setFormater(m_formatter);
     }
@@ -396,7 +944,7 @@ void Logger::addAppender(sylar::LogAppender::ptr appender) {
 }
 
 void Logger::delAppender(sylar::LogAppender::ptr appender) {
-    MutexType::Lock lock(m_mutex);
+    MutexType::WriteLock lock(m_mutex);
     for (auto it = m_appenders.begin(); it != m_appenders.end(); ++it) {
         if (*it == appender) {
             m_appenders.erase(it);
@@ -405,16 +953,16 @@ void Logger::delAppender(sylar::LogAppender::ptr appender) {
 }
 
 void Logger::clearAppenders() {
-    MutexType::Lock lock(m_mutex);
+    MutexType::WriteLock lock(m_mutex);
     m_appenders.clear();
 }
 
 void Logger::setFormatter(LogFormatter::ptr val) {
-    MutexType::Lock lock(m_mutex);
+    MutexType::WriteLock lock(m_mutex);
 
     m_formatter = val;
     for (auto &i : m_appenders) {
-        MutexType::Lock ll(i->m_mutex);
+        LogAppender::MutexType::Lock ll(i->m_mutex);
         if (!i->m_hasFormatter) {
             i->m_formatter = m_formatter;
         }
@@ -432,12 +980,12 @@ void Logger::setFormatter(const std::string &val) {
 }
 
 LogFormatter::ptr Logger::getFormatter() {
-    MutexType::Lock lock(m_mutex);
+    MutexType::ReadLock lock(m_mutex);
     return m_formatter;
 }
 
 std::string Logger::toYamlString() {
-    MutexType::Lock lock(m_mutex);
+    MutexType::ReadLock lock(m_mutex);
     YAML::Node node;
     node["name"] = m_name;
     if (m_level != LogLevel::UNKNOWN) {
@@ -481,14 +1029,20 @@ std::string LoggerManager::toYamlString() {
 }
 
 struct LogAppenderDefine {
-    int type              = 0; // 1:File, 2:Stdout
+    int type              = 0; // 1:File, 2:Stdout, 3:AsyncFile
     LogLevel::Level level = LogLevel::UNKNOWN;
     std::string formatter;
     std::string file;
+    //以下只用于AsyncFile
+    std::string overflow    = "block";
+    uint32_t buffer_size    = 256 * 1024;
+    uint32_t flush_interval = 100;
 
     bool operator==(const LogAppenderDefine &oth) const {
         return type == oth.type && level == oth.level &&
-               formatter == oth.formatter && file == oth.formatter;
+               formatter == oth.formatter && file == oth.file &&
+               overflow == oth.overflow && buffer_size == oth.buffer_size &&
+               flush_interval == oth.flush_interval;
     }
 };
 
@@ -552,6 +1106,28 @@ public:
                         if (a["formatter"].IsDefined()) {
                             lad.formatter = a["formatter"].as<std::string>();
                         }
+                    } else if (type == "AsyncFileLogAppender") {
+                        lad.type = 3;
+                        if (!a["file"].IsDefined()) {
+                            std::cout << "log config error: asyncfileappender "
+                                         "file is null, "
+                                      << a << std::endl;
+                            continue;
+                        }
+                        lad.file = a["file"].as<std::string>();
+                        if (a["formatter"].IsDefined()) {
+                            lad.formatter = a["formatter"].as<std::string>();
+                        }
+                        if (a["overflow"].IsDefined()) {
+                            lad.overflow = a["overflow"].as<std::string>();
+                        }
+                        if (a["buffer_size"].IsDefined()) {
+                            lad.buffer_size = a["buffer_size"].as<uint32_t>();
+                        }
+                        if (a["flush_interval"].IsDefined()) {
+                            lad.flush_interval =
+                                a["flush_interval"].as<uint32_t>();
+                        }
                     } else if (type == "StdoutLogAppender") {
                         lad.type = 2;
                     } else {
@@ -591,6 +1167,12 @@ public:
                     na["file"] = a.file;
                 } else if (a.type == 2) {
                     na["type"] = "StdoutLogAppender";
+                } else if (a.type == 3) {
+                    na["type"]           = "AsyncFileLogAppender";
+                    na["file"]           = a.file;
+                    na["overflow"]       = a.overflow;
+                    na["buffer_size"]    = a.buffer_size;
+                    na["flush_interval"] = a.flush_interval;
                 }
                 if (a.level != LogLevel::UNKNOWN) {
                     na["level"] = LogLevel::ToString(a.level);
@@ -645,6 +1227,11 @@ struct LogIniter {
                         ap.reset(new FileLogAppender(a.file));
                     } else if (a.type == 2) {
                         ap.reset(new StdoutLogAppender);
+                    } else if (a.type == 3) {
+                        ap.reset(new AsyncFileLogAppender(
+                            a.file,
+                            AsyncFileLogAppender::PolicyFromString(a.overflow),
+                            a.buffer_size, a.flush_interval));
                     }
 
                     ap->setLevel(a.level);
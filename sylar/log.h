@@ -15,12 +15,11 @@
 #include <string>
 #include <vector>
 
+/* 日志事件是栈上的临时对象，在语句结束时析构并输出 */
 #define SYLAR_LOG_LEVEL(logger, level)                                         \
     if (logger->getLevel() <= level)                                           \
-    sylar::LogEventWrap(                                                       \
-        sylar::LogEvent::ptr(new sylar::LogEvent(                              \
-            logger, level, __FILE__, __LINE__, 0, sylar::GetThreadId(),        \
-            sylar::GetFiberId(), time(0))))                                    \
+    sylar::LogEventWrap(logger, level, __FILE__, __LINE__, 0,                  \
+                        sylar::GetThreadId(), sylar::GetFiberId(), time(0))    \
         .getSS()
 
 #define SYLAR_LOG_DEBUG(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::DEBUG)
@@ -50,14 +49,100 @@ public:
     static LogLevel::Level FromString(const std::string &str);
 };
 
+class LogFormatter;
+
+/* 日志内容缓冲区，内容不超过INLINE_SIZE时只使用内置的缓冲区，超过时改用堆内存
+ * 整数、浮点数、字符和字符串直接写入，其他类型通过线程共享的std::ostream调用operator<<
+ * std::hex等格式控制符只对同一条日志之后的内容生效，每条日志保存自己的格式，在
+ * operator<<中嵌套写日志时不会互相影响
+ */
+class LogStream {
+public:
+    static const size_t INLINE_SIZE = 1024;
+
+    LogStream();
+    ~LogStream();
+
+    LogStream &operator<<(bool v);
+    LogStream &operator<<(char v) {
+        append(&v, 1);
+        return *this;
+    }
+    LogStream &operator<<(signed char v) { return *this << (char)v; }
+    LogStream &operator<<(unsigned char v) { return *this << (char)v; }
+    LogStream &operator<<(short v) { return *this << (long long)v; }
+    LogStream &operator<<(unsigned short v) {
+        return *this << (unsigned long long)v;
+    }
+    LogStream &operator<<(int v) { return *this << (long long)v; }
+    LogStream &operator<<(unsigned int v) {
+        return *this << (unsigned long long)v;
+    }
+    LogStream &operator<<(long v) { return *this << (long long)v; }
+    LogStream &operator<<(unsigned long v) {
+        return *this << (unsigned long long)v;
+    }
+    LogStream &operator<<(long long v);
+    LogStream &operator<<(unsigned long long v);
+    LogStream &operator<<(float v) { return *this << (double)v; }
+    LogStream &operator<<(double v);
+    LogStream &operator<<(const char *v);
+    LogStream &operator<<(char *v) { return *this << (const char *)v; }
+    LogStream &operator<<(const std::string &v) {
+        append(v.c_str(), v.size());
+        return *this;
+    }
+    /* std::endl、std::hex等控制符 */
+    LogStream &operator<<(std::ostream &(*pf)(std::ostream &));
+    LogStream &operator<<(std::ios_base &(*pf)(std::ios_base &));
+    /* 其他类型使用std::ostream的operator<< */
+    template <class T> LogStream &operator<<(const T &v) {
+        std::ostream &os = beginOstream();
+        os << v;
+        endOstream();
+        return *this;
+    }
+
+    void append(const char *data, size_t len);
+    /* 按printf格式写入 */
+    void format(const char *fmt, va_list al);
+    void clear() { m_size = 0; }
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    LogStream(const LogStream &) = delete;
+    LogStream &operator=(const LogStream &) = delete;
+
+    /* 保证还有len字节的空间 */
+    void reserve(size_t len);
+    /* 获取输出到当前对象的线程共享std::ostream，并设置为当前对象的格式 */
+    std::ostream &beginOstream();
+    /* 保存当前对象的格式，恢复之前输出对象的格式 */
+    void endOstream();
+    void saveFormat(const std::ostream &os);
+    void loadFormat(std::ostream &os) const;
+
+private:
+    char *m_data;            //指向m_inline或堆内存
+    size_t m_size;           //内容长度
+    size_t m_capacity;       //m_data的大小
+    bool m_fmtChanged;       //使用过格式控制符，数值也通过std::ostream输出
+    LogStream *m_prevTarget; //嵌套使用std::ostream时之前的输出对象
+    /* 使用std::ostream时的格式 */
+    std::ios_base::fmtflags m_flags;
+    std::streamsize m_precision;
+    std::streamsize m_width;
+    char m_fill;
+    char m_inline[INLINE_SIZE];
+};
+
 //日志事件
 class LogEvent {
 public:
-    typedef std::shared_ptr<LogEvent> ptr; //定义智能指针类型
-
-    LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level,
-             const char *file, int32_t line, uint32_t elapse,
-             uint32_t thread_id, uint32_t fiber_id, uint64_t time);
+    LogEvent(Logger *logger, LogLevel::Level level, const char *file,
+             int32_t line, uint32_t elapse, uint32_t thread_id,
+             uint32_t fiber_id, uint64_t time);
 
     const char *getFile() const { return m_file; }
     int32_t getLine() const { return m_line; }
@@ -65,13 +150,20 @@ public:
     uint32_t getThreadId() const { return m_threadId; }
     uint32_t getFiberId() const { return m_fiberId; }
     uint64_t getTime() const { return m_time; }
-    std::string getContent() const { return m_ss.str(); }
-    std::shared_ptr<Logger> getLogger() const { return m_logger; }
+    const LogStream &getContent() const { return m_ss; }
+    Logger *getLogger() const { return m_logger; }
     LogLevel::Level getLevel() const { return m_level; }
-    std::stringstream &getSS() { return m_ss; }
+    LogStream &getSS() { return m_ss; }
     void format(const char *fmt, ...);
     void format(const char *fmt, va_list al);
 
+    /* 按formatter格式化后的日志，使用同一formatter的多个appender只格式化一次 */
+    const LogStream &getFormatted(LogFormatter *formatter);
+
+private:
+    LogEvent(const LogEvent &) = delete;
+    LogEvent &operator=(const LogEvent &) = delete;
+
 private:
     const char *m_file  = nullptr; //文件名
     int32_t m_line      = 0;       //行号
@@ -79,22 +171,26 @@ private:
     uint32_t m_threadId = 0;       //线程id
     uint32_t m_fiberId  = 0;       //协程id
     uint64_t m_time     = 0;       //时间戳
-    std::stringstream m_ss;        //日志内容
+    LogStream m_ss;                //日志内容
 
-    std::shared_ptr<Logger> m_logger;
+    Logger *m_logger; //在日志语句结束前一直有效
     LogLevel::Level m_level;
+    LogFormatter *m_formattedBy = nullptr; // m_formatted使用的formatter
+    LogStream m_formatted;                 //格式化后的日志
 };
 
 class LogEventWrap {
 public:
-    LogEventWrap(LogEvent::ptr e);
+    LogEventWrap(const std::shared_ptr<Logger> &logger, LogLevel::Level level,
+                 const char *file, int32_t line, uint32_t elapse,
+                 uint32_t thread_id, uint32_t fiber_id, uint64_t time);
     ~LogEventWrap();
 
-    LogEvent::ptr getEvent() const { return m_event; }
-    std::stringstream &getSS() { return m_event->getSS(); }
+    LogEvent *getEvent() { return &m_event; }
+    LogStream &getSS() { return m_event.getSS(); }
 
 private:
-    LogEvent::ptr m_event;
+    LogEvent m_event;
 };
 
 //日志格式器
@@ -102,8 +198,8 @@ class LogFormatter {
 public:
     typedef std::shared_ptr<LogFormatter> ptr;
     LogFormatter(const std::string &pattern);
-    std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level,
-                       LogEvent::ptr);
+    void format(LogStream &os, Logger *logger, LogLevel::Level level,
+                const LogEvent &event);
     void init();
     bool isError() const { return m_error; }
     const std::string getPattern() const { return m_pattern; }
@@ -115,8 +211,8 @@ public:
         virtual ~FormatItem() {}
 
         // format方法由子类实现
-        virtual void format(std::ostream &os, std::shared_ptr<Logger> logger,
-                            LogLevel::Level level, LogEvent::ptr event) = 0;
+        virtual void format(LogStream &os, Logger *logger,
+                            LogLevel::Level level, const LogEvent &event) = 0;
     };
 
 private:
@@ -134,9 +230,9 @@ public:
     typedef Spinlock MutexType;
     virtual ~LogAppender() {}
 
-    virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level,
-                     LogEvent::ptr event) = 0;
-    virtual std::string toYamlString()    = 0;
+    virtual void log(Logger *logger, LogLevel::Level level,
+                     LogEvent &event)  = 0;
+    virtual std::string toYamlString() = 0;
 
     void setFormater(LogFormatter::ptr val);
     LogFormatter::ptr getFormatter();
@@ -154,8 +250,7 @@ protected: //继承的子类需要访问这些成员，只能声明成protected
 class StdoutLogAppender : public LogAppender {
 public:
     typedef std::shared_ptr<StdoutLogAppender> ptr;
-    void log(std::shared_ptr<Logger> logger, LogLevel::Level level,
-             LogEvent::ptr event) override;
+    void log(Logger *logger, LogLevel::Level level, LogEvent &event) override;
     std::string toYamlString() override;
 };
 
@@ -164,8 +259,7 @@ class FileLogAppender : public LogAppender {
 public:
     typedef std::shared_ptr<FileLogAppender> ptr;
     FileLogAppender(const std::string &filename);
-    void log(std::shared_ptr<Logger> logger, LogLevel::Level level,
-             LogEvent::ptr event) override;
+    void log(Logger *logger, LogLevel::Level level, LogEvent &event) override;
     bool reopen();
     std::string toYamlString() override;
 
@@ -175,6 +269,81 @@ private:
     uint64_t m_lastTime = 0;
 };
 
+/* 异步输出到文件的Appender
+ * 每个写日志的线程有自己的环形缓冲区，log()格式化后拷贝到当前线程的缓冲区即返回，
+ * 单独的刷新线程定期(或缓冲区超过一半时被唤醒)把所有缓冲区的数据合并成一次write
+ * 同一线程的日志保持顺序，不同线程之间的日志不保证按时间顺序
+ */
+class AsyncFileLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<AsyncFileLogAppender> ptr;
+
+    //缓冲区满时的处理方式
+    enum OverflowPolicy {
+        BLOCK      = 0, //由当前线程直接写入
+        DROP       = 1, //丢弃
+        DROP_DEBUG = 2, //缓冲区使用超过3/4时丢弃DEBUG日志，其他级别满时直接写入
+    };
+    static const char *PolicyToString(OverflowPolicy policy);
+    /* 不能识别时返回BLOCK */
+    static OverflowPolicy PolicyFromString(const std::string &str);
+
+    /* buffer_size: 每个线程的缓冲区大小，向上取整为2的幂
+     * flush_interval: 刷新线程没有被唤醒时写出的间隔，单位ms
+     */
+    AsyncFileLogAppender(const std::string &filename,
+                         OverflowPolicy policy   = BLOCK,
+                         uint32_t buffer_size    = 256 * 1024,
+                         uint32_t flush_interval = 100);
+    ~AsyncFileLogAppender();
+
+    void log(Logger *logger, LogLevel::Level level, LogEvent &event) override;
+    std::string toYamlString() override;
+
+    /* 写出调用前所有线程已提交的日志 */
+    void flush();
+    /* 因缓冲区满丢弃的日志数 */
+    uint64_t getDropped() const;
+    uint64_t getDropped(LogLevel::Level level) const {
+        return m_dropped[level];
+    }
+    OverflowPolicy getPolicy() const { return m_policy; }
+
+private:
+    struct Ring;
+
+    /* 获取当前线程的缓冲区，第一次调用时创建 */
+    Ring *getRing();
+    /* 唤醒刷新线程 */
+    void notify();
+    /* 刷新线程 */
+    void run();
+    /* 取出所有缓冲区的数据写入文件，需持有m_writeMutex */
+    void drain();
+    void write(const char *data, size_t len);
+    bool reopen();
+
+private:
+    std::string m_filename;
+    OverflowPolicy m_policy;
+    uint32_t m_bufferSize;
+    uint32_t m_flushInterval;
+    uint64_t m_id; //区分appender，线程按id查找自己的缓冲区
+
+    Mutex m_ringMutex;                          //保护m_rings
+    std::vector<std::shared_ptr<Ring>> m_rings; //所有线程的缓冲区
+    Mutex m_writeMutex;                         //同一时间只有一个线程取出数据
+    std::string m_batch;                        //合并后一次写入的数据
+    int m_fd            = -1;
+    uint64_t m_lastTime = 0;
+
+    int m_eventFd;                       //唤醒刷新线程
+    std::atomic<bool> m_notified{false}; //已唤醒但刷新线程还未处理
+    std::atomic<bool> m_stopping{false};
+    std::atomic<uint64_t> m_dropped[LogLevel::FATAL + 1]; //各级别丢弃的日志数
+    Thread::ptr m_thread;
+};
+
 // Logger类继承至enable_shared_from_this以便于获取自身的智能指针
 class Logger : public std::enable_shared_from_this<Logger> {
     // LoggerManager在创建Logger对象时会修改Logger的私有成员，故增加友元类的声明
@@ -182,16 +351,16 @@ class Logger : public std::enable_shared_from_this<Logger> {
 
 public:
     typedef std::shared_ptr<Logger> ptr;
-    typedef Spinlock MutexType;
+    typedef RWMutex MutexType;
 
     Logger(const std::string &name = "root");
-    void log(LogLevel::Level level, LogEvent::ptr event);
+    void log(LogLevel::Level level, LogEvent &event);
 
-    void debug(LogEvent::ptr event);
-    void info(LogEvent::ptr event);
-    void warn(LogEvent::ptr event);
-    void error(LogEvent::ptr event);
-    void fatal(LogEvent::ptr event);
+    void debug(LogEvent &event);
+    void info(LogEvent &event);
+    void warn(LogEvent &event);
+    void error(LogEvent &event);
+    void fatal(LogEvent &event);
 
     void addAppender(LogAppender::ptr appender);
     void delAppender(LogAppender::ptr appender);
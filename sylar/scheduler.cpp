@@ -1,35 +1,132 @@
 #include "scheduler.h"
+#include "config.h"
 #include "hook_sys_call.h"
 #include "macro.h"
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h> /* Obtain O_* constant definitions */
+#include <sched.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
+#include <vector>
 
 namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+//调度线程数，可通过配置文件获取，默认1个线程
+static ConfigVar<uint32_t>::ptr g_scheduler_threads =
+    ConfigManager::LookUp<uint32_t>("scheduler.threads", 1,
+                                    "scheduler thread count");
+
+//是否启用调度线程本地队列及任务窃取，关闭时所有任务都放入全局队列
+static ConfigVar<bool>::ptr g_scheduler_work_stealing =
+    ConfigManager::LookUp<bool>("scheduler.work_stealing", true,
+                                "scheduler work stealing");
+
+//idle协程一次epoll_wait最多返回的事件数
+static ConfigVar<uint32_t>::ptr g_scheduler_epoll_batch =
+    ConfigManager::LookUp<uint32_t>("scheduler.epoll_batch", 256,
+                                    "scheduler epoll_wait batch size");
+
+//调度线程本地队列的容量，本地队列满时任务放入全局队列
+static const size_t LOCAL_QUEUE_CAPACITY = 1024;
+
+//每从本地队列调度这么多次任务，优先检查一次全局队列，避免全局队列中的任务饿死
+static const uint32_t GLOBAL_QUEUE_CHECK_INTERVAL = 32;
+
+/* 取不到任务但仍有任务时(任务正被窃取或协程还未完成切出)的自旋次数，每自旋
+ * POP_SPIN_YIELD_INTERVAL次让出一次CPU，使被等待的线程在核数不足时也能运行，超过次数后
+ * 进入idle协程最多等待POP_RETRY_TIMEOUT毫秒再重试
+ */
+static const uint32_t POP_SPIN_COUNT          = 64;
+static const uint32_t POP_SPIN_YIELD_INTERVAL = 16;
+static const int POP_RETRY_TIMEOUT            = 1;
+
 //当前线程的协程调度器
 static thread_local Scheduler *t_scheduler = nullptr;
+//当前调度线程的编号及本地任务队列
+static thread_local size_t t_workerIndex = 0;
+static thread_local WorkStealingQueue<ScheduleTask> *t_localQueue = nullptr;
+//当前调度线程的调度计数
+static thread_local uint32_t t_scheduleTick = 0;
+//自旋后仍取不到任务，idle协程不因有任务立即返回，等待一段时间
+static thread_local bool t_popRetry = false;
+
+/* 自旋等待时降低CPU占用，让出流水线资源给同一核心上的其他超线程 */
+static inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/* 本地队列中保存的是任务节点指针，节点由取出任务的线程回收到自己的缓存中，压入时优先
+ * 复用缓存中的节点，避免每次调度都分配内存。缓存最多保存一个本地队列容量的节点
+ */
+struct TaskNodeCache {
+    std::vector<ScheduleTask *> nodes;
 
-Scheduler::Scheduler(const std::string &name)
+    ~TaskNodeCache() {
+        for (auto i : nodes) {
+            delete i;
+        }
+    }
+};
+static thread_local TaskNodeCache t_taskNodes;
+
+static ScheduleTask *AllocTaskNode(const ScheduleTask &task) {
+    auto &nodes = t_taskNodes.nodes;
+    if (nodes.empty()) {
+        return new ScheduleTask(task);
+    }
+    ScheduleTask *node = nodes.back();
+    nodes.pop_back();
+    *node = task;
+    return node;
+}
+
+static void FreeTaskNode(ScheduleTask *node) {
+    auto &nodes = t_taskNodes.nodes;
+    if (nodes.size() >= LOCAL_QUEUE_CAPACITY) {
+        delete node;
+        return;
+    }
+    //释放节点持有的协程和回调对象
+    node->reset();
+    nodes.push_back(node);
+}
+
+Scheduler::Scheduler(const std::string &name, size_t threads)
     : m_name(name) {
+    m_threadCount = threads ? threads : getDefaultThreadCount();
+
+    m_workStealing = g_scheduler_work_stealing->getValue();
+    m_epollBatch   = g_scheduler_epoll_batch->getValue();
+    if (m_epollBatch == 0) {
+        m_epollBatch = 1;
+    }
+    if (m_workStealing) {
+        for (size_t i = 0; i < m_threadCount; ++i) {
+            m_localQueues.emplace_back(
+                new WorkStealingQueue<ScheduleTask>(LOCAL_QUEUE_CAPACITY));
+        }
+    }
+
     // g_logger->setLevel(LogLevel::UNKNOWN); //调试时打开
     m_epfd = epoll_create1(0);
     SYLAR_ASSERT(m_epfd > 0);
 
-    int rt = pipe(m_tickleFds);
-    SYLAR_ASSERT(rt == 0);
-
-    rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
-    SYLAR_ASSERT(rt == 0);
+    m_tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    SYLAR_ASSERT(m_tickleFd >= 0);
 
     epoll_event ev;
-    ev.data.fd = m_tickleFds[0]; //读句柄
+    ev.data.fd = m_tickleFd;
     ev.events  = EPOLLIN | EPOLLET;
 
-    rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &ev);
+    int rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFd, &ev);
     SYLAR_ASSERT(rt == 0);
 
     resizeFdContext(32);
@@ -44,85 +141,159 @@ Scheduler::~Scheduler() {
             delete m_fdContexts[i];
         }
     }
+
+    //强制停止时本地队列中可能还有任务，释放掉
+    for (auto &q : m_localQueues) {
+        while (ScheduleTask *ptask = q->steal()) {
+            delete ptask;
+        }
+    }
 }
 
 void Scheduler::start() {
     MutexType::Lock lock(m_mutex);
-    SYLAR_ASSERT(m_thread.get() == nullptr);
-    m_thread.reset(new Thread(std::bind(&Scheduler::run, this), m_name));
+    SYLAR_ASSERT(m_threads.empty());
+    m_threads.resize(m_threadCount);
+    for (size_t i = 0; i < m_threadCount; ++i) {
+        std::string name =
+            m_threadCount == 1 ? m_name : m_name + "_" + std::to_string(i);
+        m_threads[i].reset(
+            new Thread(std::bind(&Scheduler::run, this, i), name));
+    }
 }
 
 void Scheduler::stop(bool force) {
     m_stop = true;
     if (!force) {
-        tickle(); //唤醒idle协程
-        m_thread->join();
-        SYLAR_ASSERT(m_tasks.empty());
+        //唤醒idle协程，调度线程退出时会再tickle一次，依次唤醒其他调度线程
+        tickle();
+        for (auto &i : m_threads) {
+            i->join();
+        }
+        SYLAR_ASSERT(m_taskCount == 0);
     } else {
-        m_thread->cancel();
-        m_thread->join();
+        for (auto &i : m_threads) {
+            i->cancel();
+            i->join();
+        }
     }
     close(m_epfd);
-    close(m_tickleFds[0]);
-    close(m_tickleFds[1]);
+    close(m_tickleFd);
 }
 
 Scheduler *Scheduler::getThis() { return t_scheduler; }
 void Scheduler::setThis(Scheduler *psc) { t_scheduler = psc; }
 
+size_t Scheduler::getDefaultThreadCount() {
+    return std::max<size_t>(1, g_scheduler_threads->getValue());
+}
+
 void Scheduler::tickle() {
-    //往pipe写入一个数据，引起idle协程的epoll_wait唤醒，实现通知调度功能
-    int rt = write(m_tickleFds[1], "T", 1);
-    SYLAR_ASSERT(rt == 1);
+    /* 已有未处理的唤醒时不再写eventfd，被唤醒的调度线程会先读eventfd再清除标志，
+     * 之后回到run()调度任务，期间省略的tickle所对应的任务不会丢失
+     */
+    if (m_tickled.exchange(true)) {
+        return;
+    }
+    //往eventfd写入数据，引起idle协程的epoll_wait唤醒，实现通知调度功能
+    ++m_tickles;
+    int rt = eventfd_write(m_tickleFd, 1);
+    SYLAR_ASSERT(rt == 0);
 }
 
+/* idle协程在调度线程内常驻，每次处理完一批IO事件和定时器后yield回run()，下次无任务时
+ * 从yield处继续，不需要每次重新创建协程和事件数组，满足停止条件时才结束
+ */
 void Scheduler::idle() {
-    // bug fixed: idle还没来得及运行，上层就添加了任务时，这里会出错
-    // SYLAR_ASSERT(m_tasks.empty());
     SYLAR_LOG_DEBUG(g_logger) << "idle begin";
-    m_idle = true;
-
-    /* idle协程阻塞在管道epoll_wait上，唤醒函数是tickle(),时机是添加新任务及停止调度
-     */
-    epoll_event *events = new epoll_event[64]();
-    std::shared_ptr<epoll_event> events_deallocator(
-        events, [](epoll_event *ptr) { delete[] ptr; });
+    std::vector<epoll_event> events(m_epollBatch);
+    std::vector<ScheduleTask> expired;
+
+    while (!stopping()) {
+        ++m_idleThreads;
+        bool retry = t_popRetry;
+        t_popRetry = false;
+
+        /* 标记idle之后再检查一次任务队列，避免在进入idle前添加的任务得不到调度。run()
+         * 自旋后仍取不到任务时不立即返回，在epoll_wait上短暂等待
+         */
+        if (m_taskCount > 0 && !retry) {
+            --m_idleThreads;
+            Fiber::GetThis()->yield();
+            continue;
+        }
 
-    while (true) {
-        int rt = epoll_wait(m_epfd, events, 64, -1);
-        if (rt < 0) {
-            if (errno == EINTR) {
-                continue;
-            } else {
+        /* idle协程阻塞在管道epoll_wait上，唤醒函数是tickle(),时机是添加新任务及停止
+         * 调度，epoll_wait的超时时间由最近的定时器决定
+         */
+        int rt = 0;
+        while (true) {
+            uint64_t next_timeout = m_timers.getNextTimeout();
+            int timeout = next_timeout == ~0ull ? -1 : (int)next_timeout;
+            if (retry && (timeout < 0 || timeout > POP_RETRY_TIMEOUT)) {
+                timeout = POP_RETRY_TIMEOUT;
+            }
+            ++m_epollWaits;
+            rt = epoll_wait(m_epfd, &events[0], events.size(), timeout);
+            if (rt < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
                 SYLAR_LOG_ERROR(g_logger)
                     << "epoll_wait error:" << strerror(errno);
+                rt = 0;
                 break;
             }
-        }
 
-        SYLAR_LOG_DEBUG(g_logger) << "epoll_wait return,rt=" << rt;
+            SYLAR_LOG_DEBUG(g_logger) << "epoll_wait return,rt=" << rt;
+
+            /* 推进时间轮，调度所有超时的定时器任务。idle协程之后会回到run()，
+             * 这里及下面的IO事件都只入队不tickle
+             */
+            expired.clear();
+            m_timers.listExpired(expired);
+            for (auto &i : expired) {
+                pushTask(i);
+            }
+            if (rt == 0 && expired.empty() && !retry) {
+                //时间轮只是完成了下降，没有定时器超时，继续等待
+                continue;
+            }
+            break;
+        }
 
         for (int i = 0; i < rt; ++i) {
-            /* pipe有数据，说明有任务需要调度 */
-            if (events[i].data.fd == m_tickleFds[0]) {
-                /* 清空pipe，一次将pipe内的所有内容读完，即有可能多次tickle()被一次
-                 * 消耗掉
-                 */
-                uint8_t dummy[256];
-                while (read(m_tickleFds[0], dummy, sizeof(dummy)) > 0)
-                    ;
+            /* eventfd有数据，说明有任务需要调度，读取即清零，先读再清除标志 */
+            if (events[i].data.fd == m_tickleFd) {
+                eventfd_t value;
+                eventfd_read(m_tickleFd, &value);
+                m_tickled = false;
                 continue;
             }
-            FdContext *fd_ctx    = (FdContext *)events[i].data.ptr;
+            FdContext *fd_ctx = (FdContext *)events[i].data.ptr;
+
+            /* 一次性IO事件等待，调度就绪的事件对应的任务，出错或挂起时读写等待都唤醒 */
+            {
+                Mutex::Lock lock(fd_ctx->mutex);
+                if (fd_ctx->waitEvents) {
+                    uint32_t real_events = events[i].events;
+                    if (real_events & (EPOLLERR | EPOLLHUP)) {
+                        real_events |= EPOLLIN | EPOLLOUT;
+                    }
+                    cancelWait(fd_ctx, real_events & fd_ctx->waitEvents,
+                               false);
+                    continue;
+                }
+            }
+
             fd_ctx->event.events = events[i].events;
             SYLAR_LOG_DEBUG(g_logger)
                 << "IO fibler fd=" << fd_ctx->fd << " has event";
 
             if (fd_ctx->task.cb) {
-                schedule(fd_ctx->task.cb,
-                         (void *)fd_ctx); //这里多tickle了一下，可以优化掉
+                pushTask(ScheduleTask(fd_ctx->task.cb, (void *)fd_ctx));
             } else if (fd_ctx->task.fiber) {
-                schedule(fd_ctx->task.fiber);
+                pushTask(ScheduleTask(fd_ctx->task.fiber));
 
                 // //fdContext里也会保存一份fiber的智能指针，
                 // 如果这里不reset，就需要手动对每个fd都执行一次EPOLL_CTL_DEL，保证不会因
@@ -132,34 +303,124 @@ void Scheduler::idle() {
                 SYLAR_LOG_ERROR(g_logger) << "invalid task";
             }
         }
-        // TODO:待优化，这里不需要break，因为idle也是一个协程，直接在这里yield就可以了，能
-        //节省掉创新新idle协程的开销
-        SYLAR_LOG_DEBUG(g_logger) << "break idle";
-        break;
+
+        /* 回到run()调度刚加入的任务 */
+        --m_idleThreads;
+        SYLAR_LOG_DEBUG(g_logger) << "idle yield";
+        Fiber::GetThis()->yield();
+    }
+    SYLAR_LOG_DEBUG(g_logger) << "idle end";
+}
+
+bool Scheduler::stopping() {
+    MutexType::Lock lock(m_mutex);
+    return m_stop && m_taskCount == 0 && m_iofds == 1 && m_waitEvents == 0 &&
+           !m_timers.hasTimer();
+}
+
+void Scheduler::pushTask(const ScheduleTask &task) {
+    ++m_taskCount;
+    if (t_scheduler == this && t_localQueue) {
+        ScheduleTask *ptask = AllocTaskNode(task);
+        if (t_localQueue->push(ptask)) {
+            return;
+        }
+        FreeTaskNode(ptask);
     }
+
+    MutexType::Lock lock(m_mutex);
+    m_tasks.push_back(task);
 }
 
-void Scheduler::run() {
+bool Scheduler::popTask(ScheduleTask &task) {
+    ScheduleTask *ptask = nullptr;
+
+    /* 本地队列只由本线程压入，这里也从top端取任务，保证本线程内的任务按FIFO顺序调度，
+     * 避免反复yield并重新加入调度的协程使其他任务饿死，所以队列不提供bottom端的LIFO弹出
+     */
+    bool global_first = (++t_scheduleTick % GLOBAL_QUEUE_CHECK_INTERVAL == 0);
+    if (t_localQueue && !global_first) {
+        ptask = t_localQueue->steal();
+    }
+
+    if (!ptask) {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_tasks.begin();
+        while (it != m_tasks.end()) {
+            SYLAR_ASSERT(it->fiber || it->cb);
+            /* 协程已被重新加入调度，但还未在其他调度线程上完成切出，暂不调度 */
+            if (it->fiber && it->fiber->getState() == Fiber::FIBER_RUNNING) {
+                ++it;
+                continue;
+            }
+            task = *it;
+            m_tasks.erase(it);
+            --m_taskCount;
+            return true;
+        }
+    }
+
+    if (!ptask && t_localQueue) {
+        ptask = t_localQueue->steal();
+    }
+
+    /* 从其他调度线程的本地队列窃取任务 */
+    for (size_t i = 1; !ptask && i < m_localQueues.size(); ++i) {
+        ptask = m_localQueues[(t_workerIndex + i) % m_localQueues.size()]->steal();
+    }
+
+    if (!ptask) {
+        return false;
+    }
+
+    task = *ptask;
+    FreeTaskNode(ptask);
+    if (task.fiber && task.fiber->getState() == Fiber::FIBER_RUNNING) {
+        /* 协程还未完成切出，放回全局队列，稍后再调度 */
+        MutexType::Lock lock(m_mutex);
+        m_tasks.push_back(task);
+        task.reset();
+        return false;
+    }
+
+    --m_taskCount;
+    return true;
+}
+
+void Scheduler::run(size_t index) {
     enable_hook_sys_call();
     Fiber::GetThis();
     setThis(this); //设置当前线程的协程调度器
+    t_workerIndex = index;
+    t_localQueue  = m_workStealing ? m_localQueues[index].get() : nullptr;
     ScheduleTask task;
     Fiber::ptr cb_fiber;
+    uint32_t spins = 0;
+    /* idle协程常驻，无任务时切换过去，满足停止条件时idle协程结束 */
+    Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
 
     while (true) {
         task.reset();
 
-        /* 从任务队列中获取一个要执行的任务 */
-        {
-            MutexType::Lock lock(m_mutex);
-            auto it = m_tasks.begin();
-            while (it != m_tasks.end()) {
-                SYLAR_ASSERT(it->fiber || it->cb);
-                task = *it;
-                m_tasks.erase(it);
-                ++it;
-                break;
+        /* 获取一个要执行的任务，取不到但仍有任务时，说明任务正被其他线程窃取或者协程
+         * 还未完成切出，先有限次数地自旋重试，之后进入idle协程等待
+         */
+        if (!popTask(task) && m_taskCount > 0) {
+            if (++spins < POP_SPIN_COUNT) {
+                if (spins % POP_SPIN_YIELD_INTERVAL) {
+                    CpuRelax();
+                } else {
+                    sched_yield();
+                }
+                continue;
             }
+            t_popRetry = true;
+        }
+        spins = 0;
+
+        /* 唤醒只会叫醒一个调度线程，还有剩余任务时由它依次唤醒其他空闲的调度线程 */
+        if ((task.fiber || task.cb) && m_taskCount > 0 && m_idleThreads > 0) {
+            tickle();
         }
 
         /* 调度任务，没有任务时执行idle协程 */
@@ -185,29 +446,18 @@ void Scheduler::run() {
                 cb_fiber->reset(nullptr);
             }
         } else {
-            /* 未停止，但无任务可调度，运行idle协程 */
-            SYLAR_ASSERT(m_tasks.empty());
-            Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
+            /* 无任务可调度，运行idle协程，idle协程在满足停止条件时结束，此时结束调度线程
+             */
             idle_fiber->resume();
-            m_idle = false;
-
-            // /*
-            // idle协程退出，表示要么添加了新任务，要么停止了调度，这里判断下，如果任
-            //  *务还没调度完，要先将所有任务调度完再退出
-            //  */
-            // if (!m_tasks.empty()) {
-            //     continue;
-            // } else {
-            //     SYLAR_LOG_INFO(g_logger) << "Schedules thread exit";
-            //     break;
-            // }
-
-            /* 当前无任务调度，且停止标志被设置，直接结束调度线程 */
-            if (m_stop && m_tasks.empty() && m_iofds == 1) {
+            if (idle_fiber->getState() == Fiber::FIBER_TERMINATED) {
                 break;
             }
         }
     } // end while(true)
+
+    t_localQueue = nullptr;
+    /* 唤醒其他仍阻塞在epoll_wait上的调度线程，使其也能检查停止条件 */
+    tickle();
 } // end Scheduler::run()
 
 void Scheduler::resizeFdContext(size_t size) {
@@ -308,13 +558,156 @@ int Scheduler::io_schedule(int fd, int op, uint32_t events, ScheduleTask task) {
     return 0;
 } // end Scheduler::io_schedule
 
+FdContext *Scheduler::getFdContext(int fd, bool auto_create) {
+    MutexType::Lock lock(m_mutex);
+    if ((int)m_fdContexts.size() > fd) {
+        return m_fdContexts[fd];
+    }
+    if (!auto_create) {
+        return nullptr;
+    }
+    resizeFdContext(fd * 1.5 + 1);
+    return m_fdContexts[fd];
+}
+
+int Scheduler::io_wait(int fd, uint32_t event, ScheduleTask task) {
+    if (fd < 0 || (event != EPOLLIN && event != EPOLLOUT)) {
+        SYLAR_LOG_ERROR(g_logger)
+            << "invalid argument, fd=" << fd << " event=" << event;
+        return -1;
+    }
+
+    FdContext *fd_ctx = getFdContext(fd, true);
+    Mutex::Lock lock(fd_ctx->mutex);
+    if (fd_ctx->fd >= 0 && !fd_ctx->waitEvents) {
+        //已通过io_schedule添加了常驻IO调度
+        SYLAR_LOG_ERROR(g_logger)
+            << "error,fd " << fd << " has been added by io_schedule!";
+        return -1;
+    }
+    if (fd_ctx->waitEvents & event) {
+        //同一个事件只能有一个等待者
+        SYLAR_LOG_ERROR(g_logger) << "error,fd " << fd << " event " << event
+                                  << " is already being waited!";
+        return -1;
+    }
+
+    int op = fd_ctx->waitEvents ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    epoll_event ev;
+    ev.events   = EPOLLET | fd_ctx->waitEvents | event;
+    ev.data.ptr = fd_ctx;
+
+    int rt = epoll_ctl(m_epfd, op, fd, &ev);
+    if (rt) {
+        SYLAR_LOG_ERROR(g_logger)
+            << "epoll_ctl(" << m_epfd << ", " << op << "," << fd << ","
+            << ev.events << "):" << rt << " (" << errno << ") ("
+            << strerror(errno) << ")";
+        return -1;
+    }
+
+    fd_ctx->waitEvents |= event;
+    fd_ctx->fd        = fd;
+    fd_ctx->scheduler = this;
+    if (event == EPOLLIN) {
+        fd_ctx->readTask = task;
+    } else {
+        fd_ctx->writeTask = task;
+    }
+    ++m_waitEvents;
+    return 0;
+} // end Scheduler::io_wait
+
+bool Scheduler::io_cancel(int fd, uint32_t event) {
+    FdContext *fd_ctx = getFdContext(fd, false);
+    if (!fd_ctx) {
+        return false;
+    }
+
+    Mutex::Lock lock(fd_ctx->mutex);
+    if (!(fd_ctx->waitEvents & event)) {
+        return false;
+    }
+    return cancelWait(fd_ctx, event, true);
+}
+
+bool Scheduler::io_cancel_all(int fd) {
+    FdContext *fd_ctx = getFdContext(fd, false);
+    if (!fd_ctx) {
+        return false;
+    }
+
+    Mutex::Lock lock(fd_ctx->mutex);
+    if (!fd_ctx->waitEvents) {
+        return false;
+    }
+    return cancelWait(fd_ctx, fd_ctx->waitEvents, true);
+}
+
+bool Scheduler::cancelWait(FdContext *fd_ctx, uint32_t events,
+                           bool need_tickle) {
+    events &= fd_ctx->waitEvents;
+    if (!events) {
+        return false;
+    }
+
+    //剩余的等待事件重新注册，没有剩余事件时从epoll中删除
+    uint32_t left = fd_ctx->waitEvents & ~events;
+    int op        = left ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    epoll_event ev;
+    ev.events   = EPOLLET | left;
+    ev.data.ptr = fd_ctx;
+    int rt      = epoll_ctl(m_epfd, op, fd_ctx->fd, &ev);
+    if (rt) {
+        //fd可能已被关闭，等待的任务仍然需要调度，不能丢失
+        SYLAR_LOG_DEBUG(g_logger)
+            << "epoll_ctl(" << m_epfd << ", " << op << "," << fd_ctx->fd << ","
+            << ev.events << "):" << rt << " (" << errno << ") ("
+            << strerror(errno) << ")";
+    }
+
+    if (events & EPOLLIN) {
+        pushTask(fd_ctx->readTask);
+        fd_ctx->readTask.reset();
+        --m_waitEvents;
+    }
+    if (events & EPOLLOUT) {
+        pushTask(fd_ctx->writeTask);
+        fd_ctx->writeTask.reset();
+        --m_waitEvents;
+    }
+    if (need_tickle && m_idleThreads > 0) {
+        tickle();
+    }
+
+    fd_ctx->waitEvents = left;
+    if (!left) {
+        fd_ctx->fd        = -1;
+        fd_ctx->scheduler = nullptr;
+    }
+    return true;
+}
+
 int Scheduler::timer_schedule(Timer::ptr timer, int op) {
     if (!timer) {
         SYLAR_LOG_ERROR(g_logger) << "invalid argument:" << timer;
         return -1;
     }
 
-    return io_schedule(timer->getFd(), op, EPOLLIN | EPOLLET, timer->getTask());
+    if (op == EPOLL_CTL_ADD) {
+        /* 定时器早于idle线程的唤醒时间时，需要唤醒idle线程重新计算epoll_wait超时 */
+        if (m_timers.addTimer(timer) && m_idleThreads > 0) {
+            tickle();
+        }
+        return 0;
+    } else if (op == EPOLL_CTL_DEL) {
+        //定时器已超时或已取消时也返回成功
+        m_timers.delTimer(timer);
+        return 0;
+    }
+
+    SYLAR_LOG_ERROR(g_logger) << "invalid op: " << op;
+    return -1;
 } // end Scheduler::timer_schedule
 
 } // end namespace sylar
\ No newline at end of file
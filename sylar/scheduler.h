@@ -5,11 +5,14 @@
 #include "log.h"
 #include "thread.h"
 #include "timer.h"
+#include "work_stealing_queue.h"
+#include <atomic>
 #include <functional>
 #include <list>
 #include <memory>
 #include <string>
 #include <sys/epoll.h>
+#include <vector>
 
 namespace sylar {
 
@@ -25,6 +28,14 @@ public:
     std::function<void(void *)> cb;
     Scheduler *scheduler;
     epoll_event event; // events用于保存已发生的事件，data.u32用于存放原始事件
+
+    /* 一次性IO事件等待，由io_wait()添加，事件就绪或被取消后调度对应的任务并自动删除，
+     * 与io_schedule()添加的常驻IO调度不能同时用于同一个fd，有等待时fd字段同样有效
+     */
+    Mutex mutex;            //保护以下一次性等待的字段
+    uint32_t waitEvents;    //正在等待的事件，EPOLLIN/EPOLLOUT的组合
+    ScheduleTask readTask;  // EPOLLIN就绪时调度的任务
+    ScheduleTask writeTask; // EPOLLOUT就绪时调度的任务
 public:
     FdContext() { reset(); }
     void reset() {
@@ -36,6 +47,9 @@ public:
         task.cb        = nullptr;
         task.fiber     = nullptr;
         task.arg       = nullptr;
+        waitEvents     = 0;
+        readTask.reset();
+        writeTask.reset();
     }
 }; // end struct FdContext
 
@@ -44,27 +58,26 @@ public:
     typedef std::shared_ptr<Scheduler> ptr;
     typedef Mutex MutexType;
 
-    Scheduler(const std::string &name = "");
+    /* name: 协程调度器名称
+     * threads: 调度线程数，为0时使用配置项scheduler.threads的值
+     */
+    Scheduler(const std::string &name = "", size_t threads = 0);
     virtual ~Scheduler();
 
     /* 添加调度任务 */
     template <class FiberOrCb>
     void schedule(FiberOrCb fc, void *arg = nullptr) {
-        bool need_tickle = false;
         ScheduleTask task(fc, arg);
 
         if (task.fiber || task.cb) {
+            pushTask(task);
 
-            /* 如果当前是idle状态，需要唤醒idle协程，使其立即退出，进行重新调度*/
-            if (m_idle) {
-                need_tickle = true;
+            /* 如果有线程处于idle状态，需要唤醒idle协程，使其立即退出，进行重新调度。
+             * 先入队再检查idle状态，与idle()中先标记idle再检查队列相对应，避免丢失唤醒
+             */
+            if (m_idleThreads > 0) {
+                tickle(); //唤醒idle协程
             }
-            MutexType::Lock lock(m_mutex);
-            m_tasks.push_back(task);
-        }
-
-        if (need_tickle) {
-            tickle(); //唤醒idle协程
         }
     }
 
@@ -72,21 +85,16 @@ public:
     template <class InputIterator>
     void schedule(InputIterator begin, InputIterator end) {
         bool need_tickle = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            while (begin != end) {
-                ScheduleTask task(*begin);
-                if (task.fiber || task.cb) {
-                    if (m_idle && !need_tickle) {
-                        need_tickle = true;
-                    }
-                    m_tasks.push_back(task);
-                }
-                ++begin;
-            }
-            if (need_tickle) {
-                tickle();
+        while (begin != end) {
+            ScheduleTask task(*begin);
+            if (task.fiber || task.cb) {
+                pushTask(task);
+                need_tickle = true;
             }
+            ++begin;
+        }
+        if (need_tickle && m_idleThreads > 0) {
+            tickle();
         }
     }
 
@@ -113,9 +121,30 @@ public:
     //     return io_schedule(fd, op, events, task);
     // }
 
-    //添加定时器调度任务
+    /* 添加一次性IO事件等待，事件就绪时调度task，之后自动删除
+     * fd: 目标文件描述符
+     * event: EPOLLIN或EPOLLOUT，同一个fd上读写事件可以分别等待
+     * 返回0表示成功，-1表示失败
+     */
+    int io_wait(int fd, uint32_t event, ScheduleTask task);
+    /* 取消一次性IO事件等待，并立即调度等待的任务，fd上没有该等待时返回false */
+    bool io_cancel(int fd, uint32_t event);
+    /* 取消fd上所有的一次性IO事件等待，关闭fd前调用 */
+    bool io_cancel_all(int fd);
+
+    /* 添加/取消定时器调度任务
+     * op: EPOLL_CTL_ADD添加定时器，EPOLL_CTL_DEL取消定时器
+     */
     int timer_schedule(Timer::ptr timer, int op);
 
+    /* 添加定时器，timeout毫秒后调度fc，recurring为true时每隔timeout毫秒调度一次 */
+    template <class FiberOrCb>
+    Timer::ptr addTimer(uint64_t timeout, FiberOrCb fc, bool recurring = false) {
+        Timer::ptr timer(new Timer(timeout, fc, recurring));
+        timer_schedule(timer, EPOLL_CTL_ADD);
+        return timer;
+    }
+
     /* 启动协程调度器 */
     void start();
 
@@ -123,39 +152,75 @@ public:
     void stop(bool force = false);
 
     const std::string &getName() const { return m_name; }
+    size_t getThreadCount() const { return m_threadCount; }
+    /* 当前待调度的任务数，包括全局队列和各调度线程本地队列中的任务 */
+    size_t getTaskCount() const { return m_taskCount; }
+    /* 唤醒idle线程时实际写eventfd的次数，及idle协程调用epoll_wait的次数 */
+    uint64_t getTickleCount() const { return m_tickles; }
+    uint64_t getEpollWaitCount() const { return m_epollWaits; }
 
     static Scheduler *getThis();
     static void setThis(Scheduler *psc);
+    /* 未指定线程数时的调度线程数，即配置项scheduler.threads的值，至少为1 */
+    static size_t getDefaultThreadCount();
 
 protected:
     /* 通知协程调度器有任务了 */
     void tickle();
-    /* 协程调度函数 */
-    void run();
-    /* 无任务调度时执行idle协程 */
+    /* 协程调度函数，index为调度线程编号 */
+    void run(size_t index);
+    /* idle协程的入口，无任务调度时切换到idle协程等待IO事件和定时器 */
     void idle();
+    /* 是否满足停止条件：已停止，且无待调度的任务、IO、IO等待及定时器 */
+    bool stopping();
 
 private:
     void resizeFdContext(size_t size);
+    /* 获取fd的上下文，auto_create为false且不存在时返回nullptr */
+    FdContext *getFdContext(int fd, bool auto_create);
+    /* 删除fd_ctx上的部分一次性等待并调度等待的任务，事件就绪和取消等待都通过这里
+     * 完成，调用前需持有fd_ctx->mutex。need_tickle为false时只入队不唤醒idle线程，
+     * 用于idle协程内的事件分发
+     */
+    bool cancelWait(FdContext *fd_ctx, uint32_t events, bool need_tickle);
+    /* 任务入队，调度线程内添加的任务优先放入本线程的本地队列 */
+    void pushTask(const ScheduleTask &task);
+    /* 任务出队，依次尝试本地队列、全局队列，最后从其他调度线程窃取 */
+    bool popTask(ScheduleTask &task);
 
 private:
-    std::string m_name;              //协程调度器名称
-    MutexType m_mutex;               //互斥锁
-    std::list<ScheduleTask> m_tasks; //任务队列
-    Thread::ptr m_thread;            //调度线程
-    bool m_idle = false;             //调度线程是否idle
-
-    /* 使用pipe配合epoll实现协程调度 */
-    int m_epfd;         // epoll句柄
-    int m_tickleFds[2]; // pipe句柄， [0]读句柄，[1]写句柄
+    std::string m_name;                   //协程调度器名称
+    MutexType m_mutex;                    //互斥锁
+    std::list<ScheduleTask> m_tasks;      //全局任务队列，所有调度线程共享
+    std::vector<Thread::ptr> m_threads;   //调度线程池
+    size_t m_threadCount;                 //调度线程数
+    std::atomic<size_t> m_idleThreads{0}; //处于idle状态的调度线程数
+    std::atomic<size_t> m_taskCount{0};   //待调度的任务总数
+
+    uint32_t m_epollBatch; // idle协程一次epoll_wait最多返回的事件数
+
+    /* 每个调度线程一个本地无锁队列，空闲的调度线程从其他线程的队列窃取任务 */
+    bool m_workStealing;
+    std::vector<std::unique_ptr<WorkStealingQueue<ScheduleTask>>> m_localQueues;
+
+    /* 使用eventfd配合epoll实现协程调度 */
+    int m_epfd;                            // epoll句柄
+    int m_tickleFd;                        // eventfd句柄，用于唤醒idle协程
+    std::atomic<bool> m_tickled{false};    //已有未处理的唤醒，期间的tickle可省略
+    std::atomic<uint64_t> m_tickles{0};    //实际写eventfd的次数
+    std::atomic<uint64_t> m_epollWaits{0}; // epoll_wait调用次数
 
     /* 增加一个停止标志，解决stop()的tickle有可能被忽略的问题 */
-    bool m_stop = false;
+    std::atomic<bool> m_stop{false};
 
     /* 文件描述符上下文集合，用于IO事件调度*/
     std::vector<FdContext *> m_fdContexts;
     int m_iofds; //当前参与IO调度的描述符个数
-};               // end class Scheduler
+    std::atomic<size_t> m_waitEvents{0}; //当前一次性IO事件等待的个数
+
+    /* 定时器时间轮，由idle协程的epoll_wait超时驱动 */
+    TimerManager m_timers;
+}; // end class Scheduler
 
 } // end namespace sylar
 
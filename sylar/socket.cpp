@@ -1,5 +1,7 @@
 #include "socket.h"
 #include "address.h"
+#include "fd_manager.h"
+#include "hook_sys_call.h"
 #include "log.h"
 #include "sylar.h"
 #include <netinet/tcp.h>
@@ -70,19 +72,95 @@ bool Socket::init(int sock) {
 }
 
 Socket::ptr Socket::accept() {
+    /* 监听socket可能是在调度线程之外创建的，没有登记到FdManager，hook的accept会直接
+     * 阻塞整个调度线程，这里补登记，使accept在没有连接时让出协程
+     */
+    if (is_enable_hook_sys_call()) {
+        FdMgr::GetInstance()->get(m_sock, true);
+    }
     Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
     int newsock = ::accept(m_sock, nullptr, nullptr);
     if (newsock == -1) {
-        SYLAR_LOG_ERROR(g_logger) << "accept(" << m_sock << ") errno=" << errno
-                                  << "errstr=" << strerror(errno);
+        //等待期间socket被close(如服务器停止)时不是错误
+        if (isValid()) {
+            SYLAR_LOG_ERROR(g_logger) << "accept(" << m_sock << ") errno="
+                                      << errno << "errstr=" << strerror(errno);
+        }
+        return nullptr;
+    }
+    if (sock->init(newsock)) {
+        return sock;
+    }
+    return nullptr;
+}
+
+Socket::ptr Socket::tryAccept() {
+    //监听socket在调度线程内已被设为系统层面的非阻塞，accept4不会阻塞
+    int newsock = accept4(m_sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (newsock == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            SYLAR_LOG_ERROR(g_logger) << "accept4(" << m_sock << ") errno="
+                                      << errno << "errstr=" << strerror(errno);
+        }
         return nullptr;
     }
+    //与hook的accept一样登记到FdManager，之后的IO才会在未就绪时让出协程
+    if (is_enable_hook_sys_call()) {
+        FdMgr::GetInstance()->get(newsock, true);
+    }
+
+    Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
     if (sock->init(newsock)) {
         return sock;
     }
     return nullptr;
 }
 
+bool Socket::setOption(int level, int option, const void *value,
+                       socklen_t len) {
+    if (!isValid()) {
+        newSock();
+        if (!isValid()) {
+            return false;
+        }
+    }
+
+    if (setsockopt(m_sock, level, option, value, len)) {
+        SYLAR_LOG_ERROR(g_logger)
+            << "setOption sock=" << m_sock << " level=" << level
+            << " option=" << option << " errno=" << errno
+            << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::setRecvTimeout(uint64_t v) {
+    timeval tv;
+    tv.tv_sec  = v / 1000;
+    tv.tv_usec = v % 1000 * 1000;
+    if (setsockopt(m_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))) {
+        SYLAR_LOG_ERROR(g_logger)
+            << "setRecvTimeout sock=" << m_sock << " errno=" << errno
+            << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::setSendTimeout(uint64_t v) {
+    timeval tv;
+    tv.tv_sec  = v / 1000;
+    tv.tv_usec = v % 1000 * 1000;
+    if (setsockopt(m_sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv))) {
+        SYLAR_LOG_ERROR(g_logger)
+            << "setSendTimeout sock=" << m_sock << " errno=" << errno
+            << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
 bool Socket::bind(const Address::ptr addr) {
     if (!isValid()) {
         newSock();
@@ -108,7 +186,7 @@ bool Socket::bind(const Address::ptr addr) {
     return true;
 }
 
-bool Socket::connect(const Address::ptr addr) {
+bool Socket::connect(const Address::ptr addr, uint64_t timeout_ms) {
     if (!isValid()) {
         newSock();
         if (!isValid()) {
@@ -123,7 +201,11 @@ bool Socket::connect(const Address::ptr addr) {
         return false;
     }
 
-    if (::connect(m_sock, addr->getAddr(), addr->getAddrLen())) {
+    int rt = timeout_ms == (uint64_t)-1
+                 ? ::connect(m_sock, addr->getAddr(), addr->getAddrLen())
+                 : connect_with_timeout(m_sock, addr->getAddr(),
+                                        addr->getAddrLen(), timeout_ms);
+    if (rt) {
         SYLAR_LOG_ERROR(g_logger)
             << "sock=" << m_sock << " connect(" << addr->toString()
             << ") error errno=" << errno << "errstr=" << strerror(errno);
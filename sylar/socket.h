@@ -25,12 +25,26 @@ public:
     ~Socket();
 
     Socket::ptr accept();
+    /* 非阻塞地接受一个连接，没有待接受的连接时立即返回nullptr，不让出协程，用于在
+     * accept()返回后批量接受剩余的连接，只能在调度线程内使用
+     */
+    Socket::ptr tryAccept();
 
     bool bind(const Address::ptr addr);
-    bool connect(const Address::ptr addr);
+    /* timeout_ms为-1时使用配置项tcp.connect.timeout */
+    bool connect(const Address::ptr addr, uint64_t timeout_ms = -1);
     bool listen(int backlog = SOMAXCONN);
     bool close();
 
+    /* 设置socket选项，socket尚未创建时先创建，用于在bind之前设置SO_REUSEPORT等 */
+    bool setOption(int level, int option, const void *value, socklen_t len);
+    template <class T> bool setOption(int level, int option, const T &value) {
+        return setOption(level, option, &value, sizeof(T));
+    }
+    /* 设置读写超时，单位ms，由hook的IO函数实现 */
+    bool setRecvTimeout(uint64_t v);
+    bool setSendTimeout(uint64_t v);
+
     int send(const void *buffer, size_t length, int flags = 0);
     int send(const iovec *buffers, size_t length, int flags = 0);
     int sendTo(const void *buffer, size_t length, const Address::ptr to,
@@ -1,4 +1,5 @@
 #include "socket_stream.h"
+#include <sys/sendfile.h>
 
 namespace sylar {
 
@@ -60,6 +61,48 @@ int SocketStream::write(ByteArray::ptr ba, size_t length) {
     return rt;
 }
 
+int SocketStream::writevFixSize(iovec *buffers, size_t count) {
+    if (!isConnected()) {
+        return -1;
+    }
+    size_t total = 0;
+    while (count > 0) {
+        int rt = m_socket->send(buffers, count);
+        if (rt <= 0) {
+            return rt;
+        }
+        total += rt;
+        //跳过已发送完的块，调整部分发送的块
+        size_t len = rt;
+        while (count > 0 && len >= buffers->iov_len) {
+            len -= buffers->iov_len;
+            ++buffers;
+            --count;
+        }
+        if (count > 0) {
+            buffers->iov_base = (char *)buffers->iov_base + len;
+            buffers->iov_len -= len;
+        }
+    }
+    return total;
+}
+
+int64_t SocketStream::sendFile(int fd, uint64_t offset, uint64_t length) {
+    if (!isConnected()) {
+        return -1;
+    }
+    off_t off     = offset;
+    uint64_t left = length;
+    while (left > 0) {
+        ssize_t rt = ::sendfile(m_socket->getSocket(), fd, &off, left);
+        if (rt <= 0) {
+            return rt;
+        }
+        left -= rt;
+    }
+    return length;
+}
+
 void SocketStream::close() {
     if (m_socket) {
         m_socket->close();
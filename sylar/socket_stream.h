@@ -18,6 +18,14 @@ public:
 
     virtual int write(const void *buffer, size_t length) override;
     virtual int write(ByteArray::ptr ba, size_t length) override;
+    /* 通过一次writev发送多块数据，部分发送时继续发送剩余部分，会修改buffers，成功返回
+     * 发送的总长度
+     */
+    int writevFixSize(iovec *buffers, size_t count);
+    /* 通过sendfile发送文件fd中从offset开始的length字节，数据不经过用户态，部分发送时
+     * 继续发送剩余部分，成功返回length
+     */
+    int64_t sendFile(int fd, uint64_t offset, uint64_t length);
 
     virtual void close() override;
 
@@ -0,0 +1,303 @@
+#include "stack_allocator.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include <algorithm>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+//协程栈分配器，pool为池化分配器，malloc为每次malloc/free
+static ConfigVar<std::string>::ptr g_fiber_stack_allocator =
+    ConfigManager::LookUp<std::string>("fiber.stack_allocator", "pool",
+                                       "fiber stack allocator, pool or malloc");
+
+//池化分配器每个线程每一级最多缓存的栈个数
+static ConfigVar<uint32_t>::ptr g_fiber_stack_pool_thread_cache =
+    ConfigManager::LookUp<uint32_t>("fiber.stack_pool.thread_cache", 64,
+                                    "fiber stack pool per-thread cache size");
+
+//池化分配器全局每一级最多缓存的栈个数
+static ConfigVar<uint32_t>::ptr g_fiber_stack_pool_global_cache =
+    ConfigManager::LookUp<uint32_t>("fiber.stack_pool.global_cache", 1024,
+                                    "fiber stack pool global cache size");
+
+StackAllocStats StackAllocator::getStats() const {
+    StackAllocStats stats;
+    stats.allocs    = m_allocs;
+    stats.deallocs  = m_deallocs;
+    stats.sysAllocs = m_sysAllocs;
+    stats.sysFrees  = m_sysFrees;
+    stats.cached    = m_cached;
+    return stats;
+}
+
+StackAllocator *StackAllocator::Get(const std::string &name) {
+    //分配器在进程退出前都可能被使用，不释放，避免静态对象的析构顺序问题
+    static MallocStackAllocator *s_malloc = new MallocStackAllocator;
+    static PooledStackAllocator *s_pool   = new PooledStackAllocator(
+        g_fiber_stack_pool_thread_cache->getValue(),
+        g_fiber_stack_pool_global_cache->getValue());
+
+    if (name == "pool") {
+        return s_pool;
+    } else if (name == "malloc") {
+        return s_malloc;
+    }
+    return nullptr;
+}
+
+static std::atomic<StackAllocator *> s_default_allocator{nullptr};
+
+StackAllocator *StackAllocator::GetDefault() {
+    StackAllocator *allocator = s_default_allocator;
+    if (!allocator) {
+        allocator = Get(g_fiber_stack_allocator->getValue());
+        if (!allocator) {
+            allocator = Get("malloc");
+        }
+        s_default_allocator = allocator;
+    }
+    return allocator;
+}
+
+namespace {
+struct _StackAllocatorIniter {
+    _StackAllocatorIniter() {
+        g_fiber_stack_allocator->addListener(
+            [](const std::string &old_value, const std::string &new_value) {
+                StackAllocator *allocator = StackAllocator::Get(new_value);
+                if (!allocator) {
+                    SYLAR_LOG_ERROR(g_logger)
+                        << "invalid fiber.stack_allocator: " << new_value;
+                    return;
+                }
+                //已创建的协程仍使用原来的分配器释放栈，见Fiber::m_allocator
+                s_default_allocator = allocator;
+            });
+    }
+};
+
+static _StackAllocatorIniter s_initer;
+} // namespace
+
+void *MallocStackAllocator::alloc(size_t size) {
+    ++m_allocs;
+    ++m_sysAllocs;
+    return malloc(size);
+}
+
+void MallocStackAllocator::dealloc(void *vp, size_t size) {
+    ++m_deallocs;
+    ++m_sysFrees;
+    free(vp);
+}
+
+/* 线程缓存，每一级一个容量为m_threadCache的空闲栈数组，首次使用该级别时申请 */
+struct PooledStackAllocator::ThreadCache {
+    PooledStackAllocator *owner;
+    size_t count[SIZE_CLASSES];
+    void **stacks[SIZE_CLASSES];
+};
+
+/* 线程缓存在线程退出时由t_cache_guard归还到全局缓存，之后本线程释放的栈直接放入
+ * 全局缓存，t_cache本身是普通指针，在线程退出过程中访问也是安全的
+ */
+static thread_local PooledStackAllocator::ThreadCache *t_cache = nullptr;
+static thread_local bool t_cache_destroyed                     = false;
+
+struct ThreadCacheGuard {
+    ~ThreadCacheGuard() {
+        if (t_cache) {
+            t_cache->owner->flushThreadCache();
+            for (auto i : t_cache->stacks) {
+                delete[] i;
+            }
+            delete t_cache;
+            t_cache = nullptr;
+        }
+        t_cache_destroyed = true;
+    }
+};
+static thread_local ThreadCacheGuard t_cache_guard;
+
+PooledStackAllocator::PooledStackAllocator(size_t thread_cache,
+                                           size_t global_cache)
+    : m_pageSize(sysconf(_SC_PAGESIZE))
+    , m_pageShift(__builtin_ctzl(m_pageSize))
+    , m_threadCache(thread_cache)
+    , m_globalCache(global_cache) {}
+
+PooledStackAllocator::ThreadCache *PooledStackAllocator::getThreadCache() {
+    if (t_cache_destroyed || m_threadCache == 0) {
+        return nullptr;
+    }
+    if (!t_cache) {
+        (void)&t_cache_guard; //确保线程退出时执行guard的析构
+        t_cache        = new ThreadCache();
+        t_cache->owner = this;
+    }
+    //只有一个池化分配器使用线程缓存
+    return t_cache->owner == this ? t_cache : nullptr;
+}
+
+int PooledStackAllocator::sizeClass(size_t size, size_t &class_size) const {
+    if (size <= m_pageSize) {
+        class_size = m_pageSize;
+        return 0;
+    }
+    //向上取整为2的幂，级别为其相对页大小的位移
+    int bits = 64 - __builtin_clzl(size - 1);
+    int cls  = bits - m_pageShift;
+    if (cls >= (int)SIZE_CLASSES) {
+        return -1;
+    }
+    class_size = 1ul << bits;
+    return cls;
+}
+
+void *PooledStackAllocator::mmapStack(size_t class_size) {
+    //多申请一个页作为保护页
+    void *base = mmap(nullptr, class_size + m_pageSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE,
+                      -1, 0);
+    if (base == MAP_FAILED) {
+        SYLAR_LOG_ERROR(g_logger) << "mmap fiber stack failed, size="
+                                  << class_size << " errno=" << errno
+                                  << " errstr=" << strerror(errno);
+        return nullptr;
+    }
+    if (mprotect(base, m_pageSize, PROT_NONE)) {
+        SYLAR_LOG_ERROR(g_logger) << "mprotect fiber stack guard page failed"
+                                  << " errno=" << errno
+                                  << " errstr=" << strerror(errno);
+    }
+    ++m_sysAllocs;
+    return (char *)base + m_pageSize;
+}
+
+void PooledStackAllocator::munmapStack(void *vp, size_t class_size) {
+    munmap((char *)vp - m_pageSize, class_size + m_pageSize);
+    ++m_sysFrees;
+}
+
+size_t PooledStackAllocator::popGlobal(int cls, void **stacks, size_t n) {
+    Mutex::Lock lock(m_mutex);
+    auto &global = m_global[cls];
+    size_t count = std::min(n, global.size());
+    for (size_t i = 0; i < count; ++i) {
+        stacks[i] = global.back();
+        global.pop_back();
+    }
+    return count;
+}
+
+size_t PooledStackAllocator::pushGlobal(int cls, void **stacks, size_t n,
+                                        size_t class_size) {
+    size_t count = 0;
+    {
+        Mutex::Lock lock(m_mutex);
+        auto &global = m_global[cls];
+        count        = std::min(n, m_globalCache - std::min(m_globalCache,
+                                                            global.size()));
+        global.insert(global.end(), stacks, stacks + count);
+    }
+    //全局缓存已满，剩余的归还给系统
+    for (size_t i = count; i < n; ++i) {
+        munmapStack(stacks[i], class_size);
+    }
+    return count;
+}
+
+void *PooledStackAllocator::alloc(size_t size) {
+    ++m_allocs;
+    size_t class_size = 0;
+    int cls           = sizeClass(size, class_size);
+    if (cls < 0) {
+        //超出最大级别的栈不缓存
+        return mmapStack(size);
+    }
+
+    ThreadCache *cache = getThreadCache();
+    if (cache) {
+        void **&stacks = cache->stacks[cls];
+        size_t &count  = cache->count[cls];
+        if (count == 0) {
+            //线程缓存为空，从全局缓存批量取一半，减少加锁次数
+            if (!stacks) {
+                stacks = new void *[m_threadCache];
+            }
+            size_t n = std::max<size_t>(1, m_threadCache / 2);
+            count    = popGlobal(cls, stacks, n);
+        }
+        if (count > 0) {
+            --m_cached;
+            return stacks[--count];
+        }
+    } else {
+        void *vp = nullptr;
+        if (popGlobal(cls, &vp, 1)) {
+            --m_cached;
+            return vp;
+        }
+    }
+    return mmapStack(class_size);
+}
+
+void PooledStackAllocator::dealloc(void *vp, size_t size) {
+    if (!vp) {
+        return;
+    }
+    ++m_deallocs;
+    size_t class_size = 0;
+    int cls           = sizeClass(size, class_size);
+    if (cls < 0) {
+        munmapStack(vp, size);
+        return;
+    }
+
+    ++m_cached;
+    ThreadCache *cache = getThreadCache();
+    if (!cache) {
+        if (!pushGlobal(cls, &vp, 1, class_size)) {
+            --m_cached;
+        }
+        return;
+    }
+
+    void **&stacks = cache->stacks[cls];
+    size_t &count  = cache->count[cls];
+    if (!stacks) {
+        stacks = new void *[m_threadCache];
+    }
+    if (count >= m_threadCache) {
+        //线程缓存已满，将一半归还到全局缓存
+        size_t n    = std::max<size_t>(1, count / 2);
+        size_t kept = pushGlobal(cls, stacks + count - n, n, class_size);
+        m_cached -= n - kept;
+        count -= n;
+    }
+    stacks[count++] = vp;
+}
+
+void PooledStackAllocator::flushThreadCache() {
+    if (!t_cache || t_cache->owner != this) {
+        return;
+    }
+    for (size_t i = 0; i < SIZE_CLASSES; ++i) {
+        size_t &count = t_cache->count[i];
+        if (count == 0) {
+            continue;
+        }
+        size_t kept = pushGlobal(i, t_cache->stacks[i], count, m_pageSize << i);
+        m_cached -= count - kept;
+        count = 0;
+    }
+}
+
+} // namespace sylar
@@ -0,0 +1,105 @@
+#ifndef MYSYLAR_STACK_ALLOCATOR_H
+#define MYSYLAR_STACK_ALLOCATOR_H
+
+#include "thread.h"
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace sylar {
+
+/* 协程栈分配器统计信息 */
+struct StackAllocStats {
+    uint64_t allocs;    //分配次数
+    uint64_t deallocs;  //释放次数
+    uint64_t sysAllocs; //向系统申请内存的次数(malloc/mmap)
+    uint64_t sysFrees;  //向系统归还内存的次数(free/munmap)
+    uint64_t cached;    //池中缓存的栈个数
+};
+
+/* 协程栈分配器接口，通过配置项fiber.stack_allocator选择实现 */
+class StackAllocator {
+public:
+    virtual ~StackAllocator() {}
+
+    virtual void *alloc(size_t size)             = 0;
+    virtual void dealloc(void *vp, size_t size) = 0;
+    virtual const char *getName() const          = 0;
+
+    StackAllocStats getStats() const;
+
+    /* 当前配置的分配器，配置项为"pool"或"malloc" */
+    static StackAllocator *GetDefault();
+    /* 按名称获取分配器，不存在时返回nullptr */
+    static StackAllocator *Get(const std::string &name);
+
+protected:
+    std::atomic<uint64_t> m_allocs{0};
+    std::atomic<uint64_t> m_deallocs{0};
+    std::atomic<uint64_t> m_sysAllocs{0};
+    std::atomic<uint64_t> m_sysFrees{0};
+    std::atomic<uint64_t> m_cached{0};
+};
+
+/* 每次都通过malloc/free申请和释放栈 */
+class MallocStackAllocator : public StackAllocator {
+public:
+    void *alloc(size_t size) override;
+    void dealloc(void *vp, size_t size) override;
+    const char *getName() const override { return "malloc"; }
+};
+
+/* 池化的协程栈分配器
+ * 栈通过mmap申请，最低地址处有一个不可访问的保护页，栈溢出时直接触发段错误而不是
+ * 破坏相邻内存。栈大小按页对齐后向上取整为2的幂，按大小分级缓存：每个线程每一级有一个
+ * 不需要加锁的空闲列表，线程缓存满时将一半归还到全局缓存，全局缓存有上限，超过上限时
+ * munmap
+ */
+class PooledStackAllocator : public StackAllocator {
+public:
+    /* 大小级别数，最小一级为一个页 */
+    static const size_t SIZE_CLASSES = 24;
+
+    /* thread_cache: 每个线程每一级最多缓存的栈个数
+     * global_cache: 全局缓存每一级最多缓存的栈个数
+     */
+    PooledStackAllocator(size_t thread_cache, size_t global_cache);
+
+    void *alloc(size_t size) override;
+    void dealloc(void *vp, size_t size) override;
+    const char *getName() const override { return "pool"; }
+
+    /* 将当前线程缓存的栈全部归还到全局缓存，线程退出时自动调用 */
+    void flushThreadCache();
+
+    /* 线程缓存，定义在cpp中 */
+    struct ThreadCache;
+
+private:
+    ThreadCache *getThreadCache();
+
+    /* 计算大小对应的级别及该级别的栈大小，超出最大级别时返回-1 */
+    int sizeClass(size_t size, size_t &class_size) const;
+
+    void *mmapStack(size_t class_size);
+    void munmapStack(void *vp, size_t class_size);
+
+    /* 从全局缓存批量取出/放入，返回实际个数 */
+    size_t popGlobal(int cls, void **stacks, size_t n);
+    size_t pushGlobal(int cls, void **stacks, size_t n, size_t class_size);
+
+private:
+    size_t m_pageSize;
+    int m_pageShift;
+    size_t m_threadCache;
+    size_t m_globalCache;
+
+    Mutex m_mutex;
+    std::vector<void *> m_global[SIZE_CLASSES]; //全局缓存，每一级一个数组
+};
+
+} // namespace sylar
+
+#endif // MYSYLAR_STACK_ALLOCATOR_H
@@ -7,7 +7,7 @@ int Stream::readFixsize(void *buffer, size_t length) {
     size_t left   = length;
 
     while (left > 0) {
-        size_t len = read((char *)buffer + offset, left);
+        int len = read((char *)buffer + offset, left);
         if (len <= 0) {
             return len;
         }
@@ -20,7 +20,7 @@ int Stream::readFixsize(void *buffer, size_t length) {
 int Stream::readFixsize(ByteArray::ptr ba, size_t length) {
     size_t left = length;
     while (left > 0) {
-        size_t len = read(ba, left);
+        int len = read(ba, left);
         if (len <= 0) {
             return len;
         }
@@ -33,7 +33,7 @@ int Stream::writeFixSize(const void *buffer, size_t length) {
     size_t offset = 0;
     size_t left   = length;
     while (left > 0) {
-        size_t len = write((const char *)buffer + offset, left);
+        int len = write((const char *)buffer + offset, left);
         if (len <= 0) {
             return len;
         }
@@ -46,7 +46,7 @@ int Stream::writeFixSize(const void *buffer, size_t length) {
 int Stream::writeFixSize(ByteArray::ptr ba, size_t length) {
     size_t left = length;
     while (left > 0) {
-        size_t len = write(ba, left);
+        int len = write(ba, left);
         if (len <= 0) {
             return len;
         }
@@ -1,35 +1,155 @@
 #include "tcp_server.h"
+#include "config.h"
 #include "log.h"
+#include "util.h"
+#include <chrono>
 #include <functional>
 #include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("tcpserver");
 
-TcpServer::TcpServer()
-    : m_name("sylar/1.0.0")
-    , m_isStop(true) {
+//是否使用复用端口模式，每个调度线程一个SO_REUSEPORT监听socket
+static ConfigVar<bool>::ptr g_tcp_server_reuseport =
+    ConfigManager::LookUp<bool>("tcp_server.reuseport", false,
+                                "tcp server SO_REUSEPORT per worker");
+
+//每次accept返回后最多接受的连接数，1表示不批量接受
+static ConfigVar<uint32_t>::ptr g_tcp_server_accept_batch =
+    ConfigManager::LookUp<uint32_t>("tcp_server.accept_batch", 1,
+                                    "tcp server accept batch size");
+
+//连接数上限，达到上限时暂停accept，0表示不限制
+static ConfigVar<uint32_t>::ptr g_tcp_server_max_connections =
+    ConfigManager::LookUp<uint32_t>("tcp_server.max_connections", 0,
+                                    "tcp server max connections");
+
+//处理连接的调度器待调度任务数上限，超过时暂停accept，0表示不限制
+static ConfigVar<uint32_t>::ptr g_tcp_server_max_queue_depth =
+    ConfigManager::LookUp<uint32_t>("tcp_server.max_queue_depth", 0,
+                                    "tcp server max worker queue depth");
+
+//暂停accept后检查是否恢复的间隔，单位ms
+static ConfigVar<uint32_t>::ptr g_tcp_server_accept_pause_interval =
+    ConfigManager::LookUp<uint32_t>("tcp_server.accept_pause_interval", 5,
+                                    "tcp server accept pause interval ms");
+
+//停止时等待已接受的连接处理完的时间，超时后shutdown剩余的连接，单位ms
+static ConfigVar<uint64_t>::ptr g_tcp_server_drain_timeout =
+    ConfigManager::LookUp<uint64_t>("tcp_server.drain_timeout", 10000,
+                                    "tcp server drain timeout ms");
+
+void ClientState::setBusy() {
+    int expect = IDLE;
+    m_state.compare_exchange_strong(expect, BUSY);
+}
+
+void ClientState::setIdle() {
+    int expect = BUSY;
+    if (m_state.compare_exchange_strong(expect, IDLE)) {
+        return;
+    }
+    if (expect == DRAINING) {
+        m_state = CLOSED;
+        shutdownRead();
+    }
+}
+
+void ClientState::drain() {
+    int expect = m_state;
+    while (true) {
+        if (expect == IDLE) {
+            if (m_state.compare_exchange_weak(expect, CLOSED)) {
+                shutdownRead();
+                return;
+            }
+        } else if (expect == BUSY) {
+            if (m_state.compare_exchange_weak(expect, DRAINING)) {
+                return;
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+void ClientState::shutdownRead() { ::shutdown(m_sock->getSocket(), SHUT_RD); }
+
+TcpServer::TcpServer(Scheduler *worker, Scheduler *accept_worker)
+    : m_worker(worker)
+    , m_acceptWorker(accept_worker)
+    , m_name("sylar/1.0.0")
+    , m_isStop(true)
+    , m_reusePort(g_tcp_server_reuseport->getValue())
+    , m_maxConnections(g_tcp_server_max_connections->getValue())
+    , m_maxQueueDepth(g_tcp_server_max_queue_depth->getValue())
+    , m_drainTimeout(g_tcp_server_drain_timeout->getValue()) {
     // g_logger->setLevel(LogLevel::UNKNOWN); //调试时打开
+    setAcceptBatch(g_tcp_server_accept_batch->getValue());
 }
 
-TcpServer::~TcpServer() { m_sock->close(); }
+TcpServer::~TcpServer() {
+    for (auto &i : m_socks) {
+        i->close();
+    }
+}
 
 bool TcpServer::bind(sylar::Address::ptr addr) {
-    m_sock = Socket::CreateTCP(addr);
-    if (!m_sock->bind(addr)) {
-        SYLAR_LOG_ERROR(g_logger)
-            << "bind fail errno=" << errno << "errstr=" << strerror(errno)
-            << "addr=[" << addr->toString() << "]";
-        return false;
+    std::vector<Address::ptr> addrs;
+    std::vector<Address::ptr> fails;
+    addrs.push_back(addr);
+    return bind(addrs, fails);
+}
+
+bool TcpServer::bind(const std::vector<Address::ptr> &addrs,
+                     std::vector<Address::ptr> &fails) {
+    size_t count = 1;
+    if (m_reusePort) {
+        count = m_worker ? m_worker->getThreadCount()
+                         : Scheduler::getDefaultThreadCount();
     }
+    std::vector<Socket::ptr> socks;
+    for (auto &addr : addrs) {
+        Address::ptr bind_addr = addr;
+        for (size_t i = 0; i < count; ++i) {
+            Socket::ptr sock = Socket::CreateTCP(bind_addr);
+            int val          = 1;
+            if (m_reusePort &&
+                !sock->setOption(SOL_SOCKET, SO_REUSEPORT, val)) {
+                fails.push_back(addr);
+                break;
+            }
+            if (!sock->bind(bind_addr)) {
+                SYLAR_LOG_ERROR(g_logger)
+                    << "bind fail errno=" << errno
+                    << "errstr=" << strerror(errno) << "addr=["
+                    << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
 
-    if (!m_sock->listen()) {
-        SYLAR_LOG_ERROR(g_logger) << "listen fail errno=" << errno
-                                  << "addr=" << addr->toString() << "]";
-        return false;
+            if (!sock->listen()) {
+                SYLAR_LOG_ERROR(g_logger) << "listen fail errno=" << errno
+                                          << "addr=" << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
+            //端口为0时由系统分配，其余监听socket绑定到同一个端口
+            bind_addr = sock->getLocalAddress();
+            socks.push_back(sock);
+        }
     }
 
+    if (!fails.empty()) {
+        for (auto &i : socks) {
+            i->close();
+        }
+        return false;
+    }
+    m_socks.insert(m_socks.end(), socks.begin(), socks.end());
     return true;
 }
 
@@ -38,33 +158,227 @@ bool TcpServer::start() {
         return true;
     }
     m_isStop = false;
-    m_acceptWorker.schedule(
-        std::bind(&TcpServer::startAccept, shared_from_this(), m_sock));
-    m_acceptWorker.start();
-    m_worker.start();
+    if (m_reusePort) {
+        for (size_t i = 0; i < m_socks.size(); ++i) {
+            Scheduler *worker =
+                new Scheduler(m_name + "_reuseport_" + std::to_string(i), 1);
+            m_reusePortWorkers.emplace_back(worker);
+            worker->schedule(std::bind(&TcpServer::startAccept,
+                                       shared_from_this(), m_socks[i]));
+            worker->start();
+        }
+        return true;
+    }
+
+    /* 未传入的调度器在这里创建，复用端口模式下不使用，不创建 */
+    if (!m_worker) {
+        m_ownWorker.reset(new Scheduler("tcp_worker"));
+        m_worker = m_ownWorker.get();
+    }
+    if (!m_acceptWorker) {
+        //每个监听socket只有一个accept协程，一个线程足够
+        m_ownAcceptWorker.reset(new Scheduler("tcp_accept", 1));
+        m_acceptWorker = m_ownAcceptWorker.get();
+    }
+    for (auto &i : m_socks) {
+        m_acceptWorker->schedule(
+            std::bind(&TcpServer::startAccept, shared_from_this(), i));
+    }
+    if (m_ownAcceptWorker) {
+        m_ownAcceptWorker->start();
+    }
+    if (m_ownWorker) {
+        m_ownWorker->start();
+    }
     return true;
 }
 
+/* 在接受连接的调度器内关闭监听socket，hook的close会唤醒阻塞在accept上的协程，使accept
+ * 循环退出，之后排空已接受的连接再停止自己创建的调度器，外部传入的调度器不停止。
+ * 强制停止会在协程栈上取消线程，无法正常退出
+ */
 void TcpServer::stop() {
-    m_isStop = true;
-    m_acceptWorker.stop(true);
-    m_worker.stop(true);
+    if (m_isStop.exchange(true)) {
+        return;
+    }
+    auto self   = shared_from_this();
+    m_listening = m_socks.size();
+    if (m_reusePort) {
+        for (size_t i = 0; i < m_socks.size(); ++i) {
+            Socket::ptr sock  = m_socks[i];
+            Scheduler *worker = m_reusePortWorkers[i].get();
+            worker->schedule([self, sock, worker](void *) {
+                self->closeListener(sock, worker);
+            });
+        }
+        drain();
+        for (auto &i : m_reusePortWorkers) {
+            i->stop();
+        }
+        return;
+    }
+    for (auto &i : m_socks) {
+        Socket::ptr sock = i;
+        m_acceptWorker->schedule([self, sock](void *) {
+            self->closeListener(sock, self->m_worker);
+        });
+    }
+    drain();
+    if (m_ownAcceptWorker) {
+        m_ownAcceptWorker->stop();
+    }
+    if (m_ownWorker) {
+        m_ownWorker->stop();
+    }
+}
+
+void TcpServer::closeListener(Socket::ptr sock, Scheduler *worker) {
+    std::vector<std::function<void(void *)>> clients;
+    while (Socket::ptr client = sock->tryAccept()) {
+        addClient(client);
+        clients.push_back(
+            std::bind(&TcpServer::onClient, shared_from_this(), client));
+    }
+    worker->schedule(clients.begin(), clients.end());
+    sock->close();
+    Mutex::Lock lock(m_clientsMutex);
+    --m_listening;
+    m_drainCond.notify_all();
+}
+
+void TcpServer::drain() {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(m_drainTimeout);
+    Mutex::Lock lock(m_clientsMutex);
+    //空闲的连接没有正在处理的请求，立即shutdown读端，之后加入的连接在addClient中处理
+    for (auto &i : m_clients) {
+        i.second->drain();
+    }
+    //等待监听socket关闭及正在处理请求的连接结束，由closeListener和onClient通知
+    while (m_listening > 0 || m_connections > 0) {
+        if (m_drainCond.wait_until(lock, deadline) ==
+            std::cv_status::timeout) {
+            break;
+        }
+    }
+    if (m_connections == 0) {
+        return;
+    }
+    SYLAR_LOG_WARN(g_logger) << "drain timeout, shutdown " << m_clients.size()
+                             << " connections";
+    for (auto &i : m_clients) {
+        ::shutdown(i.first->getSocket(), SHUT_RDWR);
+    }
+}
+
+size_t TcpServer::getQueueDepth() const {
+    if (!m_reusePort) {
+        return m_worker ? m_worker->getTaskCount() : 0;
+    }
+    size_t depth = 0;
+    for (auto &i : m_reusePortWorkers) {
+        depth += i->getTaskCount();
+    }
+    return depth;
+}
+
+bool TcpServer::isOverloaded(Scheduler *worker, size_t pending) const {
+    if (m_maxConnections && m_connections >= m_maxConnections) {
+        return true;
+    }
+    return m_maxQueueDepth &&
+           worker->getTaskCount() + pending >= m_maxQueueDepth;
+}
+
+void TcpServer::waitForCapacity(Scheduler *worker) {
+    if (!isOverloaded(worker, 0)) {
+        return;
+    }
+    ++m_acceptPauses;
+    SYLAR_LOG_DEBUG(g_logger)
+        << "pause accept, connections=" << m_connections
+        << " queue_depth=" << worker->getTaskCount();
+    /* 定时检查，不在连接关闭时唤醒，避免处理连接的路径上增加额外的开销。accept协程
+     * 在调度线程中执行，hook的usleep只让出当前协程
+     */
+    while (!m_isStop && isOverloaded(worker, 0)) {
+        usleep(g_tcp_server_accept_pause_interval->getValue() * 1000);
+    }
 }
 
 void TcpServer::startAccept(Socket::ptr sock) {
+    //复用端口模式下连接由接受它的调度器处理
+    Scheduler *worker = m_reusePort ? Scheduler::getThis() : m_worker;
+    std::vector<std::function<void(void *)>> clients;
     while (!m_isStop) {
+        waitForCapacity(worker);
+        if (m_isStop) {
+            break;
+        }
         SYLAR_LOG_DEBUG(g_logger) << "start accept:" << *sock;
         Socket::ptr client = sock->accept();
+        if (!client) {
+            if (!m_isStop) {
+                SYLAR_LOG_ERROR(g_logger) << "accept errno=" << errno
+                                          << "errstr=" << strerror(errno);
+            }
+            continue;
+        }
         SYLAR_LOG_DEBUG(g_logger) << "accepted:" << *client;
-        if (client) {
-            m_worker.schedule(std::bind(&TcpServer::handleClient,
-                                        shared_from_this(), client));
-        } else {
-            SYLAR_LOG_ERROR(g_logger)
-                << "accept errno=" << errno << "errstr=" << strerror(errno);
+        addClient(client);
+        if (m_acceptBatch <= 1) {
+            worker->schedule(
+                std::bind(&TcpServer::onClient, shared_from_this(), client));
+            continue;
+        }
+
+        /* 批量接受已完成握手的连接，一次性加入调度，减少accept让出协程及唤醒调度线程的
+         * 次数
+         */
+        clients.clear();
+        clients.push_back(
+            std::bind(&TcpServer::onClient, shared_from_this(), client));
+        while (clients.size() < m_acceptBatch &&
+               !isOverloaded(worker, clients.size())) {
+            client = sock->tryAccept();
+            if (!client) {
+                break;
+            }
+            addClient(client);
+            clients.push_back(
+                std::bind(&TcpServer::onClient, shared_from_this(), client));
         }
+        worker->schedule(clients.begin(), clients.end());
+    }
+}
+
+void TcpServer::addClient(Socket::ptr client) {
+    ClientState::ptr state(new ClientState(client));
+    Mutex::Lock lock(m_clientsMutex);
+    //排空时closeListener接受的监听队列中剩余的连接
+    if (m_isStop) {
+        state->drain();
+    }
+    m_clients[client] = state;
+    ++m_connections;
+}
+
+void TcpServer::onClient(Socket::ptr client) {
+    handleClient(client);
+    Mutex::Lock lock(m_clientsMutex);
+    m_clients.erase(client);
+    --m_connections;
+    if (m_isStop) {
+        m_drainCond.notify_all();
     }
 }
+
+ClientState::ptr TcpServer::getClientState(Socket::ptr client) {
+    Mutex::Lock lock(m_clientsMutex);
+    auto it = m_clients.find(client);
+    return it == m_clients.end() ? nullptr : it->second;
+}
+
 void TcpServer::handleClient(Socket::ptr client) {
     SYLAR_LOG_INFO(g_logger) << "handleClient:" << *client;
     client->close();
@@ -4,33 +4,147 @@
 #include "address.h"
 #include "scheduler.h"
 #include "socket.h"
+#include <atomic>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <vector>
 
 namespace sylar {
 
+/* 连接的处理状态，只使用原子操作。处理连接的协程开始等待请求时标记为空闲，收到请求
+ * 数据后标记为忙，处理完请求后再标记为空闲；排空时空闲的连接立即shutdown读端，忙的
+ * 连接在处理完当前请求、标记为空闲时shutdown读端，不用等到排空超时。handleClient
+ * 没有标记的连接一直视为忙，排空时等待其结束
+ */
+class ClientState {
+public:
+    typedef std::shared_ptr<ClientState> ptr;
+    ClientState(Socket::ptr sock) : m_sock(sock), m_state(BUSY) {}
+
+    Socket::ptr getSocket() const { return m_sock; }
+    /* 收到请求数据，开始处理请求 */
+    void setBusy();
+    /* 当前请求处理完，等待下一个请求，排空已开始时shutdown读端 */
+    void setIdle();
+    /* 开始排空，空闲时立即shutdown读端，忙时在setIdle时shutdown */
+    void drain();
+
+private:
+    enum State {
+        IDLE,     //等待请求
+        BUSY,     //正在处理请求
+        DRAINING, //正在处理请求，处理完后shutdown读端
+        CLOSED    //已shutdown读端
+    };
+    /* shutdown读端，只shutdown不close，阻塞在读上的协程返回，fd仍由处理连接的协程关闭 */
+    void shutdownRead();
+
+private:
+    Socket::ptr m_sock;
+    std::atomic<int> m_state;
+};
+
 class TcpServer : public std::enable_shared_from_this<TcpServer> {
 public:
     typedef std::shared_ptr<TcpServer> ptr;
-    TcpServer();
+    /* worker: 处理连接的调度器，accept_worker: 接受连接的调度器
+     * 传入的调度器由调用者负责启动和停止，多个TcpServer可以共用同一组调度器；为nullptr
+     * 时TcpServer自己创建，worker使用scheduler.threads个线程，accept_worker一个线程
+     */
+    TcpServer(Scheduler *worker = nullptr, Scheduler *accept_worker = nullptr);
     virtual ~TcpServer();
+    /* 复用端口模式下为每个调度线程创建一个监听socket，否则只创建一个 */
     virtual bool bind(sylar::Address::ptr addr);
+    /* 绑定多个地址，失败的地址放入fails，有失败时已绑定的地址也一并关闭并返回false */
+    virtual bool bind(const std::vector<Address::ptr> &addrs,
+                      std::vector<Address::ptr> &fails);
     virtual bool start();
+    /* 排空并停止：关闭监听socket不再接受新连接，空闲的连接立即shutdown读端，等待正在
+     * 处理请求的连接处理完，超过排空时间后shutdown剩余的连接，使阻塞在读写上的协程返回，
+     * 最后停止自己创建的调度器。会阻塞调用线程，不要在处理连接的调度线程中调用
+     */
     virtual void stop();
 
     void setName(const std::string &v) { m_name = v; }
     std::string getName() const { return m_name; }
+    /* 已调用stop()，handleClient可据此在处理完当前请求后结束连接 */
     bool isStop() const { return m_isStop; }
+    /* 排空时间，单位ms，0表示不等待，立即shutdown剩余的连接 */
+    void setDrainTimeout(uint64_t v) { m_drainTimeout = v; }
+    uint64_t getDrainTimeout() const { return m_drainTimeout; }
+
+    /* 复用端口模式：每个调度线程一个SO_REUSEPORT监听socket和一个单线程调度器，
+     * 由内核分配连接，每个调度器只处理自己接受的连接，需要在bind之前设置。
+     * 该模式下worker只用于确定线程数(未传入时为scheduler.threads)，不使用worker和
+     * accept_worker调度
+     */
+    void setReusePort(bool v) { m_reusePort = v; }
+    bool isReusePort() const { return m_reusePort; }
+    /* 每次accept返回后，最多再用accept4非阻塞地接受的连接数之和，1表示不批量接受 */
+    void setAcceptBatch(uint32_t v) { m_acceptBatch = v ? v : 1; }
+    uint32_t getAcceptBatch() const { return m_acceptBatch; }
+
+    /* 连接数上限，已接受且handleClient未返回的连接数达到上限时暂停accept，新连接留在
+     * 内核的监听队列中，0表示不限制
+     */
+    void setMaxConnections(uint32_t v) { m_maxConnections = v; }
+    uint32_t getMaxConnections() const { return m_maxConnections; }
+    /* 处理连接的调度器待调度任务数超过该值时暂停accept，0表示不限制 */
+    void setMaxQueueDepth(uint32_t v) { m_maxQueueDepth = v; }
+    uint32_t getMaxQueueDepth() const { return m_maxQueueDepth; }
+
+    /* 当前连接数，包括已接受但还未开始处理的连接 */
+    uint64_t getConnectionCount() const { return m_connections; }
+    /* 处理连接的调度器当前待调度的任务数 */
+    size_t getQueueDepth() const;
+    /* 因超过上限暂停accept的次数 */
+    uint64_t getAcceptPauseCount() const { return m_acceptPauses; }
 
 protected:
     virtual void handleClient(Socket::ptr client);
     virtual void startAccept(Socket::ptr sock);
+    /* 连接的处理状态，handleClient开始时获取一次，之后通过它标记连接是否空闲，不再加锁 */
+    ClientState::ptr getClientState(Socket::ptr client);
 
 private:
-    Socket::ptr m_sock;
-    Scheduler m_worker;
-    Scheduler m_acceptWorker;
+    /* 接受连接后记录连接，连接数加一 */
+    void addClient(Socket::ptr client);
+    /* 调用handleClient，返回后删除连接，连接数减一 */
+    void onClient(Socket::ptr client);
+    /* 关闭监听socket前把监听队列中已完成握手的连接接受下来，避免被内核重置 */
+    void closeListener(Socket::ptr sock, Scheduler *worker);
+    /* 等待连接处理完，超时后shutdown剩余的连接 */
+    void drain();
+    /* 连接数或队列长度超过上限时暂停accept，直到低于上限或服务器停止 */
+    void waitForCapacity(Scheduler *worker);
+    /* pending: 已接受但还未加入调度的连接数 */
+    bool isOverloaded(Scheduler *worker, size_t pending) const;
+
+private:
+    std::vector<Socket::ptr> m_socks; //监听socket
+    Scheduler *m_worker;              //处理连接的调度器
+    Scheduler *m_acceptWorker;        //接受连接的调度器
+    /* 未传入调度器时在start中创建的调度器，由TcpServer启动和停止，复用端口模式下不创建 */
+    std::unique_ptr<Scheduler> m_ownWorker;
+    std::unique_ptr<Scheduler> m_ownAcceptWorker;
+    /* 复用端口模式下每个监听socket对应的单线程调度器 */
+    std::vector<std::unique_ptr<Scheduler>> m_reusePortWorkers;
     std::string m_name;
-    bool m_isStop;
+    std::atomic<bool> m_isStop;
+    bool m_reusePort;
+    uint32_t m_acceptBatch;
+    uint32_t m_maxConnections;
+    uint32_t m_maxQueueDepth;
+    std::atomic<uint64_t> m_connections{0};  //当前连接数
+    std::atomic<uint64_t> m_acceptPauses{0}; //暂停accept的次数
+    std::atomic<size_t> m_listening{0};      //排空时尚未关闭的监听socket数
+    uint64_t m_drainTimeout;                 //排空时间，单位ms
+    Mutex m_clientsMutex;
+    /* 当前连接及其处理状态，只在连接建立和结束时加锁，排空时shutdown */
+    std::map<Socket::ptr, ClientState::ptr> m_clients;
+    /* 排空时等待监听socket关闭及连接结束 */
+    std::condition_variable_any m_drainCond;
 };
 
 } // namespace sylar
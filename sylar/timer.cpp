@@ -1,26 +1,232 @@
 #include "timer.h"
 #include "log.h"
 #include "macro.h"
-#include "scheduler.h"
-#include <sys/timerfd.h>
+#include "util.h"
+#include <string.h>
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
 namespace sylar {
 
-void Timer::initTimer(long timeout, ScheduleTask task) {
-    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    SYLAR_ASSERT(fd > 0);
+bool Timer::cancel() {
+    //m_self在锁内被时间轮修改，这里不读取，由delTimer在锁内重新检查m_manager
+    TimerManager *manager = m_manager;
+    if (!manager) {
+        return false;
+    }
+    return manager->delTimer(shared_from_this());
+}
+
+TimerManager::TimerManager()
+    : m_currentTick(GetCurrentMS())
+    , m_nextWake(~0ull) {
+    memset(m_tv1, 0, sizeof(m_tv1));
+    memset(m_tvn, 0, sizeof(m_tvn));
+}
+
+TimerManager::~TimerManager() {
+    //释放时间轮中剩余定时器对自身的引用
+    std::vector<Timer::ptr> timers;
+    {
+        MutexType::Lock lock(m_mutex);
+        for (size_t i = 0; i < TVR_SIZE; ++i) {
+            while (m_tv1[i]) {
+                Timer *timer = m_tv1[i];
+                timers.push_back(std::move(timer->m_self));
+                delTimerLocked(timer);
+            }
+        }
+        for (int l = 0; l < TVN_LEVELS; ++l) {
+            for (size_t i = 0; i < TVN_SIZE; ++i) {
+                while (m_tvn[l][i]) {
+                    Timer *timer = m_tvn[l][i];
+                    timers.push_back(std::move(timer->m_self));
+                    delTimerLocked(timer);
+                }
+            }
+        }
+    }
+}
+
+bool TimerManager::addTimer(Timer::ptr timer) {
+    if (!timer || (!timer->m_task.fiber && !timer->m_task.cb)) {
+        SYLAR_LOG_ERROR(g_logger) << "invalid timer";
+        return false;
+    }
+
+    MutexType::Lock lock(m_mutex);
+    if (timer->m_manager) {
+        //已添加的定时器先移除，重新计算超时时间
+        delTimerLocked(timer.get());
+    }
+    timer->m_expire = GetCurrentMS() + timer->m_ms;
+    timer->m_self   = timer;
+    addTimerLocked(timer.get());
+
+    if (timer->m_expire < m_nextWake) {
+        m_nextWake = timer->m_expire;
+        return true;
+    }
+    return false;
+}
+
+bool TimerManager::delTimer(Timer::ptr timer) {
+    Timer::ptr self;
+    MutexType::Lock lock(m_mutex);
+    if (!timer || timer->m_manager != this) {
+        return false;
+    }
+    //在锁外释放定时器自身的引用，避免定时器在持锁时析构
+    self.swap(timer->m_self);
+    delTimerLocked(timer.get());
+    return true;
+}
+
+void TimerManager::addTimerLocked(Timer *timer) {
+    uint64_t expire = timer->m_expire;
+    if (expire < m_currentTick) {
+        expire = m_currentTick;
+    }
+
+    uint64_t delta = expire - m_currentTick;
+    Timer **slot   = nullptr;
+    if (delta < TVR_SIZE) {
+        slot = &m_tv1[expire & (TVR_SIZE - 1)];
+    } else if (delta < (1ull << (TVR_BITS + TVN_BITS))) {
+        slot = &m_tvn[0][(expire >> TVR_BITS) & (TVN_SIZE - 1)];
+    } else if (delta < (1ull << (TVR_BITS + 2 * TVN_BITS))) {
+        slot = &m_tvn[1][(expire >> (TVR_BITS + TVN_BITS)) & (TVN_SIZE - 1)];
+    } else {
+        //超出时间轮范围的定时器放在最后一层的最远位置，下降时再按实际超时时间放置
+        uint64_t max_delta = (1ull << (TVR_BITS + 3 * TVN_BITS)) - 1;
+        if (delta > max_delta) {
+            expire = m_currentTick + max_delta;
+        }
+        slot =
+            &m_tvn[2][(expire >> (TVR_BITS + 2 * TVN_BITS)) & (TVN_SIZE - 1)];
+    }
+
+    timer->m_manager = this;
+    timer->m_slot    = slot;
+    timer->m_prev    = nullptr;
+    timer->m_next    = *slot;
+    if (*slot) {
+        (*slot)->m_prev = timer;
+    }
+    *slot = timer;
+    ++m_count;
+}
+
+void TimerManager::delTimerLocked(Timer *timer) {
+    if (timer->m_prev) {
+        timer->m_prev->m_next = timer->m_next;
+    } else {
+        *timer->m_slot = timer->m_next;
+    }
+    if (timer->m_next) {
+        timer->m_next->m_prev = timer->m_prev;
+    }
+    timer->m_manager = nullptr;
+    timer->m_slot    = nullptr;
+    timer->m_prev    = nullptr;
+    timer->m_next    = nullptr;
+    --m_count;
+}
+
+void TimerManager::cascade(int level, size_t index) {
+    Timer *timer        = m_tvn[level][index];
+    m_tvn[level][index] = nullptr;
+    while (timer) {
+        Timer *next = timer->m_next;
+        --m_count; //addTimerLocked会重新计数
+        addTimerLocked(timer);
+        timer = next;
+    }
+}
+
+uint64_t TimerManager::getNextTimeout() {
+    MutexType::Lock lock(m_mutex);
+    if (m_count == 0) {
+        m_nextWake = ~0ull;
+        return ~0ull;
+    }
+
+    uint64_t now = GetCurrentMS();
+    if (m_currentTick <= now) {
+        m_nextWake = now;
+        return 0;
+    }
 
-    struct itimerspec ts = {0};
-    ts.it_value.tv_sec   = timeout / 1000;
-    ts.it_value.tv_nsec  = (timeout % 1000) * 1000 * 1000;
+    //在第一层当前这一圈内查找最近的非空槽位，找不到时在这一圈结束时唤醒，进行下降
+    uint64_t end = m_currentTick | (TVR_SIZE - 1);
+    uint64_t tick = m_currentTick;
+    for (; tick <= end; ++tick) {
+        if (m_tv1[tick & (TVR_SIZE - 1)]) {
+            break;
+        }
+    }
+    m_nextWake = tick;
+    return tick - now;
+}
+
+void TimerManager::listExpired(std::vector<ScheduleTask> &tasks) {
+    std::vector<Timer::ptr> expired;
+    uint64_t now = GetCurrentMS();
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_count == 0) {
+            m_currentTick = now + 1;
+            return;
+        }
+
+        while (m_currentTick <= now) {
+            size_t index = m_currentTick & (TVR_SIZE - 1);
+            if (index == 0) {
+                //第一层走完一圈，依次将上层的定时器下降
+                for (int l = 0; l < TVN_LEVELS; ++l) {
+                    size_t idx = (m_currentTick >> (TVR_BITS + l * TVN_BITS)) &
+                                 (TVN_SIZE - 1);
+                    cascade(l, idx);
+                    if (idx != 0) {
+                        break;
+                    }
+                }
+            }
+
+            while (Timer *timer = m_tv1[index]) {
+                Timer::ptr self;
+                self.swap(timer->m_self);
+                delTimerLocked(timer);
+                tasks.push_back(timer->m_task);
+                if (timer->m_recurring) {
+                    /* 至少推迟到下一毫秒，否则0ms的循环定时器会重新落到当前槽位，
+                     * 在持锁时死循环
+                     */
+                    timer->m_expire = now + (timer->m_ms ? timer->m_ms : 1);
+                    timer->m_self   = self;
+                    addTimerLocked(timer);
+                } else {
+                    expired.push_back(self);
+                }
+            }
+            ++m_currentTick;
 
-    int rt = timerfd_settime(fd, 0, &ts, nullptr);
-    SYLAR_ASSERT(rt == 0);
+            if (m_count == 0) {
+                m_currentTick = now + 1;
+                break;
+            }
+        }
+    }
+}
+
+bool TimerManager::hasTimer() {
+    MutexType::Lock lock(m_mutex);
+    return m_count > 0;
+}
 
-    m_fd   = fd;
-    m_task = task;
+size_t TimerManager::getTimerCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_count;
 }
 
-} // end namespace sylar
\ No newline at end of file
+} // end namespace sylar
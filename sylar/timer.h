@@ -3,10 +3,10 @@
 
 #include "fiber.h"
 #include "thread.h"
-#include <fcntl.h>
+#include <atomic>
 #include <iostream>
 #include <memory>
-#include <unistd.h>
+#include <vector>
 
 namespace sylar {
 
@@ -18,7 +18,10 @@ struct ScheduleTask {
     std::function<void(void *)> cb;
     void *arg;
 
-    ScheduleTask(Fiber::ptr f, void *_arg = nullptr) { fiber = f; }
+    ScheduleTask(Fiber::ptr f, void *_arg = nullptr) {
+        fiber = f;
+        arg   = nullptr;
+    }
     ScheduleTask(std::function<void(void *)> f, void *_arg = nullptr) {
         cb  = f;
         arg = _arg;
@@ -38,7 +41,12 @@ struct ScheduleTask {
     }
 };
 
-class Timer {
+class TimerManager;
+
+/* 定时器，由TimerManager的时间轮管理，超时后将任务加入协程调度 */
+class Timer : public std::enable_shared_from_this<Timer> {
+    friend class TimerManager;
+
 public:
     typedef std::shared_ptr<Timer> ptr;
 
@@ -46,30 +54,91 @@ public:
     /* 初始化定时器
      * timeout: 超时时间，单位ms
      * fc: 超时时的执行对象
+     * recurring: 是否循环定时器，循环定时器每隔timeout毫秒执行一次，直到被取消
      */
-    template <class FiberOrCb> Timer(long timeout, FiberOrCb cb) {
-        ScheduleTask task(cb);
-        if (task.fiber || task.cb) {
-            initTimer(timeout, task);
-        }
-    }
-
-    ~Timer() { close(m_fd); }
+    template <class FiberOrCb>
+    Timer(uint64_t timeout, FiberOrCb cb, bool recurring = false)
+        : m_ms(timeout)
+        , m_recurring(recurring)
+        , m_task(cb) {}
 
-    int getFd() { return m_fd; }
     ScheduleTask getTask() { return m_task; }
+    uint64_t getTimeout() const { return m_ms; }
+    bool isRecurring() const { return m_recurring; }
+    /* 定时器是否已添加到时间轮且尚未超时或取消 */
+    bool isPending() const { return m_manager != nullptr; }
 
-private:
-    void initTimer(long timeout, ScheduleTask task);
+    /* 取消定时器，定时器未添加或已经超时(非循环定时器)时返回false，可以与时间轮的
+     * 推进并发调用，在TimerManager的锁内判断定时器是否仍在时间轮中
+     */
+    bool cancel();
 
+private:
     //禁止拷贝
     Timer(const Timer &)  = delete;
     Timer(const Timer &&) = delete;
     Timer operator=(const Timer &) = delete;
 
 private:
-    int m_fd;
-    ScheduleTask m_task;
+    uint64_t m_ms;       //超时时间
+    bool m_recurring;    //是否循环定时器
+    uint64_t m_expire;   //超时的绝对时间，单位ms
+    ScheduleTask m_task; //超时时的执行对象
+
+    /* 时间轮槽位的侵入式双向链表，用于O(1)添加和删除，只在TimerManager的锁内修改，
+     * m_manager可以在锁外读取
+     */
+    std::atomic<TimerManager *> m_manager{nullptr};
+    Timer **m_slot          = nullptr; //所在槽位的链表头
+    Timer *m_prev           = nullptr;
+    Timer *m_next           = nullptr;
+    Timer::ptr m_self; //定时器在时间轮中时持有自身引用，超时或取消后释放
+};
+
+/* 分层时间轮定时器管理，精度为1ms，添加和取消定时器都是O(1)
+ * 第一层256个槽位，每个槽位1ms，后三层各64个槽位，每个槽位为上一层的一圈，总共可覆盖
+ * 2^26ms(约18.6小时)，更长的定时器先放在最后一层，逐层下降时再重新计算位置
+ */
+class TimerManager {
+public:
+    typedef Mutex MutexType;
+
+    TimerManager();
+    ~TimerManager();
+
+    /* 添加定时器，返回true表示该定时器早于当前idle线程的唤醒时间，需要tickle */
+    bool addTimer(Timer::ptr timer);
+    /* 取消定时器，定时器不在时间轮中时返回false */
+    bool delTimer(Timer::ptr timer);
+
+    /* 距离下一次需要处理时间轮的毫秒数，无定时器时返回~0ull */
+    uint64_t getNextTimeout();
+    /* 推进时间轮到当前时间，将所有超时定时器的任务取出，循环定时器会被重新添加 */
+    void listExpired(std::vector<ScheduleTask> &tasks);
+
+    bool hasTimer();
+    size_t getTimerCount();
+
+private:
+    void addTimerLocked(Timer *timer);
+    void delTimerLocked(Timer *timer);
+    /* 将第level层index槽位上的定时器重新放置到更低层 */
+    void cascade(int level, size_t index);
+
+private:
+    static const int TVR_BITS   = 8;
+    static const int TVN_BITS   = 6;
+    static const size_t TVR_SIZE = 1 << TVR_BITS;
+    static const size_t TVN_SIZE = 1 << TVN_BITS;
+    static const int TVN_LEVELS = 3;
+
+    MutexType m_mutex;
+    uint64_t m_currentTick; //下一个待处理的tick，即时间轮当前指针，单位ms
+    uint64_t m_nextWake;    //idle线程预计唤醒的tick，早于此时间的定时器需要tickle
+    size_t m_count = 0;     //时间轮中的定时器个数
+
+    Timer *m_tv1[TVR_SIZE];             //第一层
+    Timer *m_tvn[TVN_LEVELS][TVN_SIZE]; //后三层
 };
 
 } // end namespace sylar
@@ -6,10 +6,20 @@ sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
 namespace sylar {
 
-pid_t GetThreadId() { return syscall(SYS_gettid); }
+pid_t GetThreadId() {
+    //每条日志都会调用，缓存在线程局部变量中避免系统调用
+    static thread_local pid_t t_tid = syscall(SYS_gettid);
+    return t_tid;
+}
 
 uint32_t GetFiberId() { return sylar::Fiber::GetFiberId(); }
 
+uint64_t GetCurrentMS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+
 void Backtrace(std::vector<std::string> &bt, int size, int skip) {
     void **array = (void **)malloc(sizeof(void *) * size);
     size_t s     = ::backtrace(array, size);
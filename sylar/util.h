@@ -8,6 +8,7 @@
 #include <string>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include <vector>
 
@@ -16,6 +17,9 @@ namespace sylar {
 pid_t GetThreadId();
 uint32_t GetFiberId();
 
+//单调时钟的当前时间，单位ms
+uint64_t GetCurrentMS();
+
 void Backtrace(std::vector<std::string> &bt, int size, int skip = 1);
 std::string BacktraceToString(int size, int skip = 2,
                               const std::string &prefix = "");
@@ -0,0 +1,91 @@
+#ifndef MYSYLAR_WORK_STEALING_QUEUE_H
+#define MYSYLAR_WORK_STEALING_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sylar {
+
+/* 有界无锁工作窃取队列，单生产者多消费者的FIFO环形队列
+ * 只有队列所属线程可以调用push，从bottom端压入；所有线程（包括所属线程）都通过steal
+ * 用CAS从top端按FIFO顺序取出。push和steal的实现与Chase-Lev deque相同，但没有所属线程
+ * 从bottom端LIFO弹出的pop，因此不是双端队列。队列中保存的是指针，元素的创建和释放由
+ * 使用者负责
+ * 参考：Lê et al. "Correct and Efficient Work-Stealing for Weak Memory Models"
+ */
+template <class T> class WorkStealingQueue {
+public:
+    /* capacity: 队列容量，会向上取整为2的幂 */
+    WorkStealingQueue(size_t capacity = 1024) {
+        m_capacity = 1;
+        while (m_capacity < capacity) {
+            m_capacity <<= 1;
+        }
+        m_mask = m_capacity - 1;
+        m_buffer.reset(new std::atomic<T *>[m_capacity]);
+        for (size_t i = 0; i < m_capacity; ++i) {
+            m_buffer[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    /* 所属线程从bottom端压入元素，队列已满时返回false */
+    bool push(T *item) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if (b - t >= (int64_t)m_capacity) {
+            return false;
+        }
+        m_buffer[b & m_mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /* 任意线程从top端窃取元素(FIFO)，队列为空或竞争失败时返回nullptr */
+    T *steal() {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+
+        T *item = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                           std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    /* 队列中的元素个数，并发访问时只是一个近似值 */
+    size_t size() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return m_capacity; }
+
+private:
+    //禁止拷贝
+    WorkStealingQueue(const WorkStealingQueue &) = delete;
+    WorkStealingQueue &operator=(const WorkStealingQueue &) = delete;
+
+private:
+    //top和bottom分别被取出线程和所属线程频繁修改，用填充字节放在不同的cache line上
+    std::atomic<int64_t> m_top{0};
+    char m_pad1[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> m_bottom{0};
+    char m_pad2[64 - sizeof(std::atomic<int64_t>)];
+    std::unique_ptr<std::atomic<T *>[]> m_buffer;
+    size_t m_capacity;
+    size_t m_mask;
+};
+
+} // end namespace sylar
+
+#endif
@@ -0,0 +1,221 @@
+#include "sylar/fcontext.h"
+#include "sylar/sylar.h"
+#include "sylar/stack_allocator.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <ucontext.h>
+
+// 协程性能测试，对比malloc和池化两种协程栈分配器，以及ucontext和汇编两种上下文切换方式
+// 1. 顺序创建、运行、销毁协程，统计每个协程的平均耗时、向系统申请内存的次数及缺页次数
+// 2. 每轮同时存在多个协程，模拟连接的建立和断开
+// 3. 一个线程释放的栈归还到全局缓存后，其他线程首次分配时能直接复用
+// 4. 一次resume/yield的耗时，以及直接调用swapcontext和汇编切换的耗时
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int FIBER_COUNT    = 100000;     //顺序创建的协程数
+static const int BATCH_SIZE     = 256;        //每轮同时存在的协程数
+static const int BATCH_ROUND    = 400;        //轮数
+static const int SWITCH_COUNT   = 1000000;    //切换测试的切换次数
+static const size_t STACK_SIZE  = 128 * 1024; //切换测试的栈大小
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+static long minor_faults() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+void fiber_func(void *arg) {
+    //使用一部分栈空间，模拟真实的协程
+    volatile char buf[8192];
+    memset((char *)buf, 0, sizeof(buf));
+    if (arg) {
+        sylar::Fiber::GetThis()->yield();
+    }
+}
+
+void report(const char *name, const char *allocator, uint64_t count,
+            uint64_t used_ns, const sylar::StackAllocStats &begin,
+            long faults) {
+    sylar::StackAllocStats end =
+        sylar::StackAllocator::Get(allocator)->getStats();
+    SYLAR_LOG_INFO(g_logger)
+        << name << " allocator=" << allocator << " fibers=" << count
+        << " create+run+destroy=" << used_ns / count << "ns"
+        << " sys_allocs=" << end.sysAllocs - begin.sysAllocs
+        << " sys_frees=" << end.sysFrees - begin.sysFrees
+        << " page_faults=" << faults;
+}
+
+void bench_sequential(const char *allocator) {
+    sylar::ConfigManager::LookUp<std::string>("fiber.stack_allocator")
+        ->setValue(allocator);
+    sylar::StackAllocStats stats =
+        sylar::StackAllocator::Get(allocator)->getStats();
+    long faults    = minor_faults();
+    uint64_t begin = now_ns();
+    for (int i = 0; i < FIBER_COUNT; ++i) {
+        sylar::Fiber::ptr fiber(new sylar::Fiber(&fiber_func));
+        fiber->resume();
+    }
+    uint64_t used = now_ns() - begin;
+    report("sequential", allocator, FIBER_COUNT, used, stats,
+           minor_faults() - faults);
+}
+
+void bench_batch(const char *allocator) {
+    sylar::ConfigManager::LookUp<std::string>("fiber.stack_allocator")
+        ->setValue(allocator);
+    sylar::StackAllocStats stats =
+        sylar::StackAllocator::Get(allocator)->getStats();
+    long faults    = minor_faults();
+    uint64_t begin = now_ns();
+    std::vector<sylar::Fiber::ptr> fibers(BATCH_SIZE);
+    for (int r = 0; r < BATCH_ROUND; ++r) {
+        for (auto &i : fibers) {
+            i.reset(new sylar::Fiber(&fiber_func, (void *)1));
+            i->resume();
+        }
+        for (auto &i : fibers) {
+            i->resume();
+            i.reset();
+        }
+    }
+    uint64_t used = now_ns() - begin;
+    report("batch     ", allocator, BATCH_SIZE * BATCH_ROUND, used, stats,
+           minor_faults() - faults);
+}
+
+void check_cross_thread() {
+    const size_t count = 100;
+    const size_t size  = 128 * 1024;
+    sylar::StackAllocator *pool = sylar::StackAllocator::Get("pool");
+    //线程退出时缓存的栈全部归还到全局缓存
+    sylar::Thread producer(
+        [pool, count, size]() {
+            std::vector<void *> stacks;
+            for (size_t i = 0; i < count; ++i) {
+                stacks.push_back(pool->alloc(size));
+            }
+            for (auto i : stacks) {
+                pool->dealloc(i, size);
+            }
+        },
+        "producer");
+    producer.join();
+
+    sylar::StackAllocStats stats = pool->getStats();
+    sylar::Thread consumer(
+        [pool, count, size]() {
+            std::vector<void *> stacks;
+            for (size_t i = 0; i < count; ++i) {
+                stacks.push_back(pool->alloc(size));
+            }
+            for (auto i : stacks) {
+                pool->dealloc(i, size);
+            }
+        },
+        "consumer");
+    consumer.join();
+    SYLAR_ASSERT(pool->getStats().sysAllocs == stats.sysAllocs);
+    SYLAR_LOG_INFO(g_logger) << "cross thread reuse ok";
+}
+
+void switch_in_fiber(void *arg) {
+    for (int i = 0; i < SWITCH_COUNT; ++i) {
+        sylar::Fiber::GetThis()->yield();
+    }
+}
+
+//通过Fiber::resume/yield切换，使用编译时选择的上下文切换方式
+void bench_fiber() {
+    sylar::Fiber::ptr fiber(new sylar::Fiber(&switch_in_fiber));
+    uint64_t begin = now_ns();
+    for (int i = 0; i < SWITCH_COUNT; ++i) {
+        fiber->resume();
+    }
+    uint64_t used = now_ns() - begin;
+    fiber->resume();
+    SYLAR_LOG_INFO(g_logger) << "Fiber(" << sylar::Fiber::ContextBackend()
+                             << ") resume+yield=" << used / SWITCH_COUNT
+                             << "ns";
+}
+
+static ucontext_t s_uc_main, s_uc_func;
+
+void ucontext_func() {
+    while (true) {
+        swapcontext(&s_uc_func, &s_uc_main);
+    }
+}
+
+//直接使用swapcontext切换
+void bench_ucontext() {
+    void *stack = malloc(STACK_SIZE);
+    getcontext(&s_uc_func);
+    s_uc_func.uc_link          = nullptr;
+    s_uc_func.uc_stack.ss_sp   = stack;
+    s_uc_func.uc_stack.ss_size = STACK_SIZE;
+    makecontext(&s_uc_func, &ucontext_func, 0);
+
+    uint64_t begin = now_ns();
+    for (int i = 0; i < SWITCH_COUNT; ++i) {
+        swapcontext(&s_uc_main, &s_uc_func);
+    }
+    uint64_t used = now_ns() - begin;
+    SYLAR_LOG_INFO(g_logger) << "raw ucontext swapcontext x2="
+                             << used / SWITCH_COUNT << "ns";
+    free(stack);
+}
+
+#ifdef SYLAR_HAS_ASM_CONTEXT
+static void *s_asm_main = nullptr;
+static void *s_asm_func = nullptr;
+
+void asm_func(void *arg) {
+    while (true) {
+        sylar_jump_context(&s_asm_func, s_asm_main, nullptr);
+    }
+}
+
+//直接使用汇编实现切换
+void bench_asm() {
+    void *stack = malloc(STACK_SIZE);
+    s_asm_func  = sylar_make_context((char *)stack + STACK_SIZE, STACK_SIZE,
+                                    &asm_func);
+
+    uint64_t begin = now_ns();
+    for (int i = 0; i < SWITCH_COUNT; ++i) {
+        sylar_jump_context(&s_asm_main, s_asm_func, nullptr);
+    }
+    uint64_t used = now_ns() - begin;
+    SYLAR_LOG_INFO(g_logger) << "raw asm sylar_jump_context x2="
+                             << used / SWITCH_COUNT << "ns";
+    free(stack);
+}
+#endif
+
+int main() {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+    sylar::Fiber::GetThis();
+
+    check_cross_thread();
+    bench_sequential("malloc");
+    bench_sequential("pool");
+    bench_batch("malloc");
+    bench_batch("pool");
+    bench_fiber();
+    bench_ucontext();
+#ifdef SYLAR_HAS_ASM_CONTEXT
+    bench_asm();
+#endif
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include "sylar/hook_sys_call.h"
+#include "sylar/sylar.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+
+// hook socket相关系统函数测试
+// 1. 单个调度线程上同时运行一个ECHO服务器和多个客户端，所有socket都以阻塞方式使用，
+//    未hook时第一个阻塞的accept/recv就会卡住整个调度线程
+// 2. SO_RCVTIMEO读超时及tcp.connect.timeout连接超时
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int CLIENT_COUNT   = 100; //客户端个数
+static const int MESSAGE_COUNT  = 10;  //每个客户端发送的消息数
+static const uint16_t ECHO_PORT = 9527;
+static const uint16_t SILENT_PORT = 9528;
+static std::atomic<int> s_ok{0};
+
+static sockaddr_in make_addr(const char *ip, uint16_t port) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = inet_addr(ip);
+    return addr;
+}
+
+void echo_client_handler(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    char buf[256];
+    while (true) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            break;
+        }
+        send(fd, buf, n, 0);
+    }
+    close(fd);
+}
+
+void echo_client(void *arg) {
+    int id = (int)(intptr_t)arg;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    SYLAR_ASSERT(fd >= 0);
+
+    sockaddr_in addr = make_addr("127.0.0.1", ECHO_PORT);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr))) {
+        SYLAR_LOG_ERROR(g_logger) << "connect errno=" << errno
+                                  << " errstr=" << strerror(errno);
+        close(fd);
+        return;
+    }
+
+    for (int i = 0; i < MESSAGE_COUNT; ++i) {
+        std::string msg = "client " + std::to_string(id) + " message " +
+                          std::to_string(i);
+        SYLAR_ASSERT(write(fd, msg.c_str(), msg.size()) == (ssize_t)msg.size());
+
+        //可能分多次收到，读满为止
+        std::string rsp(msg.size(), '\0');
+        size_t offset = 0;
+        while (offset < rsp.size()) {
+            ssize_t n = read(fd, &rsp[offset], rsp.size() - offset);
+            SYLAR_ASSERT(n > 0);
+            offset += n;
+        }
+        SYLAR_ASSERT(rsp == msg);
+        //让其他客户端有机会交错执行
+        usleep(1000);
+    }
+    close(fd);
+    ++s_ok;
+}
+
+void echo_server(void *arg) {
+    int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+    SYLAR_ASSERT(listenfd >= 0);
+    int val = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+
+    sockaddr_in addr = make_addr("127.0.0.1", ECHO_PORT);
+    SYLAR_ASSERT(bind(listenfd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    SYLAR_ASSERT(listen(listenfd, SOMAXCONN) == 0);
+
+    //用户未设置非阻塞，fcntl返回的标志中不应包含O_NONBLOCK
+    SYLAR_ASSERT(!(fcntl(listenfd, F_GETFL) & O_NONBLOCK));
+
+    //开始监听之后再启动客户端
+    sylar::Scheduler *psc = sylar::Scheduler::getThis();
+    for (int i = 0; i < CLIENT_COUNT; ++i) {
+        psc->schedule(&echo_client, (void *)(intptr_t)i);
+    }
+
+    for (int i = 0; i < CLIENT_COUNT; ++i) {
+        int fd = accept(listenfd, nullptr, nullptr);
+        SYLAR_ASSERT(fd >= 0);
+        psc->schedule(&echo_client_handler, (void *)(intptr_t)fd);
+    }
+    close(listenfd);
+    SYLAR_LOG_INFO(g_logger) << "echo server accepted " << CLIENT_COUNT
+                             << " clients";
+}
+
+void test_recv_timeout(void *arg) {
+    //服务端只accept不发送数据
+    int listenfd     = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = make_addr("127.0.0.1", SILENT_PORT);
+    int val          = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+    SYLAR_ASSERT(bind(listenfd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    SYLAR_ASSERT(listen(listenfd, SOMAXCONN) == 0);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    SYLAR_ASSERT(connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    int peer = accept(listenfd, nullptr, nullptr);
+    SYLAR_ASSERT(peer >= 0);
+
+    timeval tv = {0, 200 * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char buf[16];
+    uint64_t begin = sylar::GetCurrentMS();
+    ssize_t n      = recv(fd, buf, sizeof(buf), 0);
+    uint64_t used  = sylar::GetCurrentMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "recv timeout: n=" << n << " errno=" << errno
+                             << " used=" << used << "ms";
+    SYLAR_ASSERT(n == -1 && errno == EAGAIN);
+    SYLAR_ASSERT(used >= 190 && used < 1000);
+
+    close(peer);
+    close(fd);
+    close(listenfd);
+}
+
+void test_connect_timeout(void *arg) {
+    sylar::ConfigManager::LookUp<int>("tcp.connect.timeout")->setValue(300);
+
+    //监听队列已满且不accept时，新连接的SYN会被丢弃，connect无法完成
+    int listenfd     = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = make_addr("127.0.0.1", SILENT_PORT + 1);
+    int val          = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+    SYLAR_ASSERT(bind(listenfd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    SYLAR_ASSERT(listen(listenfd, 0) == 0);
+
+    std::vector<int> fds;
+    int rt        = 0;
+    uint64_t used = 0;
+    for (int i = 0; i < 16 && rt == 0; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        fds.push_back(fd);
+        uint64_t begin = sylar::GetCurrentMS();
+        rt             = connect(fd, (sockaddr *)&addr, sizeof(addr));
+        used           = sylar::GetCurrentMS() - begin;
+    }
+    SYLAR_LOG_INFO(g_logger) << "connect timeout: connections=" << fds.size()
+                             << " rt=" << rt << " errno=" << errno
+                             << " used=" << used << "ms";
+    SYLAR_ASSERT(rt == -1 && errno == ETIMEDOUT);
+    SYLAR_ASSERT(used >= 290 && used < 1000);
+
+    for (auto fd : fds) {
+        close(fd);
+    }
+    close(listenfd);
+}
+
+int main() {
+    {
+        sylar::Scheduler sc("hook_socket", 1);
+        sc.schedule(&echo_server);
+        sc.start();
+        sc.stop();
+
+        SYLAR_LOG_INFO(g_logger)
+            << "clients ok=" << s_ok << "/" << CLIENT_COUNT;
+        SYLAR_ASSERT(s_ok == CLIENT_COUNT);
+    }
+
+    {
+        sylar::Scheduler sc("hook_timeout", 1);
+        sc.schedule(&test_recv_timeout);
+        sc.schedule(&test_connect_timeout);
+        sc.start();
+        sc.stop();
+    }
+    return 0;
+}
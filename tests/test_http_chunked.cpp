@@ -0,0 +1,310 @@
+#include "sylar/http/http_server.h"
+#include "sylar/sylar.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+
+// HTTP分块编码测试
+// 请求：客户端以分块编码上传较小(读入body)和较大(流式读取)的消息体，带块扩展参数和
+// trailer，紧跟一个流水线请求，检查服务器收到的数据和后续请求
+// 响应：servlet生成较大的响应，对比分块发送和全部生成后一次发送的首字节时间和总时间，
+// HTTP/1.0的请求不使用分块编码
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const uint16_t PORT        = 8350;
+static const uint64_t UPLOAD_SIZE = 32 * 1024 * 1024; //较大的上传消息体大小
+static const int GEN_CHUNKS       = 256;              //生成的响应块数
+static const size_t GEN_CHUNK     = 64 * 1024;        //生成的响应块大小
+
+static char body_byte(uint64_t i) { return (char)(i * 7); }
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
+/* 生成响应的第i块，模拟计算耗时 */
+static void gen_chunk(int i, std::string &chunk) {
+    chunk.resize(GEN_CHUNK);
+    for (size_t j = 0; j < GEN_CHUNK; ++j) {
+        chunk[j] = body_byte(i * GEN_CHUNK + j);
+    }
+    usleep(200);
+}
+
+/* 返回"字节数 校验和 是否流式读取" */
+int32_t upload(sylar::http::HttpRequest::ptr req,
+               sylar::http::HttpResponse::ptr rsp,
+               sylar::http::HttpSession::ptr session) {
+    uint64_t bytes = 0;
+    uint64_t sum   = 0;
+    sylar::Stream::ptr stream = req->getBodyStream();
+    if (stream) {
+        char buf[64 * 1024];
+        int n = 0;
+        while ((n = stream->read(buf, sizeof(buf))) > 0) {
+            for (int i = 0; i < n; ++i) {
+                sum += (uint8_t)buf[i];
+            }
+            bytes += n;
+        }
+        if (n < 0) {
+            rsp->setStatus(sylar::http::HttpStatus::BAD_REQUEST);
+        }
+    } else {
+        for (auto c : req->getBody()) {
+            sum += (uint8_t)c;
+        }
+        bytes = req->getBody().size();
+    }
+    rsp->setBody(std::to_string(bytes) + " " + std::to_string(sum) + " " +
+                 (stream ? "stream" : "body"));
+    return 0;
+}
+
+int32_t gen_chunked(sylar::http::HttpRequest::ptr req,
+                    sylar::http::HttpResponse::ptr rsp,
+                    sylar::http::HttpSession::ptr session) {
+    sylar::http::HttpChunkedWriter::ptr writer =
+        session->beginChunkedResponse(rsp);
+    std::string chunk;
+    std::string body;
+    for (int i = 0; i < GEN_CHUNKS; ++i) {
+        gen_chunk(i, chunk);
+        if (!writer) {
+            body += chunk;
+        } else if (writer->write(chunk.c_str(), chunk.size()) < 0) {
+            return -1;
+        }
+    }
+    if (!writer) {
+        rsp->setBody(body);
+    }
+    return 0;
+}
+
+int32_t gen_buffered(sylar::http::HttpRequest::ptr req,
+                     sylar::http::HttpResponse::ptr rsp,
+                     sylar::http::HttpSession::ptr session) {
+    std::string chunk;
+    std::string body;
+    for (int i = 0; i < GEN_CHUNKS; ++i) {
+        gen_chunk(i, chunk);
+        body += chunk;
+    }
+    rsp->setBody(body);
+    return 0;
+}
+
+static int connect_server() {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    SYLAR_ASSERT(connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+static void send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        SYLAR_ASSERT(n > 0);
+        data += n;
+        len -= n;
+    }
+}
+
+static void send_all(int fd, const std::string &data) {
+    send_all(fd, data.c_str(), data.size());
+}
+
+/* 以分块编码发送size字节的消息体，每块最多chunk字节 */
+static void send_chunked(int fd, uint64_t size, size_t chunk) {
+    send_all(fd, "POST /upload HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                 "Transfer-Encoding: chunked\r\n\r\n");
+    std::string buf;
+    char head[64];
+    for (uint64_t i = 0; i < size;) {
+        size_t n = std::min<uint64_t>(chunk, size - i);
+        buf.resize(n);
+        for (size_t j = 0; j < n; ++j) {
+            buf[j] = body_byte(i + j);
+        }
+        snprintf(head, sizeof(head), "%zX;name=value\r\n", n);
+        send_all(fd, head);
+        send_all(fd, buf);
+        send_all(fd, "\r\n");
+        i += n;
+    }
+    send_all(fd, "0\r\nX-Trailer: 1\r\n\r\n");
+}
+
+/* 按缓冲区读取的响应 */
+struct Response {
+    int fd;
+    std::string data;   //已收到未处理的数据
+    uint64_t firstByte; //收到第一个字节的时间
+
+    Response(int v)
+        : fd(v)
+        , firstByte(0) {}
+
+    bool fill() {
+        char buf[64 * 1024];
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return false;
+        }
+        if (!firstByte) {
+            firstByte = now_us();
+        }
+        data.append(buf, n);
+        return true;
+    }
+
+    std::string line() {
+        size_t pos;
+        while ((pos = data.find("\r\n")) == std::string::npos) {
+            SYLAR_ASSERT(fill());
+        }
+        std::string rt = data.substr(0, pos);
+        data.erase(0, pos + 2);
+        return rt;
+    }
+
+    std::string bytes(size_t n) {
+        while (data.size() < n) {
+            SYLAR_ASSERT(fill());
+        }
+        std::string rt = data.substr(0, n);
+        data.erase(0, n);
+        return rt;
+    }
+
+    /* 读取一个响应的消息体，chunked返回是否为分块编码 */
+    std::string body(bool *chunked = nullptr) {
+        SYLAR_ASSERT(line().compare(0, 12, "HTTP/1.1 200") == 0);
+        size_t length = 0;
+        bool is_chunked = false;
+        std::string l;
+        while (!(l = line()).empty()) {
+            if (l.compare(0, 16, "content-length: ") == 0) {
+                length = atoi(l.c_str() + 16);
+            } else if (l == "transfer-encoding: chunked") {
+                is_chunked = true;
+            }
+        }
+        if (chunked) {
+            *chunked = is_chunked;
+        }
+        if (!is_chunked) {
+            return bytes(length);
+        }
+        std::string rt;
+        size_t n = 0;
+        while ((n = strtoul(line().c_str(), nullptr, 16)) > 0) {
+            rt += bytes(n);
+            SYLAR_ASSERT(line().empty());
+        }
+        SYLAR_ASSERT(line().empty());
+        return rt;
+    }
+};
+
+static std::string expect_upload(uint64_t size, const char *mode) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < size; ++i) {
+        sum += (uint8_t)body_byte(i);
+    }
+    return std::to_string(size) + " " + std::to_string(sum) + " " + mode;
+}
+
+void test_request() {
+    int fd = connect_server();
+    Response rsp(fd);
+
+    //较小的消息体读入body，之后的流水线请求正常处理
+    send_chunked(fd, 10000, 3000);
+    send_all(fd, "GET /upload HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    SYLAR_ASSERT(rsp.body() == expect_upload(10000, "body"));
+    SYLAR_ASSERT(rsp.body() == "0 0 body");
+
+    //较大的消息体流式读取
+    uint64_t begin = now_us();
+    send_chunked(fd, UPLOAD_SIZE, 64 * 1024);
+    SYLAR_ASSERT(rsp.body() == expect_upload(UPLOAD_SIZE, "stream"));
+    uint64_t used = now_us() - begin;
+    SYLAR_LOG_INFO(g_logger)
+        << "chunked upload=" << UPLOAD_SIZE / 1024 / 1024
+        << "MB MB/s=" << UPLOAD_SIZE / used;
+
+    //同时带有Content-Length的分块编码请求被拒绝，连接关闭
+    send_all(fd, "POST /upload HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                 "Content-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n"
+                 "0\r\n\r\n");
+    SYLAR_ASSERT(!rsp.fill());
+    close(fd);
+}
+
+void test_response() {
+    int fd = connect_server();
+    Response rsp(fd);
+    std::string expect;
+    std::string chunk;
+    for (int i = 0; i < GEN_CHUNKS; ++i) {
+        gen_chunk(i, chunk);
+        expect += chunk;
+    }
+
+    const char *paths[] = {"/gen_buffered", "/gen_chunked"};
+    for (auto path : paths) {
+        rsp.firstByte  = 0;
+        uint64_t begin = now_us();
+        send_all(fd, std::string("GET ") + path +
+                         " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+        bool chunked = false;
+        SYLAR_ASSERT(rsp.body(&chunked) == expect);
+        SYLAR_ASSERT(chunked == (path == paths[1]));
+        uint64_t end = now_us();
+        SYLAR_LOG_INFO(g_logger)
+            << path << " size=" << expect.size() / 1024 / 1024
+            << "MB first_byte=" << rsp.firstByte - begin
+            << "us total=" << end - begin << "us";
+    }
+
+    // HTTP/1.0不使用分块编码
+    send_all(fd, "GET /gen_chunked HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+    std::string l = rsp.line();
+    SYLAR_ASSERT(l.compare(0, 12, "HTTP/1.0 200") == 0);
+    rsp.data = l.replace(0, 8, "HTTP/1.1") + "\r\n" + rsp.data;
+    bool chunked = true;
+    SYLAR_ASSERT(rsp.body(&chunked) == expect);
+    SYLAR_ASSERT(!chunked);
+    close(fd);
+}
+
+int main() {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    SYLAR_LOG_NAME("tcpserver")->setLevel(sylar::LogLevel::WARN);
+    sylar::ConfigManager::LookUp<uint32_t>("scheduler.threads")->setValue(2);
+
+    sylar::http::HttpServer::ptr server(new sylar::http::HttpServer(true));
+    auto sd = server->getServletDispatch();
+    sd->addServlet("/upload", &upload);
+    sd->addServlet("/gen_chunked", &gen_chunked);
+    sd->addServlet("/gen_buffered", &gen_buffered);
+    auto addr = sylar::IPAddress::Create("127.0.0.1", PORT);
+    SYLAR_ASSERT(server->bind(addr));
+    server->start();
+
+    sylar::Thread request(&test_request, "request");
+    request.join();
+    sylar::Thread response(&test_response, "response");
+    response.join();
+    server->stop();
+    return 0;
+}
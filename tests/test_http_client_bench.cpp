@@ -0,0 +1,303 @@
+#include "sylar/http/http_connection.h"
+#include "sylar/http/http_server.h"
+#include "sylar/sylar.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+
+// HTTP客户端测试，先检查Content-Length、分块编码、HEAD、POST、超时和错误的url，连接池的
+// 连接复用、Connection: close、空闲超时、每个连接的请求数上限、连接数上限，以及复用的连接
+// 已被服务器关闭时只重试幂等的请求，再对本地HttpServer对比每次新建连接和使用连接池时单个协程和多个协程并发
+// 每秒完成的请求数
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const uint16_t PORT       = 8380;
+static const uint16_t RAW_PORT   = 8381; //处理一个请求后关闭连接的服务器
+static const size_t BIG_SIZE     = 1024 * 1024;
+static const uint64_t TIMEOUT_MS = 3000;
+
+static std::string s_url = "http://127.0.0.1:" + std::to_string(PORT);
+
+typedef sylar::http::HttpResult::Error Error;
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
+static std::string big_body() {
+    std::string body(BIG_SIZE, 0);
+    for (size_t i = 0; i < BIG_SIZE; ++i) {
+        body[i] = 'a' + i % 26;
+    }
+    return body;
+}
+
+static std::string chunked_body() {
+    std::string body;
+    for (int i = 0; i < 10; ++i) {
+        body += "chunk" + std::to_string(i) + ";";
+    }
+    return body;
+}
+
+void start_server(sylar::http::HttpServer::ptr server) {
+    auto sd = server->getServletDispatch();
+    sd->addServlet("/hello", [](sylar::http::HttpRequest::ptr req,
+                                sylar::http::HttpResponse::ptr rsp,
+                                sylar::http::HttpSession::ptr session) {
+        rsp->setBody("hello world");
+        return 0;
+    });
+    sd->addServlet("/echo", [](sylar::http::HttpRequest::ptr req,
+                               sylar::http::HttpResponse::ptr rsp,
+                               sylar::http::HttpSession::ptr session) {
+        rsp->setBody(req->getQuery() + "|" + req->getBody() + "|" +
+                     req->getHeader("X-Test"));
+        return 0;
+    });
+    sd->addServlet("/chunked", [](sylar::http::HttpRequest::ptr req,
+                                  sylar::http::HttpResponse::ptr rsp,
+                                  sylar::http::HttpSession::ptr session) {
+        auto writer = session->beginChunkedResponse(rsp);
+        for (int i = 0; i < 10; ++i) {
+            std::string chunk = "chunk" + std::to_string(i) + ";";
+            writer->write(chunk.c_str(), chunk.size());
+        }
+        return 0;
+    });
+    sd->addServlet("/big", [](sylar::http::HttpRequest::ptr req,
+                              sylar::http::HttpResponse::ptr rsp,
+                              sylar::http::HttpSession::ptr session) {
+        static std::string body = big_body();
+        rsp->setBody(body);
+        return 0;
+    });
+    sd->addServlet("/slow", [](sylar::http::HttpRequest::ptr req,
+                               sylar::http::HttpResponse::ptr rsp,
+                               sylar::http::HttpSession::ptr session) {
+        usleep(300 * 1000);
+        rsp->setBody("slow");
+        return 0;
+    });
+    sd->addServlet("/close", [](sylar::http::HttpRequest::ptr req,
+                                sylar::http::HttpResponse::ptr rsp,
+                                sylar::http::HttpSession::ptr session) {
+        rsp->setClose(true);
+        rsp->setBody("bye");
+        return 0;
+    });
+    auto addr = sylar::IPAddress::Create("127.0.0.1", PORT);
+    SYLAR_ASSERT(server->bind(addr));
+    server->start();
+}
+
+/* 不使用hook的服务器，每个连接处理一个请求后关闭，响应没有Connection: close */
+void raw_server(int listenfd, int conns) {
+    for (int i = 0; i < conns; ++i) {
+        int fd = accept(listenfd, nullptr, nullptr);
+        SYLAR_ASSERT(fd >= 0);
+        std::string data;
+        char buf[4096];
+        while (data.find("\r\n\r\n") == std::string::npos) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            SYLAR_ASSERT(n > 0);
+            data.append(buf, n);
+        }
+        const char *rsp = "HTTP/1.1 200 OK\r\ncontent-length: 2\r\n\r\nok";
+        SYLAR_ASSERT(send(fd, rsp, strlen(rsp), 0) == (ssize_t)strlen(rsp));
+        close(fd);
+    }
+}
+
+void check(void *) {
+    // Content-Length
+    auto r = sylar::http::HttpConnection::DoGet(s_url + "/hello", TIMEOUT_MS);
+    SYLAR_LOG_INFO(g_logger) << r->toString();
+    SYLAR_ASSERT(r->result == Error::OK && r->response->getBody() == "hello world");
+    r = sylar::http::HttpConnection::DoGet(s_url + "/big", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK && r->response->getBody() == big_body());
+    r = sylar::http::HttpConnection::DoGet(s_url + "/nothing", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK &&
+                 r->response->getStatus() == sylar::http::HttpStatus::NOT_FOUND);
+
+    //分块编码
+    r = sylar::http::HttpConnection::DoGet(s_url + "/chunked", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK &&
+                 r->response->getBody() == chunked_body());
+
+    // HEAD没有消息体
+    r = sylar::http::HttpConnection::DoRequest(sylar::http::HttpMethod::HEAD,
+                                               s_url + "/big", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK && r->response->getBody().empty());
+    SYLAR_ASSERT(r->response->getHeader("content-length") ==
+                 std::to_string(BIG_SIZE));
+
+    // POST、query和头部
+    r = sylar::http::HttpConnection::DoPost(s_url + "/echo?a=1#frag",
+                                            TIMEOUT_MS, {{"X-Test", "yes"}},
+                                            "body");
+    SYLAR_ASSERT(r->result == Error::OK &&
+                 r->response->getBody() == "a=1|body|yes");
+
+    //超时和错误
+    uint64_t begin = now_us();
+    r = sylar::http::HttpConnection::DoGet(s_url + "/slow", 100);
+    SYLAR_ASSERT(r->result == Error::TIMEOUT);
+    SYLAR_ASSERT(now_us() - begin < 250 * 1000);
+    r = sylar::http::HttpConnection::DoGet("https://127.0.0.1/", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::INVALID_URL);
+    r = sylar::http::HttpConnection::DoGet("http://127.0.0.1:1/", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::CONNECT_FAIL);
+
+    //连接复用
+    sylar::http::HttpConnectionPool pool("127.0.0.1", PORT, 4, 1000);
+    for (int i = 0; i < 100; ++i) {
+        r = pool.doGet(i % 10 ? "/hello" : "/chunked", TIMEOUT_MS);
+        SYLAR_ASSERT(r->result == Error::OK);
+    }
+    r = pool.doGet("/big", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK && r->response->getBody() == big_body());
+    SYLAR_ASSERT(pool.getConnectCount() == 1 && pool.getIdleCount() == 1);
+    r = pool.doPost("/echo?b=2", TIMEOUT_MS, {}, "post");
+    SYLAR_ASSERT(r->result == Error::OK &&
+                 r->response->getBody() == "b=2|post|");
+
+    //服务器要求关闭的连接不放回连接池
+    r = pool.doGet("/close", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK && r->response->isClose());
+    SYLAR_ASSERT(pool.getIdleCount() == 0);
+    r = pool.doGet("/hello", TIMEOUT_MS);
+    SYLAR_ASSERT(pool.getConnectCount() == 2);
+
+    //超时的连接关闭后不放回连接池
+    r = pool.doGet("/slow", 100);
+    SYLAR_ASSERT(r->result == Error::TIMEOUT && pool.getIdleCount() == 0);
+
+    //空闲超时
+    sylar::http::HttpConnectionPool idle_pool("127.0.0.1", PORT, 4, 50);
+    idle_pool.doGet("/hello", TIMEOUT_MS);
+    idle_pool.doGet("/hello", TIMEOUT_MS);
+    SYLAR_ASSERT(idle_pool.getConnectCount() == 1);
+    usleep(100 * 1000);
+    r = idle_pool.doGet("/hello", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK && idle_pool.getConnectCount() == 2);
+
+    //每个连接最多3个请求
+    sylar::http::HttpConnectionPool max_pool("127.0.0.1", PORT, 4, 1000, 3);
+    for (int i = 0; i < 9; ++i) {
+        SYLAR_ASSERT(max_pool.doGet("/hello", TIMEOUT_MS)->result == Error::OK);
+    }
+    SYLAR_ASSERT(max_pool.getConnectCount() == 3);
+
+    //连接数上限，正在使用的连接也计入，等待超时后失败，等到连接用完后复用
+    sylar::http::HttpConnectionPool one_pool("127.0.0.1", PORT, 1, 1000);
+    std::atomic<int> slow_done{0};
+    sylar::Scheduler::getThis()->schedule([&](void *) {
+        SYLAR_ASSERT(one_pool.doGet("/slow", TIMEOUT_MS)->result == Error::OK);
+        ++slow_done;
+    });
+    usleep(50 * 1000);
+    SYLAR_ASSERT(one_pool.getConnectionCount() == 1);
+    begin = now_us();
+    r     = one_pool.doGet("/hello", 100);
+    SYLAR_ASSERT(r->result == Error::POOL_GET_CONNECTION);
+    SYLAR_ASSERT(now_us() - begin < 250 * 1000);
+    r = one_pool.doGet("/hello", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK && slow_done == 1);
+    SYLAR_ASSERT(one_pool.getConnectCount() == 1);
+
+    //复用的连接已被服务器关闭时，POST可能已被处理，不重试，GET换用新的连接重试
+    sylar::http::HttpConnectionPool raw_pool("127.0.0.1", RAW_PORT, 4, 1000);
+    r = raw_pool.doGet("/", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK && r->response->getBody() == "ok");
+    usleep(10 * 1000);
+    r = raw_pool.doPost("/", TIMEOUT_MS, {}, "post");
+    SYLAR_ASSERT(r->result == Error::RECV_FAIL);
+    SYLAR_ASSERT(raw_pool.getConnectCount() == 1);
+    SYLAR_ASSERT(raw_pool.getConnectionCount() == 0);
+    r = raw_pool.doGet("/", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK && r->response->getBody() == "ok");
+    usleep(10 * 1000);
+    r = raw_pool.doGet("/", TIMEOUT_MS);
+    SYLAR_ASSERT(r->result == Error::OK && r->response->getBody() == "ok");
+    SYLAR_ASSERT(raw_pool.getConnectCount() == 3);
+    SYLAR_LOG_INFO(g_logger) << "check ok";
+}
+
+/* fibers个协程并发，每个协程count个请求 */
+void bench(sylar::Scheduler *sc, bool pooled, int fibers, int count) {
+    sylar::http::HttpConnectionPool pool("127.0.0.1", PORT, fibers, 10000);
+    std::string url = s_url + "/hello";
+    std::atomic<int> done{0};
+    std::atomic<int> failed{0};
+    uint64_t begin = now_us();
+    for (int i = 0; i < fibers; ++i) {
+        sc->schedule([&](void *) {
+            for (int j = 0; j < count; ++j) {
+                auto r = pooled
+                             ? pool.doGet("/hello", TIMEOUT_MS)
+                             : sylar::http::HttpConnection::DoGet(url, TIMEOUT_MS);
+                if (r->result != Error::OK) {
+                    ++failed;
+                }
+            }
+            ++done;
+        });
+    }
+    while (done < fibers) {
+        usleep(1000);
+    }
+    uint64_t used = now_us() - begin;
+    SYLAR_ASSERT(failed == 0);
+    SYLAR_LOG_INFO(g_logger)
+        << (pooled ? "pool      " : "no pool   ") << " fibers=" << fibers
+        << " requests=" << fibers * count
+        << " req/s=" << (uint64_t)(fibers * count * 1e6 / used)
+        << " connects=" << (pooled ? pool.getConnectCount()
+                                   : (uint64_t)fibers * count);
+}
+
+int main() {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    SYLAR_LOG_NAME("tcpserver")->setLevel(sylar::LogLevel::ERROR);
+    sylar::ConfigManager::LookUp<uint32_t>("scheduler.threads")->setValue(1);
+
+    sylar::http::HttpServer::ptr server(new sylar::http::HttpServer(true));
+    start_server(server);
+
+    int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+    int val      = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(RAW_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    SYLAR_ASSERT(bind(listenfd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    SYLAR_ASSERT(listen(listenfd, 16) == 0);
+    sylar::Thread raw([listenfd]() { raw_server(listenfd, 3); }, "raw_server");
+
+    {
+        sylar::Scheduler sc("client", 1);
+        sc.schedule(&check);
+        sc.start();
+        sc.stop();
+    }
+    raw.join();
+    close(listenfd);
+
+    {
+        sylar::Scheduler sc("client", 1);
+        sc.start();
+        bench(&sc, false, 1, 2000);
+        bench(&sc, true, 1, 2000);
+        bench(&sc, false, 8, 300);
+        bench(&sc, true, 8, 300);
+        sc.stop();
+    }
+    server->stop();
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include "sylar/http/http_parser.h"
+#include "sylar/sylar.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// HTTP请求解析性能测试，对比拷贝头部到map和零拷贝两种解析方式每秒解析的请求数及每个
+// 请求的内存分配次数，每个请求包括申请接收缓冲区、解析、查找常用的头部
+// 另外检查零拷贝模式下请求头分两次收到时重新解析的结果与一次收到时相同，以及查找头部
+// 不申请内存
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int REQUEST_COUNT = 200000; //每种方式解析的请求数
+
+static const char s_request[] =
+    "GET /index.html?from=bench HTTP/1.1\r\n"
+    "Host: www.sylar.top\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 "
+    "Firefox/115.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: zh-CN,zh;q=0.8,en-US;q=0.5,en;q=0.3\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: session=8f2a1c9e4b7d6a5f3e2d1c0b9a8f7e6d; theme=dark\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n";
+
+static std::atomic<uint64_t> s_allocs{0};
+
+void *operator new(size_t size) {
+    ++s_allocs;
+    void *p = malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+/* 解析一个请求，chunk不为0时分两次收到 */
+sylar::http::HttpRequest::ptr parse(bool zero_copy, size_t chunk = 0) {
+    uint64_t buff_size =
+        sylar::http::HttpRequestParser::GetHttpRequestBufferSize();
+    std::shared_ptr<char> buffer(new char[buff_size],
+                                 [](char *ptr) { delete[] ptr; });
+    char *data = buffer.get();
+    sylar::http::HttpRequestParser parser(zero_copy);
+
+    size_t total = sizeof(s_request) - 1;
+    size_t len   = chunk ? chunk : total;
+    memcpy(data, s_request, len);
+    size_t nparse = parser.excute(data, len);
+    if (!parser.isFinished()) {
+        //非零拷贝模式下已解析的数据被移除
+        size_t left = zero_copy ? len : len - nparse;
+        memcpy(data + left, s_request + len, total - len);
+        parser.excute(data, left + total - len);
+    }
+    SYLAR_ASSERT(!parser.hasError() && parser.isFinished());
+
+    sylar::http::HttpRequest::ptr req = parser.getData();
+    if (zero_copy) {
+        req->setBuffer(buffer);
+    }
+    boost::string_view conn;
+    SYLAR_ASSERT(req->findHeader("connection", conn));
+    SYLAR_ASSERT(parser.getContentLength() == 0);
+    return req;
+}
+
+void bench(bool zero_copy) {
+    uint64_t allocs = s_allocs;
+    uint64_t begin  = now_ns();
+    for (int i = 0; i < REQUEST_COUNT; ++i) {
+        parse(zero_copy);
+    }
+    uint64_t used = now_ns() - begin;
+    allocs        = s_allocs - allocs;
+    SYLAR_LOG_INFO(g_logger)
+        << (zero_copy ? "zero copy" : "copy     ")
+        << " requests=" << REQUEST_COUNT
+        << " req/s=" << (uint64_t)(REQUEST_COUNT * 1e9 / used)
+        << " ns/req=" << used / REQUEST_COUNT
+        << " allocs/req=" << (double)allocs / REQUEST_COUNT;
+}
+
+/* 零拷贝的头部按收到的顺序保存，逐个与拷贝到map中的头部比较 */
+void check_headers(sylar::http::HttpRequest::ptr copy,
+                   sylar::http::HttpRequest::ptr view) {
+    SYLAR_ASSERT(view->getHeaderViews().size() == copy->getHeaders().size());
+    for (auto &i : copy->getHeaders()) {
+        SYLAR_ASSERT(view->getHeader(i.first) == i.second);
+    }
+    SYLAR_ASSERT(view->getPath() == copy->getPath());
+    SYLAR_ASSERT(view->getQuery() == copy->getQuery());
+}
+
+void check() {
+    sylar::http::HttpRequest::ptr copy = parse(false);
+    sylar::http::HttpRequest::ptr view = parse(true);
+    SYLAR_ASSERT(view->getHeaderViews().size() == 9);
+    check_headers(copy, view);
+    SYLAR_ASSERT(view->getHeader("HOST") == "www.sylar.top");
+    SYLAR_ASSERT(view->getHeaderAs<int>("upgrade-insecure-requests") == 1);
+
+    //请求头在字段中间被截断，第二次从头重新解析
+    size_t cut = strstr(s_request, "gzip") - s_request;
+    sylar::http::HttpRequest::ptr split = parse(true, cut);
+    check_headers(copy, split);
+
+    //修改后map优先，删除同时作用于零拷贝的头部
+    view->setHeader("host", "example.com");
+    view->delHeader("cookie");
+    SYLAR_ASSERT(view->getHeader("Host") == "example.com");
+    SYLAR_ASSERT(!view->hasHeader("Cookie"));
+    SYLAR_ASSERT(view->getHeaders().size() == 8);
+    SYLAR_ASSERT(view->getHeaderViews().empty());
+
+    //通过const引用也能取得零拷贝解析的全部头部
+    sylar::http::HttpRequest::ptr cview = parse(true);
+    const sylar::http::HttpRequest &creq = *cview;
+    SYLAR_ASSERT(creq.getHeaders().size() == copy->getHeaders().size());
+
+    //查找头部不申请内存
+    sylar::http::HttpRequest::ptr req = parse(true);
+    req->setHeader("x-test", "1");
+    boost::string_view v;
+    uint64_t allocs = s_allocs;
+    SYLAR_ASSERT(req->findHeader("X-Test", v) && v == "1");
+    SYLAR_ASSERT(req->findHeader("HOST", v) && v == "www.sylar.top");
+    SYLAR_ASSERT(!req->findHeader("x-none", v));
+    SYLAR_ASSERT(s_allocs == allocs);
+    req->materializeHeaders();
+    SYLAR_ASSERT(req->getHeaderViews().empty());
+    SYLAR_ASSERT(req->findHeader("host", v) && v == "www.sylar.top");
+}
+
+int main() {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+    check();
+    bench(false);
+    bench(true);
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "sylar/http/http_session.h"
+#include "sylar/sylar.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// HTTP响应发送性能测试，对比通过stringstream序列化整个响应后发送和头部写入复用的缓冲区、
+// 头部和消息体通过一次writev发送两种方式，统计100B、10KB、1MB消息体每秒发送的响应数及
+// 每个响应的内存分配次数，另一个线程接收并丢弃全部数据
+// 另外检查预先生成的状态行和缓存的Date头部，统计序列化响应头部的耗时
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const uint16_t PORT = 8360;
+
+static std::atomic<uint64_t> s_allocs{0};
+
+void *operator new(size_t size) {
+    ++s_allocs;
+    void *p = malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+/* 改动前的发送方式 */
+static int send_stringstream(sylar::http::HttpSession::ptr session,
+                             sylar::http::HttpResponse::ptr rsp) {
+    std::stringstream ss;
+    ss << *rsp;
+    std::string data = ss.str();
+    return session->writeFixSize(data.c_str(), data.size());
+}
+
+void bench(bool writev, size_t body_size, int count) {
+    auto addr = sylar::IPAddress::Create("127.0.0.1", PORT);
+    sylar::Socket::ptr listener = sylar::Socket::CreateTCP(addr);
+    int val                     = 1;
+    listener->setOption(SOL_SOCKET, SO_REUSEADDR, val);
+    SYLAR_ASSERT(listener->bind(addr) && listener->listen());
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family      = AF_INET;
+    sin.sin_port        = htons(PORT);
+    sin.sin_addr.s_addr = inet_addr("127.0.0.1");
+    SYLAR_ASSERT(connect(fd, (sockaddr *)&sin, sizeof(sin)) == 0);
+    sylar::Socket::ptr client = listener->accept();
+    SYLAR_ASSERT(client);
+    listener->close();
+
+    sylar::http::HttpResponse::ptr rsp(
+        new sylar::http::HttpResponse(0x11, false));
+    rsp->setHeader("Server", "sylar/1.0.0");
+    rsp->setHeader("Content-Type", "text/plain");
+    rsp->setBody(std::string(body_size, 'x'));
+    uint64_t total = rsp->toString().size() * count;
+
+    //另一个线程接收全部数据
+    sylar::Thread reader(
+        [fd, total]() {
+            static char buf[256 * 1024];
+            uint64_t recved = 0;
+            while (recved < total) {
+                ssize_t n = recv(fd, buf, sizeof(buf), 0);
+                SYLAR_ASSERT(n > 0);
+                recved += n;
+            }
+        },
+        "reader");
+
+    sylar::http::HttpSession::ptr session(
+        new sylar::http::HttpSession(client));
+    uint64_t allocs = s_allocs;
+    uint64_t begin  = now_ns();
+    for (int i = 0; i < count; ++i) {
+        int rt = writev ? session->sendResponse(rsp)
+                        : send_stringstream(session, rsp);
+        SYLAR_ASSERT(rt > 0);
+    }
+    reader.join();
+    uint64_t used = now_ns() - begin;
+    allocs        = s_allocs - allocs;
+
+    SYLAR_LOG_INFO(g_logger)
+        << (writev ? "writev      " : "stringstream") << " body=" << body_size
+        << " responses=" << count
+        << " rsp/s=" << (uint64_t)(count * 1e9 / used)
+        << " MB/s=" << (uint64_t)(total * 1e9 / used / 1024 / 1024)
+        << " allocs/rsp=" << (double)allocs / count;
+    session->close();
+    close(fd);
+}
+
+/* 序列化响应头部的耗时，常见的200响应使用预先生成的状态行和缓存的Date头部 */
+void bench_head() {
+    sylar::http::HttpResponse::ptr rsp(
+        new sylar::http::HttpResponse(0x11, false));
+    rsp->setHeader("Server", "sylar/1.0.0");
+    rsp->setBody("hello");
+    std::string buf;
+    rsp->appendHead(buf);
+    SYLAR_LOG_INFO(g_logger) << buf;
+
+    //Date头部与strftime格式化的当前时间一致
+    char date[64];
+    time_t now = time(nullptr);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    strftime(date, sizeof(date), "date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+    SYLAR_ASSERT(buf.compare(0, 17, "HTTP/1.1 200 OK\r\n") == 0);
+    SYLAR_ASSERT(buf.find(date) != std::string::npos ||
+                 time(nullptr) != now);
+
+    //自定义原因短语和设置了Date头部时不使用缓存
+    rsp->setStatus(sylar::http::HttpStatus::NOT_FOUND);
+    rsp->setReason("Nothing Here");
+    rsp->setHeader("Date", "Thu, 01 Jan 1970 00:00:00 GMT");
+    buf.clear();
+    rsp->appendHead(buf);
+    SYLAR_ASSERT(buf.compare(0, 27, "HTTP/1.1 404 Nothing Here\r\n") == 0);
+    SYLAR_ASSERT(buf.find("Date: Thu, 01 Jan 1970") != std::string::npos);
+    SYLAR_ASSERT(buf.find("date:") == std::string::npos);
+
+    //分块编码时忽略servlet设置的Content-Length
+    rsp->setHeader("Content-Length", "5");
+    rsp->setChunked(true);
+    buf.clear();
+    rsp->appendHead(buf);
+    SYLAR_ASSERT(buf.find("transfer-encoding: chunked\r\n") !=
+                 std::string::npos);
+    SYLAR_ASSERT(strcasestr(buf.c_str(), "content-length") == nullptr);
+
+    rsp.reset(new sylar::http::HttpResponse(0x10, true));
+    rsp->setHeader("Server", "sylar/1.0.0");
+    rsp->setBody("hello");
+    const int count = 1000000;
+    uint64_t allocs = s_allocs;
+    uint64_t begin  = now_ns();
+    for (int i = 0; i < count; ++i) {
+        buf.clear();
+        rsp->appendHead(buf);
+    }
+    uint64_t used = now_ns() - begin;
+    allocs        = s_allocs - allocs;
+    SYLAR_LOG_INFO(g_logger) << "appendHead count=" << count
+                             << " ns/head=" << used / count
+                             << " allocs/head=" << (double)allocs / count;
+}
+
+int main() {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+    bench_head();
+    struct {
+        size_t size;
+        int count;
+    } cases[] = {{100, 200000}, {10 * 1024, 50000}, {1024 * 1024, 1000}};
+    for (auto &i : cases) {
+        bench(false, i.size, i.count);
+        bench(true, i.size, i.count);
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include "sylar/http/http_server.h"
+#include "sylar/sylar.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+
+// HttpServer平滑重启测试，多个客户端线程持续发送keep-alive请求，期间多次启动新的服务器
+// 并排空停止旧的服务器，新旧服务器通过SO_REUSEPORT监听同一个端口
+// 旧服务器停止后对正在处理的请求返回connection: close，客户端收到后重新建立连接；空闲
+// 的keep-alive连接被直接关闭，客户端和一般的HTTP客户端一样，复用的连接上未收到任何响应
+// 时重新建立连接重试，要求所有请求都收到响应；最后保留一个空闲的keep-alive连接
+// 和一个只建立连接未发送请求的连接，检查不用等到排空超时就能停止
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const uint16_t PORT        = 8320;
+static const int CLIENT_THREADS   = 4;   //客户端线程数
+static const int RESTART_COUNT    = 5;   //重启次数
+static const int RESTART_INTERVAL = 300; //重启间隔，单位ms
+
+static std::atomic<bool> s_running{true};
+static std::atomic<uint64_t> s_requests{0};     //收到响应的请求数
+static std::atomic<uint64_t> s_dropped{0};      //已发出但未收到响应的请求数
+static std::atomic<uint64_t> s_reconnects{0};   //收到connection: close后重连的次数
+static std::atomic<uint64_t> s_retries{0};      //空闲连接被关闭后重试的次数
+static std::atomic<uint64_t> s_connect_fail{0}; //建立连接失败的次数
+
+static int connect_server() {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    while (s_running) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+        ++s_connect_fail;
+        close(fd);
+        usleep(1000);
+    }
+    return -1;
+}
+
+/* 发送一个请求并读取完整的响应，返回-1表示失败，-2表示未收到任何响应连接就被关闭，
+ * 0表示成功且可以复用连接，1表示服务器要求关闭连接
+ */
+static int request(int fd) {
+    static const char req[] = "GET /restart HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (send(fd, req, sizeof(req) - 1, MSG_NOSIGNAL) != sizeof(req) - 1) {
+        return -1;
+    }
+    std::string rsp;
+    char buf[4096];
+    size_t header_end = std::string::npos;
+    size_t length     = 0;
+    while (header_end == std::string::npos ||
+           rsp.size() < header_end + 4 + length) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return rsp.empty() ? -2 : -1;
+        }
+        rsp.append(buf, n);
+        if (header_end == std::string::npos) {
+            header_end = rsp.find("\r\n\r\n");
+            size_t pos = rsp.find("content-length: ");
+            if (pos != std::string::npos && pos < header_end) {
+                length = atoi(rsp.c_str() + pos + 16);
+            }
+        }
+    }
+    if (rsp.compare(0, 12, "HTTP/1.1 200") != 0) {
+        return -1;
+    }
+    return rsp.find("connection: close") < header_end ? 1 : 0;
+}
+
+void client_func() {
+    int fd      = connect_server();
+    bool reused = false; //连接上是否已经收到过响应
+    while (s_running && fd >= 0) {
+        int rt = request(fd);
+        if (rt == -2 && reused) {
+            close(fd);
+            ++s_retries;
+            fd     = connect_server();
+            reused = false;
+            continue;
+        }
+        if (rt < 0) {
+            ++s_dropped;
+        } else {
+            ++s_requests;
+        }
+        reused = true;
+        if (rt != 0) {
+            close(fd);
+            ++s_reconnects;
+            fd     = connect_server();
+            reused = false;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+sylar::http::HttpServer::ptr start_server(int generation) {
+    sylar::http::HttpServer::ptr server(new sylar::http::HttpServer(true));
+    server->setReusePort(true);
+    server->getServletDispatch()->addServlet(
+        "/restart", [generation](sylar::http::HttpRequest::ptr req,
+                                 sylar::http::HttpResponse::ptr rsp,
+                                 sylar::http::HttpSession::ptr session) {
+            rsp->setBody("generation " + std::to_string(generation));
+            return 0;
+        });
+    auto addr = sylar::IPAddress::Create("127.0.0.1", PORT);
+    SYLAR_ASSERT(server->bind(addr));
+    server->start();
+    return server;
+}
+
+int main() {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+    SYLAR_LOG_NAME("tcpserver")->setLevel(sylar::LogLevel::WARN);
+    sylar::ConfigManager::LookUp<uint32_t>("scheduler.threads")->setValue(2);
+
+    sylar::http::HttpServer::ptr server = start_server(0);
+    std::vector<sylar::Thread::ptr> clients;
+    for (int i = 0; i < CLIENT_THREADS; ++i) {
+        clients.push_back(sylar::Thread::ptr(
+            new sylar::Thread(&client_func, "client_" + std::to_string(i))));
+    }
+
+    for (int i = 1; i <= RESTART_COUNT; ++i) {
+        usleep(RESTART_INTERVAL * 1000);
+        //先启动新的服务器，再排空停止旧的服务器
+        sylar::http::HttpServer::ptr next = start_server(i);
+        uint64_t requests = s_requests;
+        uint64_t begin    = sylar::GetCurrentMS();
+        server->stop();
+        SYLAR_LOG_INFO(g_logger)
+            << "restart " << i << " drain=" << sylar::GetCurrentMS() - begin
+            << "ms requests_during_drain=" << s_requests - requests;
+        server = next;
+    }
+    usleep(RESTART_INTERVAL * 1000);
+    s_running = false;
+    for (auto &i : clients) {
+        i->join();
+    }
+
+    //空闲连接不会再发送请求，不用等到排空超时；只建立连接未发送请求的连接也是空闲的
+    s_running  = true;
+    int idle   = connect_server();
+    int silent = connect_server();
+    SYLAR_ASSERT(request(idle) == 0);
+    s_running = false;
+    server->setDrainTimeout(5000);
+    uint64_t begin = sylar::GetCurrentMS();
+    server->stop();
+    uint64_t used = sylar::GetCurrentMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "stop with idle connection used=" << used
+                             << "ms";
+    SYLAR_ASSERT(used < 1000);
+    char c;
+    SYLAR_ASSERT(recv(idle, &c, 1, 0) == 0);
+    SYLAR_ASSERT(recv(silent, &c, 1, 0) == 0);
+    close(idle);
+    close(silent);
+
+    SYLAR_LOG_INFO(g_logger)
+        << "requests=" << s_requests << " dropped=" << s_dropped
+        << " reconnects=" << s_reconnects << " retries=" << s_retries
+        << " connect_fail=" << s_connect_fail;
+    SYLAR_ASSERT(s_dropped == 0);
+    SYLAR_ASSERT(s_connect_fail == 0);
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "sylar/http/http_session.h"
+#include "sylar/sylar.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// HttpSession接收请求性能测试，客户端在一个连接上一次性发送大量流水线请求(GET和带消息体
+// 的POST交替)，服务器依次接收并检查每个请求的路径和消息体，统计拷贝和零拷贝两种解析方式
+// 每秒接收的请求数及每个请求的内存分配次数
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const uint16_t PORT     = 8330;
+static const int REQUEST_COUNT = 100000; //每种方式接收的请求数
+
+static std::atomic<uint64_t> s_allocs{0};
+
+void *operator new(size_t size) {
+    ++s_allocs;
+    void *p = malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+static std::string make_requests() {
+    std::string data;
+    for (int i = 0; i < REQUEST_COUNT; ++i) {
+        std::string path = "/p/" + std::to_string(i);
+        if (i % 2) {
+            std::string body = "body" + std::to_string(i);
+            data += "POST " + path +
+                    " HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: " +
+                    std::to_string(body.size()) + "\r\n\r\n" + body;
+        } else {
+            data += "GET " + path +
+                    " HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: */*\r\n\r\n";
+        }
+    }
+    return data;
+}
+
+void bench(bool zero_copy, const std::string &data) {
+    sylar::ConfigManager::LookUp<bool>("http.request.zero_copy")
+        ->setValue(zero_copy);
+
+    auto addr = sylar::IPAddress::Create("127.0.0.1", PORT);
+    sylar::Socket::ptr listener = sylar::Socket::CreateTCP(addr);
+    int val                     = 1;
+    listener->setOption(SOL_SOCKET, SO_REUSEADDR, val);
+    SYLAR_ASSERT(listener->bind(addr) && listener->listen());
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family      = AF_INET;
+    sin.sin_port        = htons(PORT);
+    sin.sin_addr.s_addr = inet_addr("127.0.0.1");
+    SYLAR_ASSERT(connect(fd, (sockaddr *)&sin, sizeof(sin)) == 0);
+    sylar::Socket::ptr client = listener->accept();
+    SYLAR_ASSERT(client);
+    listener->close();
+
+    //另一个线程发送全部请求，避免发送缓冲区满时阻塞
+    sylar::Thread writer(
+        [fd, &data]() {
+            size_t offset = 0;
+            while (offset < data.size()) {
+                ssize_t n = send(fd, data.c_str() + offset,
+                                 data.size() - offset, 0);
+                SYLAR_ASSERT(n > 0);
+                offset += n;
+            }
+        },
+        "writer");
+
+    sylar::http::HttpSession::ptr session(
+        new sylar::http::HttpSession(client));
+    uint64_t allocs = s_allocs;
+    uint64_t begin  = now_ns();
+    char path[32];
+    char body[32];
+    for (int i = 0; i < REQUEST_COUNT; ++i) {
+        sylar::http::HttpRequest::ptr req = session->recvRequest();
+        SYLAR_ASSERT(req);
+        snprintf(path, sizeof(path), "/p/%d", i);
+        SYLAR_ASSERT(req->getPath() == path);
+        if (i % 2) {
+            snprintf(body, sizeof(body), "body%d", i);
+            SYLAR_ASSERT(req->getBody() == body);
+        } else {
+            SYLAR_ASSERT(req->getBody().empty());
+        }
+        SYLAR_ASSERT(!req->isClose());
+    }
+    uint64_t used = now_ns() - begin;
+    allocs        = s_allocs - allocs;
+    writer.join();
+
+    SYLAR_LOG_INFO(g_logger)
+        << (zero_copy ? "zero copy" : "copy     ")
+        << " pipelined requests=" << REQUEST_COUNT
+        << " req/s=" << (uint64_t)(REQUEST_COUNT * 1e9 / used)
+        << " allocs/req=" << (double)allocs / REQUEST_COUNT;
+    session->close();
+    close(fd);
+}
+
+int main() {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+    std::string data = make_requests();
+    bench(false, data);
+    bench(true, data);
+    return 0;
+}
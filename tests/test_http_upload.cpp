@@ -0,0 +1,182 @@
+#include "sylar/http/http_server.h"
+#include "sylar/sylar.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/resource.h>
+
+// HTTP上传测试，客户端在一个keep-alive连接上上传较大的消息体，服务器分块读取消息体并计算
+// 校验和，对比流式读取和全部读入body两种方式的上传速度及进程内存峰值的增长
+// 另外检查servlet不读取消息体时剩余部分被丢弃，紧跟在消息体之后的下一个请求能正常处理
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const uint16_t PORT       = 8340;
+static const uint64_t UPLOAD_SIZE = 32 * 1024 * 1024; //上传的消息体大小
+static const uint64_t SKIP_SIZE   = 1024 * 1024;      //不读取的消息体大小
+
+static long max_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+static char body_byte(uint64_t i) { return (char)(i * 7); }
+
+/* 分块读取消息体，返回"字节数 校验和" */
+int32_t upload(sylar::http::HttpRequest::ptr req,
+               sylar::http::HttpResponse::ptr rsp,
+               sylar::http::HttpSession::ptr session) {
+    uint64_t bytes = 0;
+    uint64_t sum   = 0;
+    sylar::Stream::ptr stream = req->getBodyStream();
+    if (stream) {
+        std::vector<char> buf(64 * 1024);
+        int n = 0;
+        while ((n = stream->read(&buf[0], buf.size())) > 0) {
+            for (int i = 0; i < n; ++i) {
+                sum += (uint8_t)buf[i];
+            }
+            bytes += n;
+        }
+    } else {
+        for (auto c : req->getBody()) {
+            sum += (uint8_t)c;
+        }
+        bytes = req->getBody().size();
+    }
+    rsp->setBody(std::to_string(bytes) + " " + std::to_string(sum));
+    return 0;
+}
+
+static int connect_server() {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    SYLAR_ASSERT(connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+static void send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        SYLAR_ASSERT(n > 0);
+        data += n;
+        len -= n;
+    }
+}
+
+/* 发送请求头及size字节的消息体，消息体分块生成 */
+static void send_request(int fd, const std::string &path, uint64_t size) {
+    std::string head = "POST " + path +
+                       " HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: " +
+                       std::to_string(size) + "\r\n\r\n";
+    send_all(fd, head.c_str(), head.size());
+    char buf[64 * 1024];
+    for (uint64_t i = 0; i < size;) {
+        size_t n = std::min<uint64_t>(sizeof(buf), size - i);
+        for (size_t j = 0; j < n; ++j) {
+            buf[j] = body_byte(i + j);
+        }
+        send_all(fd, buf, n);
+        i += n;
+    }
+}
+
+/* 读取一个响应，返回响应的消息体，rsp中保留多读到的下一个响应的数据 */
+static std::string recv_response(int fd, std::string &rsp) {
+    char buf[4096];
+    size_t header_end = std::string::npos;
+    size_t length     = 0;
+    while (true) {
+        if (header_end == std::string::npos) {
+            header_end = rsp.find("\r\n\r\n");
+            size_t pos = rsp.find("content-length: ");
+            if (pos != std::string::npos && pos < header_end) {
+                length = atoi(rsp.c_str() + pos + 16);
+            }
+        }
+        if (header_end != std::string::npos &&
+            rsp.size() >= header_end + 4 + length) {
+            break;
+        }
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        SYLAR_ASSERT(n > 0);
+        rsp.append(buf, n);
+    }
+    SYLAR_ASSERT(rsp.compare(0, 12, "HTTP/1.1 200") == 0);
+    std::string body = rsp.substr(header_end + 4, length);
+    rsp.erase(0, header_end + 4 + length);
+    return body;
+}
+
+void client_func(const char *name) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < UPLOAD_SIZE; ++i) {
+        sum += (uint8_t)body_byte(i);
+    }
+    std::string expect =
+        std::to_string(UPLOAD_SIZE) + " " + std::to_string(sum);
+
+    int fd         = connect_server();
+    long rss       = max_rss_kb();
+    uint64_t begin = now_ns();
+    std::string rsp;
+    send_request(fd, "/upload", UPLOAD_SIZE);
+    SYLAR_ASSERT(recv_response(fd, rsp) == expect);
+    uint64_t used = now_ns() - begin;
+
+    //不读取的消息体与下一个请求一起发送
+    send_request(fd, "/skip", SKIP_SIZE);
+    send_request(fd, "/upload", 3);
+    SYLAR_ASSERT(recv_response(fd, rsp) == "skipped");
+    SYLAR_ASSERT(recv_response(fd, rsp) == "3 " + std::to_string(0 + 7 + 14));
+    close(fd);
+
+    SYLAR_LOG_INFO(g_logger)
+        << name << " upload=" << UPLOAD_SIZE / 1024 / 1024 << "MB"
+        << " MB/s=" << (uint64_t)(UPLOAD_SIZE * 1e9 / used / 1024 / 1024)
+        << " max_rss_growth=" << (max_rss_kb() - rss) / 1024 << "MB";
+}
+
+void run(const char *name, uint64_t body_buffer_size) {
+    sylar::ConfigManager::LookUp<uint64_t>("http.request.body_buffer_size")
+        ->setValue(body_buffer_size);
+
+    sylar::http::HttpServer::ptr server(new sylar::http::HttpServer(true));
+    auto sd = server->getServletDispatch();
+    sd->addServlet("/upload", &upload);
+    sd->addServlet("/skip", [](sylar::http::HttpRequest::ptr req,
+                               sylar::http::HttpResponse::ptr rsp,
+                               sylar::http::HttpSession::ptr session) {
+        rsp->setBody("skipped");
+        return 0;
+    });
+    auto addr = sylar::IPAddress::Create("127.0.0.1", PORT);
+    SYLAR_ASSERT(server->bind(addr));
+    server->start();
+
+    sylar::Thread client(std::bind(&client_func, name), "client");
+    client.join();
+    server->stop();
+}
+
+int main() {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+    SYLAR_LOG_NAME("tcpserver")->setLevel(sylar::LogLevel::WARN);
+    sylar::ConfigManager::LookUp<uint32_t>("scheduler.threads")->setValue(2);
+
+    //内存峰值只增不减，先测试流式读取
+    run("stream  ", 64 * 1024);
+    run("buffered", UPLOAD_SIZE);
+    return 0;
+}
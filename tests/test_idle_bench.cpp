@@ -0,0 +1,147 @@
+#include "sylar/sylar.h"
+#include "sylar/stack_allocator.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+// 调度器idle/唤醒性能测试
+// 1. 调度线程反复在idle和执行单个任务之间切换，统计每次唤醒的耗时及协程栈分配次数
+// 2. 大量fd同时就绪，使用不同的scheduler.epoll_batch，统计每个IO事件的调度耗时
+// 3. 外部线程批量添加任务，统计唤醒调度线程的系统调用次数
+// 每项都输出tickle(写eventfd)和epoll_wait的系统调用次数
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int WAKEUP_COUNT = 20000; //唤醒次数
+static const int PIPE_COUNT   = 1000;  //同时就绪的fd数
+static const int BURST_ROUND  = 50;    //每个批量大小测试的轮数
+static const int TASK_BATCH   = 100;   //外部线程每批添加的任务数
+static const int TASK_ROUND   = 1000;  //外部线程添加任务的批数
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+static sylar::Semaphore s_sem;
+
+void notify_task(void *arg) { s_sem.notify(); }
+
+void bench_wakeup() {
+    sylar::Scheduler sc("idle_bench", 1);
+    sc.start();
+
+    sylar::StackAllocator *allocator = sylar::StackAllocator::GetDefault();
+    uint64_t allocs                  = allocator->getStats().allocs;
+    uint64_t begin                   = now_ns();
+    //每次都等任务执行完再添加下一个，调度线程每次都会进入idle后再被唤醒
+    for (int i = 0; i < WAKEUP_COUNT; ++i) {
+        sc.schedule(&notify_task);
+        s_sem.wait();
+    }
+    uint64_t used = now_ns() - begin;
+    allocs        = allocator->getStats().allocs - allocs;
+    sc.stop();
+
+    SYLAR_LOG_INFO(g_logger)
+        << "wakeup: count=" << WAKEUP_COUNT
+        << " schedule+wakeup+run=" << used / WAKEUP_COUNT
+        << "ns stack_allocs=" << allocs << " tickles=" << sc.getTickleCount()
+        << " epoll_waits=" << sc.getEpollWaitCount();
+}
+
+static int s_pipes[PIPE_COUNT][2];
+static std::atomic<int> s_ready{0};
+
+void read_task(void *arg) {
+    char c;
+    int fd = (int)(intptr_t)arg;
+    SYLAR_ASSERT(read(fd, &c, 1) == 1);
+    if (++s_ready == PIPE_COUNT) {
+        s_sem.notify();
+    }
+}
+
+void bench_burst(uint32_t batch) {
+    sylar::ConfigManager::LookUp<uint32_t>("scheduler.epoll_batch")
+        ->setValue(batch);
+    sylar::Scheduler sc("burst_bench", 1);
+    sc.start();
+
+    uint64_t used = 0;
+    for (int r = 0; r < BURST_ROUND; ++r) {
+        s_ready = 0;
+        for (int i = 0; i < PIPE_COUNT; ++i) {
+            int fd = s_pipes[i][0];
+            sc.io_wait(fd, EPOLLIN,
+                       sylar::ScheduleTask(&read_task, (void *)(intptr_t)fd));
+        }
+        uint64_t begin = now_ns();
+        for (int i = 0; i < PIPE_COUNT; ++i) {
+            SYLAR_ASSERT(write(s_pipes[i][1], "x", 1) == 1);
+        }
+        s_sem.wait();
+        used += now_ns() - begin;
+    }
+    sc.stop();
+
+    SYLAR_LOG_INFO(g_logger)
+        << "burst: epoll_batch=" << batch << " fds=" << PIPE_COUNT
+        << " per_event=" << used / (BURST_ROUND * PIPE_COUNT)
+        << "ns events=" << BURST_ROUND * PIPE_COUNT
+        << " tickles=" << sc.getTickleCount()
+        << " epoll_waits=" << sc.getEpollWaitCount();
+}
+
+static std::atomic<int> s_done{0};
+
+void count_task(void *arg) {
+    if (++s_done == TASK_BATCH) {
+        s_sem.notify();
+    }
+}
+
+void bench_schedule(size_t threads) {
+    sylar::Scheduler sc("schedule_bench", threads);
+    sc.start();
+
+    uint64_t begin = now_ns();
+    for (int r = 0; r < TASK_ROUND; ++r) {
+        s_done = 0;
+        for (int i = 0; i < TASK_BATCH; ++i) {
+            sc.schedule(&count_task);
+        }
+        s_sem.wait();
+    }
+    uint64_t used = now_ns() - begin;
+    sc.stop();
+
+    SYLAR_LOG_INFO(g_logger)
+        << "schedule: threads=" << threads << " tasks=" << TASK_BATCH * TASK_ROUND
+        << " per_task=" << used / (TASK_BATCH * TASK_ROUND)
+        << "ns tickles=" << sc.getTickleCount()
+        << " epoll_waits=" << sc.getEpollWaitCount();
+}
+
+int main() {
+    //关闭调度器的调试日志，避免日志输出影响测试结果
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+
+    bench_wakeup();
+
+    for (int i = 0; i < PIPE_COUNT; ++i) {
+        SYLAR_ASSERT(pipe2(s_pipes[i], O_NONBLOCK) == 0);
+    }
+    bench_burst(1);
+    bench_burst(16);
+    bench_burst(256);
+    for (int i = 0; i < PIPE_COUNT; ++i) {
+        close(s_pipes[i][0]);
+        close(s_pipes[i][1]);
+    }
+
+    bench_schedule(1);
+    bench_schedule(4);
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include <fstream>
+#include <time.h>
+#include <unistd.h>
+
+// 异步日志测试，8个线程同时写日志，对比FileLogAppender和AsyncFileLogAppender三种溢出策略
+// 每秒写入的日志行数，检查阻塞策略下日志没有丢失且每个线程的日志保持顺序，丢弃策略下写入
+// 的行数加丢弃数等于总数，drop_debug只丢弃DEBUG日志，最后检查通过配置创建异步appender
+
+static const int THREADS = 8;
+static const int LINES   = 100000; //每个线程的日志行数
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
+static std::string log_file(const std::string &name) {
+    return "/tmp/test_log_async_" + name + "_" + std::to_string(getpid()) +
+           ".log";
+}
+
+/* 每个线程写LINES行，奇数行为DEBUG，返回耗时(us) */
+static uint64_t write_logs(sylar::Logger::ptr logger) {
+    std::vector<sylar::Thread::ptr> thrs;
+    uint64_t begin = now_us();
+    for (int i = 0; i < THREADS; ++i) {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread(
+            [logger, i]() {
+                for (int j = 0; j < LINES; ++j) {
+                    if (j % 2) {
+                        SYLAR_LOG_DEBUG(logger) << "thread " << i << " seq " << j;
+                    } else {
+                        SYLAR_LOG_INFO(logger) << "thread " << i << " seq " << j;
+                    }
+                }
+            },
+            "log_" + std::to_string(i))));
+    }
+    for (auto &i : thrs) {
+        i->join();
+    }
+    return now_us() - begin;
+}
+
+/* 统计各级别的行数，检查每个线程的序号递增 */
+static void check_file(const std::string &file, uint64_t &info,
+                       uint64_t &debug) {
+    std::ifstream ifs(file);
+    std::string line;
+    int last[THREADS];
+    for (auto &i : last) {
+        i = -1;
+    }
+    info  = 0;
+    debug = 0;
+    while (std::getline(ifs, line)) {
+        int thread = 0;
+        int seq    = 0;
+        size_t pos = line.find("thread ");
+        SYLAR_ASSERT(pos != std::string::npos);
+        SYLAR_ASSERT(sscanf(line.c_str() + pos, "thread %d seq %d", &thread,
+                            &seq) == 2);
+        SYLAR_ASSERT(thread >= 0 && thread < THREADS);
+        SYLAR_ASSERT(seq > last[thread]);
+        last[thread] = seq;
+        ++(line.find("DEBUG") != std::string::npos ? debug : info);
+    }
+}
+
+static void bench(const std::string &name, sylar::LogAppender::ptr appender) {
+    std::string file = log_file(name);
+    sylar::Logger::ptr logger(new sylar::Logger(name));
+    logger->setLevel(sylar::LogLevel::UNKNOWN);
+    logger->addAppender(appender);
+
+    uint64_t used = write_logs(logger);
+    auto async    = std::dynamic_pointer_cast<sylar::AsyncFileLogAppender>(
+        appender);
+    uint64_t dropped = 0;
+    if (async) {
+        async->flush();
+        dropped = async->getDropped();
+    }
+    logger->clearAppenders();
+    appender.reset();
+
+    uint64_t info  = 0;
+    uint64_t debug = 0;
+    check_file(file, info, debug);
+    unlink(file.c_str());
+
+    uint64_t total = THREADS * LINES;
+    std::cout << name << " lines/s=" << (uint64_t)(total * 1e6 / used)
+              << " written=" << info + debug << " dropped=" << dropped
+              << " (debug " << total / 2 - debug << ")" << std::endl;
+    SYLAR_ASSERT(info + debug + dropped == total);
+    if (!async || async->getPolicy() == sylar::AsyncFileLogAppender::BLOCK) {
+        SYLAR_ASSERT(dropped == 0);
+    } else if (async->getPolicy() ==
+               sylar::AsyncFileLogAppender::DROP_DEBUG) {
+        SYLAR_ASSERT(info == total / 2);
+    }
+}
+
+/* 通过配置创建 */
+static void check_config() {
+    std::string file = log_file("config");
+    YAML::Node root  = YAML::Load("logs:\n"
+                                  "  - name: async\n"
+                                  "    level: info\n"
+                                  "    appenders:\n"
+                                  "      - type: AsyncFileLogAppender\n"
+                                  "        file: " +
+                                  file +
+                                  "\n"
+                                  "        overflow: drop_debug\n"
+                                  "        buffer_size: 10000\n"
+                                  "        flush_interval: 10\n");
+    sylar::ConfigManager::LoadFromYaml(root);
+    auto logger = SYLAR_LOG_NAME("async");
+    std::string yaml = logger->toYamlString();
+    std::cout << yaml << std::endl;
+    SYLAR_ASSERT(yaml.find("AsyncFileLogAppender") != std::string::npos);
+    SYLAR_ASSERT(yaml.find("drop_debug") != std::string::npos);
+    SYLAR_ASSERT(yaml.find("16384") != std::string::npos);
+
+    SYLAR_LOG_ERROR(logger) << "thread 0 seq 0";
+    //等待刷新线程写出
+    usleep(100 * 1000);
+    uint64_t info  = 0;
+    uint64_t debug = 0;
+    check_file(file, info, debug);
+    SYLAR_ASSERT(info == 1);
+    logger->clearAppenders();
+    unlink(file.c_str());
+    std::cout << "check config ok" << std::endl;
+}
+
+int main() {
+    check_config();
+    bench("file", sylar::LogAppender::ptr(
+                      new sylar::FileLogAppender(log_file("file"))));
+    bench("async_block",
+          sylar::LogAppender::ptr(new sylar::AsyncFileLogAppender(
+              log_file("async_block"), sylar::AsyncFileLogAppender::BLOCK)));
+    bench("async_drop",
+          sylar::LogAppender::ptr(new sylar::AsyncFileLogAppender(
+              log_file("async_drop"), sylar::AsyncFileLogAppender::DROP)));
+    bench("async_drop_debug",
+          sylar::LogAppender::ptr(new sylar::AsyncFileLogAppender(
+              log_file("async_drop_debug"),
+              sylar::AsyncFileLogAppender::DROP_DEBUG)));
+    return 0;
+}
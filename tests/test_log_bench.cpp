@@ -0,0 +1,159 @@
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include <atomic>
+#include <climits>
+#include <fstream>
+#include <new>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// 日志调用开销测试，先检查整数、浮点数、字符串、控制符、自定义类型、printf格式、超长内容
+// 和在operator<<中嵌套写日志的输出，再统计单线程每次日志调用的耗时(ns)和内存分配次数，包括级别被过滤、输出到
+// /dev/null的FileLogAppender、两个appender、AsyncFileLogAppender和超过1KB的日志内容
+
+static std::atomic<uint64_t> s_allocs{0};
+
+void *operator new(size_t size) {
+    ++s_allocs;
+    void *p = malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+struct Point {
+    int x;
+    int y;
+};
+
+std::ostream &operator<<(std::ostream &os, const Point &p) {
+    return os << "(" << p.x << "," << p.y << ")";
+}
+
+/* 输出时写另一条日志，两条日志的格式互不影响 */
+struct Nested {
+    sylar::Logger::ptr logger;
+};
+
+std::ostream &operator<<(std::ostream &os, const Nested &n) {
+    SYLAR_LOG_INFO(n.logger) << Point{10, 11} << std::hex << 255;
+    return os << "nested";
+}
+
+void check() {
+    std::string file = "/tmp/test_log_bench_" + std::to_string(getpid());
+    sylar::Logger::ptr logger(new sylar::Logger("check"));
+    logger->setLevel(sylar::LogLevel::UNKNOWN);
+    logger->setFormatter(sylar::LogFormatter::ptr(
+        new sylar::LogFormatter("[%p %c] %m%n")));
+    sylar::LogAppender::ptr appender(new sylar::FileLogAppender(file));
+    logger->addAppender(appender);
+
+    std::string long_str(3000, 'x');
+    const char *cstr = "cstr";
+    char buf[]       = "buf";
+    SYLAR_LOG_INFO(logger) << 0 << " " << -1 << " " << INT_MIN << " "
+                           << LLONG_MIN << " " << ULLONG_MAX << " "
+                           << (short)-5 << " " << (unsigned short)65535;
+    SYLAR_LOG_INFO(logger) << 3.14159265 << " " << 1e20 << " " << 0.1f << " "
+                           << -0.0 << " " << 100.0 << " " << 1.0 / 0.0;
+    SYLAR_LOG_WARN(logger) << true << " " << 'c' << " " << cstr << " " << buf
+                           << " " << std::string("str") << std::endl
+                           << "next";
+    SYLAR_LOG_ERROR(logger) << std::hex << 255 << " " << std::dec << 255 << " "
+                            << Point{1, 2} << " " << sylar::LogLevel::ERROR;
+    SYLAR_LOG_ERROR(logger) << std::hex << 255 << " " << Nested{logger} << " "
+                            << 255 << " " << Point{10, 11};
+    SYLAR_LOG_INFO(logger) << Point{10, 11} << " " << 255;
+    SYLAR_LOG_INFO(logger) << long_str << "|" << 42;
+    SYLAR_LOG_DEBUG(logger) << "debug";
+    sylar::LogEventWrap(logger, sylar::LogLevel::FATAL, __FILE__, __LINE__, 0,
+                        0, 0, time(0))
+        .getEvent()
+        ->format("%d-%s-%.2f", 7, "fmt", 2.5);
+    logger->clearAppenders();
+    appender.reset();
+
+    std::ifstream ifs(file);
+    std::string content((std::istreambuf_iterator<char>(ifs)),
+                        std::istreambuf_iterator<char>());
+    unlink(file.c_str());
+    std::string expect =
+        "[INFO check] 0 -1 -2147483648 -9223372036854775808 "
+        "18446744073709551615 -5 65535\n"
+        "[INFO check] 3.14159 1e+20 0.1 -0 100 inf\n"
+        "[WARN check] 1 c cstr buf str\nnext\n"
+        "[ERROR check] ff 255 (1,2) 4\n"
+        "[INFO check] (10,11)ff\n"
+        "[ERROR check] ff nested ff (a,b)\n"
+        "[INFO check] (10,11) 255\n"
+        "[INFO check] " +
+        long_str +
+        "|42\n"
+        "[DEBUG check] debug\n"
+        "[FATAL check] 7-fmt-2.50\n";
+    if (content != expect) {
+        std::cout << "content:\n" << content << "expect:\n" << expect;
+    }
+    SYLAR_ASSERT(content == expect);
+    std::cout << "check ok" << std::endl;
+}
+
+static void bench(const std::string &name, sylar::Logger::ptr logger,
+                  bool long_msg = false) {
+    const uint64_t count = 200000;
+    std::string path     = "/api/v1/user/list";
+    std::string long_str(2000, 'x');
+    uint64_t allocs = s_allocs;
+    uint64_t begin  = now_ns();
+    for (uint64_t i = 0; i < count; ++i) {
+        if (long_msg) {
+            SYLAR_LOG_INFO(logger) << "long " << long_str << " id=" << i;
+        } else {
+            SYLAR_LOG_INFO(logger) << "request id=" << i << " path=" << path
+                                   << " status=" << 200 << " cost=" << 1.25
+                                   << "ms";
+        }
+    }
+    uint64_t used = now_ns() - begin;
+    allocs        = s_allocs - allocs;
+    std::cout << name << " ns/log=" << used / count
+              << " allocs/log=" << (double)allocs / count << std::endl;
+}
+
+int main() {
+    check();
+
+    sylar::Logger::ptr disabled(new sylar::Logger("disabled"));
+    disabled->setLevel(sylar::LogLevel::ERROR);
+    bench("disabled         ", disabled);
+
+    sylar::Logger::ptr file(new sylar::Logger("file"));
+    file->addAppender(
+        sylar::LogAppender::ptr(new sylar::FileLogAppender("/dev/null")));
+    bench("file             ", file);
+    bench("file long        ", file, true);
+
+    sylar::Logger::ptr two(new sylar::Logger("two"));
+    two->addAppender(
+        sylar::LogAppender::ptr(new sylar::FileLogAppender("/dev/null")));
+    two->addAppender(
+        sylar::LogAppender::ptr(new sylar::FileLogAppender("/dev/null")));
+    bench("two file         ", two);
+
+    sylar::Logger::ptr async(new sylar::Logger("async"));
+    async->addAppender(sylar::LogAppender::ptr(
+        new sylar::AsyncFileLogAppender("/dev/null")));
+    bench("async            ", async);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "sylar/sylar.h"
+#include <sys/time.h>
+#include <thread>
+#include <vector>
+
+// 多线程协程调度器吞吐量测试，分别使用1~N个调度线程执行相同数量的计算型任务，
+// 统计每秒完成的任务数及相对单线程的加速比
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int TASK_COUNT = 20000;  //任务数
+static const int TASK_LOOPS = 200000; //每个任务的计算量
+
+static std::atomic<uint64_t> s_done{0};
+
+static uint64_t now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
+}
+
+void cpu_task(void *arg) {
+    volatile uint64_t v = (uint64_t)arg;
+    for (int i = 0; i < TASK_LOOPS; ++i) {
+        v = v * 6364136223846793005ul + 1442695040888963407ul;
+    }
+    ++s_done;
+}
+
+double bench(size_t threads) {
+    s_done = 0;
+    sylar::Scheduler sc("bench", threads);
+    for (int i = 0; i < TASK_COUNT; ++i) {
+        sc.schedule(&cpu_task, (void *)(uint64_t)i);
+    }
+
+    uint64_t begin = now_us();
+    sc.start();
+    sc.stop();
+    uint64_t used = now_us() - begin;
+
+    SYLAR_ASSERT(s_done == TASK_COUNT);
+    return TASK_COUNT * 1000.0 * 1000.0 / used;
+}
+
+int main() {
+    //关闭调度器的调试日志，避免日志输出影响测试结果
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+
+    size_t cores = std::thread::hardware_concurrency();
+    if (cores == 0) {
+        cores = 1;
+    }
+    SYLAR_LOG_INFO(g_logger) << "cores=" << cores << " tasks=" << TASK_COUNT;
+
+    //2的幂个线程，最后一轮使用全部核心
+    std::vector<size_t> threads;
+    for (size_t n = 1; n < cores; n *= 2) {
+        threads.push_back(n);
+    }
+    threads.push_back(cores);
+
+    double base = 0;
+    for (auto n : threads) {
+        double tps = bench(n);
+        if (n == 1) {
+            base = tps;
+        }
+        SYLAR_LOG_INFO(g_logger) << "threads=" << n << " tasks/s=" << (uint64_t)tps
+                                 << " speedup=" << tps / base;
+    }
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include "sylar/http/servlet.h"
+#include "sylar/sylar.h"
+#include <atomic>
+#include <time.h>
+
+// ServletDispatch多线程分发测试
+// 对比改动前的读写锁保护路由表、返回servlet的shared_ptr拷贝和RCU路由表快照两种方式在
+// 1、2、4、8个线程同时分发请求时的总吞吐，再在分发的同时不断添加删除路由，检查已有的
+// 路由始终能匹配，分发时使用的servlet没有被提前释放，被替换的路由表和其中的servlet
+// 最终都被释放
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int ROUTES = 100;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+/* 改动前的方式 */
+class LockedDispatch {
+public:
+    void addServlet(const std::string &uri, sylar::http::Servlet::ptr slt) {
+        sylar::RWMutex::WriteLock lock(m_mutex);
+        m_routes.add(uri, slt, false);
+    }
+
+    int32_t handle(sylar::http::HttpRequest::ptr request,
+                   sylar::http::HttpResponse::ptr response) {
+        sylar::http::Servlet::ptr slt;
+        {
+            sylar::RWMutex::ReadLock lock(m_mutex);
+            sylar::http::RouteTree::Params params;
+            const sylar::http::Servlet::ptr *rt =
+                m_routes.match(request->getPath(), params);
+            slt = rt ? *rt : m_default;
+        }
+        return slt->handle(request, response, nullptr);
+    }
+
+    sylar::http::Servlet::ptr m_default;
+
+private:
+    sylar::RWMutex m_mutex;
+    sylar::http::RouteTree m_routes;
+};
+
+static std::atomic<int> s_alive{0}; //未释放的CountServlet个数
+
+class CountServlet : public sylar::http::Servlet {
+public:
+    CountServlet()
+        : Servlet("CountServlet") {
+        ++s_alive;
+    }
+    ~CountServlet() {
+        m_magic = 0;
+        --s_alive;
+    }
+
+    virtual int32_t handle(sylar::http::HttpRequest::ptr request,
+                           sylar::http::HttpResponse::ptr response,
+                           sylar::http::HttpSession::ptr session) override {
+        //路由表被提前释放时，servlet可能已经析构
+        SYLAR_ASSERT(m_magic == MAGIC);
+        response->setStatus(sylar::http::HttpStatus::OK);
+        return 0;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x5e41e7;
+    volatile uint32_t m_magic   = MAGIC;
+};
+
+static std::string route(int i) {
+    return "/api/v1/res" + std::to_string(i) + "/list";
+}
+
+template <class Dispatch>
+static void dispatch_loop(Dispatch *sd, int thread, uint64_t count) {
+    sylar::http::HttpRequest::ptr req(new sylar::http::HttpRequest);
+    sylar::http::HttpResponse::ptr rsp(new sylar::http::HttpResponse);
+    std::vector<std::string> paths;
+    for (int i = 0; i < ROUTES; ++i) {
+        paths.push_back(route((i * 7 + thread) % ROUTES));
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        req->setPath(paths[i % paths.size()]);
+        rsp->setStatus(sylar::http::HttpStatus::BAD_REQUEST);
+        sd->handle(req, rsp, nullptr);
+        SYLAR_ASSERT(rsp->getStatus() == sylar::http::HttpStatus::OK);
+    }
+}
+
+template <class Dispatch>
+static uint64_t run(Dispatch *sd, int threads, uint64_t count) {
+    std::vector<sylar::Thread::ptr> thrs;
+    uint64_t begin = now_ns();
+    for (int i = 0; i < threads; ++i) {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread(
+            [sd, i, count]() { dispatch_loop(sd, i, count); },
+            "dispatch_" + std::to_string(i))));
+    }
+    for (auto &i : thrs) {
+        i->join();
+    }
+    return now_ns() - begin;
+}
+
+/* 让LockedDispatch与ServletDispatch的handle参数一致 */
+struct LockedAdapter {
+    LockedDispatch *sd;
+    int32_t handle(sylar::http::HttpRequest::ptr request,
+                   sylar::http::HttpResponse::ptr response,
+                   sylar::http::HttpSession::ptr) {
+        return sd->handle(request, response);
+    }
+};
+
+void bench() {
+    sylar::http::ServletDispatch::ptr sd(new sylar::http::ServletDispatch);
+    LockedDispatch locked;
+    locked.m_default = sd->getDefault();
+    sylar::http::Servlet::ptr slt(new CountServlet);
+    for (int i = 0; i < ROUTES; ++i) {
+        sd->addServlet(route(i), slt);
+        locked.addServlet(route(i), slt);
+    }
+    LockedAdapter adapter{&locked};
+
+    const uint64_t count = 200000;
+    int threads[]        = {1, 2, 4, 8};
+    for (auto n : threads) {
+        uint64_t used_locked = run(&adapter, n, count);
+        uint64_t used_rcu    = run(sd.get(), n, count);
+        SYLAR_LOG_INFO(g_logger)
+            << "threads=" << n << " rwlock dispatch/s="
+            << (uint64_t)(n * count * 1e9 / used_locked)
+            << " rcu dispatch/s=" << (uint64_t)(n * count * 1e9 / used_rcu);
+    }
+}
+
+/* 分发的同时修改路由 */
+void check_update() {
+    {
+        sylar::http::ServletDispatch::ptr sd(new sylar::http::ServletDispatch);
+        for (int i = 0; i < ROUTES; ++i) {
+            sd->addServlet(route(i), sylar::http::Servlet::ptr(new CountServlet));
+        }
+
+        std::atomic<bool> stop{false};
+        uint64_t updates = 0;
+        sylar::Thread writer(
+            [&sd, &stop, &updates]() {
+                while (!stop) {
+                    std::string uri = "/tmp/" + std::to_string(updates % 10);
+                    sd->addServlet(uri, sylar::http::Servlet::ptr(new CountServlet));
+                    //替换已有的路由
+                    sd->addServlet(route(updates % ROUTES),
+                                   sylar::http::Servlet::ptr(new CountServlet));
+                    sd->delServlet(uri);
+                    ++updates;
+                }
+            },
+            "writer");
+        run(sd.get(), 8, 50000);
+        stop = true;
+        writer.join();
+        //没有读者时下一次修改释放全部旧路由表
+        sd->delServlet("/none");
+        SYLAR_LOG_INFO(g_logger) << "updates=" << updates
+                                 << " alive servlets=" << s_alive;
+        SYLAR_ASSERT(s_alive == ROUTES);
+    }
+    SYLAR_ASSERT(s_alive == 0);
+    SYLAR_LOG_INFO(g_logger) << "check update ok";
+}
+
+int main() {
+    check_update();
+    bench();
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include "sylar/http/servlet.h"
+#include "sylar/sylar.h"
+#include <fnmatch.h>
+#include <time.h>
+
+// ServletDispatch路由测试，先检查静态路径、参数、通配符的匹配优先级和回溯、路径参数、
+// fnmatch模糊匹配和删除，再对比改动前的unordered_map加fnmatch逐个匹配和路由树在10、
+// 100、1000个路由时每次匹配的耗时，分别统计命中和未命中
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+/* 改动前的匹配方式 */
+class OldDispatch {
+public:
+    void addServlet(const std::string &uri, sylar::http::Servlet::ptr slt) {
+        sylar::RWMutex::WriteLock lock(m_mutex);
+        m_datas[uri] = slt;
+    }
+
+    void addGlobServlet(const std::string &uri, sylar::http::Servlet::ptr slt) {
+        sylar::RWMutex::WriteLock lock(m_mutex);
+        m_globs.push_back(std::make_pair(uri, slt));
+    }
+
+    sylar::http::Servlet::ptr getMatchedServlet(const std::string &uri) {
+        sylar::RWMutex::ReadLock lock(m_mutex);
+        auto mit = m_datas.find(uri);
+        if (mit != m_datas.end()) {
+            return mit->second;
+        }
+        for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
+            if (!fnmatch(it->first.c_str(), uri.c_str(), 0)) {
+                return it->second;
+            }
+        }
+        return m_default;
+    }
+
+    sylar::http::Servlet::ptr m_default;
+
+private:
+    sylar::RWMutex m_mutex;
+    std::unordered_map<std::string, sylar::http::Servlet::ptr> m_datas;
+    std::vector<std::pair<std::string, sylar::http::Servlet::ptr>> m_globs;
+};
+
+static sylar::http::Servlet::ptr make_servlet(const std::string &name) {
+    sylar::http::Servlet::ptr slt(new sylar::http::FunctionServlet(
+        [name](sylar::http::HttpRequest::ptr req,
+               sylar::http::HttpResponse::ptr rsp,
+               sylar::http::HttpSession::ptr session) {
+            rsp->setBody(name);
+            return 0;
+        }));
+    return slt;
+}
+
+/* 分发请求，返回servlet设置的消息体 */
+static std::string dispatch(sylar::http::ServletDispatch::ptr sd,
+                            sylar::http::HttpRequest::ptr req,
+                            const std::string &path) {
+    req->reset();
+    req->setPath(path);
+    sylar::http::HttpResponse::ptr rsp(new sylar::http::HttpResponse);
+    sd->handle(req, rsp, nullptr);
+    return rsp->getStatus() == sylar::http::HttpStatus::NOT_FOUND
+               ? "404"
+               : rsp->getBody();
+}
+
+void check() {
+    sylar::http::ServletDispatch::ptr sd(new sylar::http::ServletDispatch);
+    sylar::http::HttpRequest::ptr req(new sylar::http::HttpRequest);
+    const char *routes[] = {"/",
+                            "/user",
+                            "/user/list",
+                            "/user/:id",
+                            "/user/:id/profile",
+                            "/user/:id/post/:post",
+                            "/users",
+                            "/use",
+                            "/a*b"};
+    for (auto r : routes) {
+        sd->addServlet(r, make_servlet(r));
+    }
+    const char *globs[] = {"/static/*", "/static/img/*", "/user/:id/file/*",
+                           "/*.html", "/doc/?.txt", "/x"};
+    for (auto g : globs) {
+        sd->addGlobServlet(g, make_servlet(std::string("glob ") + g));
+    }
+
+    //静态路径、压缩节点的拆分
+    SYLAR_ASSERT(dispatch(sd, req, "/") == "/");
+    SYLAR_ASSERT(dispatch(sd, req, "/user") == "/user");
+    SYLAR_ASSERT(dispatch(sd, req, "/users") == "/users");
+    SYLAR_ASSERT(dispatch(sd, req, "/use") == "/use");
+    SYLAR_ASSERT(dispatch(sd, req, "/us") == "404");
+    SYLAR_ASSERT(dispatch(sd, req, "/a*b") == "/a*b");
+    SYLAR_ASSERT(dispatch(sd, req, "/aXb") == "404");
+
+    //静态优先于参数，参数匹配一个非空的路径段
+    SYLAR_ASSERT(dispatch(sd, req, "/user/list") == "/user/list");
+    SYLAR_ASSERT(req->getPathParams().empty());
+    SYLAR_ASSERT(dispatch(sd, req, "/user/42") == "/user/:id");
+    SYLAR_ASSERT(req->getPathParam("id") == "42");
+    SYLAR_ASSERT(req->getPathParamAs<int>("id") == 42);
+    //"list"匹配静态节点后不匹配，回溯到参数
+    SYLAR_ASSERT(dispatch(sd, req, "/user/list/profile") == "/user/:id/profile");
+    SYLAR_ASSERT(req->getPathParam("id") == "list");
+    SYLAR_ASSERT(dispatch(sd, req, "/user/7/post/abc") ==
+                 "/user/:id/post/:post");
+    SYLAR_ASSERT(req->getPathParam("id") == "7");
+    SYLAR_ASSERT(req->getPathParam("post") == "abc");
+    SYLAR_ASSERT(dispatch(sd, req, "/user/") == "404");
+    SYLAR_ASSERT(dispatch(sd, req, "/user/7/post") == "404");
+
+    //通配符
+    SYLAR_ASSERT(dispatch(sd, req, "/static/") == "glob /static/*");
+    SYLAR_ASSERT(dispatch(sd, req, "/static/js/a.js") == "glob /static/*");
+    SYLAR_ASSERT(req->getPathParam("*") == "js/a.js");
+    SYLAR_ASSERT(dispatch(sd, req, "/static/img/a.png") == "glob /static/img/*");
+    SYLAR_ASSERT(req->getPathParam("*") == "a.png");
+    SYLAR_ASSERT(dispatch(sd, req, "/static/imgx") == "glob /static/*");
+    SYLAR_ASSERT(dispatch(sd, req, "/user/9/file/a/b") == "glob /user/:id/file/*");
+    SYLAR_ASSERT(req->getPathParam("id") == "9");
+    SYLAR_ASSERT(req->getPathParam("*") == "a/b");
+
+    //不能加入路由树的模式使用fnmatch
+    SYLAR_ASSERT(dispatch(sd, req, "/index.html") == "glob /*.html");
+    SYLAR_ASSERT(dispatch(sd, req, "/doc/a.txt") == "glob /doc/?.txt");
+    SYLAR_ASSERT(dispatch(sd, req, "/x") == "glob /x");
+    //路由树优先
+    SYLAR_ASSERT(dispatch(sd, req, "/static/a.html") == "glob /static/*");
+
+    //获取和删除
+    SYLAR_ASSERT(sd->getServlet("/user/:id"));
+    SYLAR_ASSERT(!sd->getServlet("/user/:name"));
+    SYLAR_ASSERT(!sd->getServlet("/static/*"));
+    SYLAR_ASSERT(sd->getGlobServlet("/static/*"));
+    SYLAR_ASSERT(sd->getGlobServlet("/*.html"));
+    sd->delServlet("/user/:id");
+    SYLAR_ASSERT(dispatch(sd, req, "/user/42") == "404");
+    SYLAR_ASSERT(dispatch(sd, req, "/user/42/profile") == "/user/:id/profile");
+    sd->delGlobServlet("/static/img/*");
+    SYLAR_ASSERT(dispatch(sd, req, "/static/img/a.png") == "glob /static/*");
+    sd->delGlobServlet("/*.html");
+    SYLAR_ASSERT(dispatch(sd, req, "/index.html") == "404");
+
+    //同一位置的参数名不一致时不添加
+    sd->addServlet("/user/:name/other", make_servlet("other"));
+    SYLAR_ASSERT(dispatch(sd, req, "/user/42/other") == "404");
+    SYLAR_LOG_INFO(g_logger) << "check ok";
+}
+
+void bench(size_t count) {
+    sylar::http::ServletDispatch::ptr sd(new sylar::http::ServletDispatch);
+    OldDispatch old;
+    old.m_default = sd->getDefault();
+
+    //三分之一静态路径、三分之一前缀匹配、三分之一参数
+    std::vector<std::string> hits;
+    std::vector<std::string> misses;
+    for (size_t i = 0; i < count; ++i) {
+        std::string id = std::to_string(i);
+        auto slt       = make_servlet(id);
+        switch (i % 3) {
+        case 0:
+            sd->addServlet("/api/v1/res" + id + "/list", slt);
+            old.addServlet("/api/v1/res" + id + "/list", slt);
+            hits.push_back("/api/v1/res" + id + "/list");
+            break;
+        case 1:
+            sd->addGlobServlet("/static/res" + id + "/*", slt);
+            old.addGlobServlet("/static/res" + id + "/*", slt);
+            hits.push_back("/static/res" + id + "/js/app.js");
+            break;
+        default:
+            sd->addServlet("/user/:id/res" + id, slt);
+            old.addGlobServlet("/user/*/res" + id, slt);
+            hits.push_back("/user/12345/res" + id);
+            break;
+        }
+        misses.push_back("/api/v2/res" + id + "/list");
+    }
+    for (auto &i : hits) {
+        SYLAR_ASSERT(sd->getMatchedServlet(i) == old.getMatchedServlet(i));
+        SYLAR_ASSERT(sd->getMatchedServlet(i) != sd->getDefault());
+    }
+    for (auto &i : misses) {
+        SYLAR_ASSERT(sd->getMatchedServlet(i) == sd->getDefault());
+        SYLAR_ASSERT(old.getMatchedServlet(i) == sd->getDefault());
+    }
+
+    const size_t lookups = 300000;
+    uint64_t used[2][2]; // [old/tree][hit/miss]
+    for (int t = 0; t < 2; ++t) {
+        for (int m = 0; m < 2; ++m) {
+            auto &paths    = m ? misses : hits;
+            uint64_t begin = now_ns();
+            for (size_t i = 0; i < lookups; ++i) {
+                auto &path = paths[i % paths.size()];
+                auto slt   = t ? sd->getMatchedServlet(path)
+                               : old.getMatchedServlet(path);
+                SYLAR_ASSERT(slt);
+            }
+            used[t][m] = now_ns() - begin;
+        }
+    }
+    for (int t = 0; t < 2; ++t) {
+        SYLAR_LOG_INFO(g_logger)
+            << (t ? "radix tree   " : "map+fnmatch  ") << " routes=" << count
+            << " hit ns/lookup=" << used[t][0] / lookups
+            << " miss ns/lookup=" << used[t][1] / lookups;
+    }
+}
+
+int main() {
+    check();
+    size_t counts[] = {10, 100, 1000};
+    for (auto i : counts) {
+        bench(i);
+    }
+    return 0;
+}
@@ -0,0 +1,318 @@
+#include "sylar/http/http_server.h"
+#include "sylar/http/static_file_servlet.h"
+#include "sylar/sylar.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <map>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// StaticFileServlet测试，先检查Range、ETag/If-Modified-Since条件请求、HEAD、路径检查、
+// 文件修改后重新打开和发送失败时关闭连接，再在一个keep-alive连接上对比sendfile发送和
+// 每次读入文件后setBody两种方式在不同文件大小下每秒处理的请求数
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const uint16_t PORT = 8370;
+static std::string s_root;
+
+static const struct {
+    const char *name;
+    size_t size;
+    int count; //性能测试的请求数
+} s_files[] = {
+    {"small.txt", 4 * 1024, 20000},
+    {"medium.bin", 64 * 1024, 10000},
+    {"large.bin", 1024 * 1024, 1000},
+    {"huge.bin", 8 * 1024 * 1024, 200},
+};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+static std::string file_content(size_t size, char seed) {
+    std::string data(size, 0);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = seed + i % 61;
+    }
+    return data;
+}
+
+static void write_file(const std::string &name, const std::string &data) {
+    std::string path = s_root + "/" + name;
+    FILE *fp         = fopen(path.c_str(), "wb");
+    SYLAR_ASSERT(fp);
+    SYLAR_ASSERT(fwrite(data.c_str(), 1, data.size(), fp) == data.size());
+    fclose(fp);
+}
+
+/* 对比用的servlet，每个请求打开文件并读入body */
+int32_t read_file(sylar::http::HttpRequest::ptr req,
+                  sylar::http::HttpResponse::ptr rsp,
+                  sylar::http::HttpSession::ptr session) {
+    std::string path = s_root + "/" + req->getPath().substr(6);
+    int fd           = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        rsp->setStatus(sylar::http::HttpStatus::NOT_FOUND);
+        return 0;
+    }
+    std::string body(st.st_size, 0);
+    size_t offset = 0;
+    while (offset < body.size()) {
+        ssize_t n = read(fd, &body[offset], body.size() - offset);
+        if (n <= 0) {
+            break;
+        }
+        offset += n;
+    }
+    close(fd);
+    rsp->setHeader("Content-Type", "application/octet-stream");
+    rsp->setBody(body);
+    return 0;
+}
+
+struct Response {
+    int status = 0;
+    std::map<std::string, std::string> headers; //头部名称转为小写
+    std::string body;
+};
+
+class Client {
+public:
+    Client() {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(PORT);
+        addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        m_fd                 = socket(AF_INET, SOCK_STREAM, 0);
+        SYLAR_ASSERT(connect(m_fd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    }
+    ~Client() { close(m_fd); }
+
+    /* 发送请求并读取响应，head为true时响应没有消息体，keep_body为false时丢弃消息体 */
+    Response request(const std::string &method, const std::string &path,
+                     const std::string &headers = "", bool keep_body = true) {
+        std::string req = method + " " + path +
+                          " HTTP/1.1\r\nHost: 127.0.0.1\r\n" + headers +
+                          "\r\n";
+        SYLAR_ASSERT(send(m_fd, req.c_str(), req.size(), MSG_NOSIGNAL) ==
+                     (ssize_t)req.size());
+
+        Response rsp;
+        size_t pos;
+        while ((pos = m_data.find("\r\n\r\n")) == std::string::npos) {
+            fill();
+        }
+        std::string head = m_data.substr(0, pos + 2);
+        m_data.erase(0, pos + 4);
+        rsp.status = atoi(head.c_str() + 9);
+        size_t begin = head.find("\r\n") + 2;
+        while (begin < head.size()) {
+            size_t end   = head.find("\r\n", begin);
+            size_t colon = head.find(": ", begin);
+            std::string name = head.substr(begin, colon - begin);
+            for (auto &c : name) {
+                c = tolower(c);
+            }
+            rsp.headers[name] = head.substr(colon + 2, end - colon - 2);
+            begin             = end + 2;
+        }
+        SYLAR_ASSERT(rsp.status == 304 || rsp.headers.count("content-length"));
+        size_t length = method == "HEAD" || rsp.status == 304
+                            ? 0
+                            : atoll(rsp.headers["content-length"].c_str());
+        while (length > 0) {
+            if (m_data.empty()) {
+                fill();
+            }
+            size_t n = std::min(length, m_data.size());
+            if (keep_body) {
+                rsp.body.append(m_data, 0, n);
+            }
+            m_data.erase(0, n);
+            length -= n;
+        }
+        return rsp;
+    }
+
+private:
+    void fill() {
+        static thread_local char buf[256 * 1024];
+        ssize_t n = recv(m_fd, buf, sizeof(buf), 0);
+        SYLAR_ASSERT(n > 0);
+        m_data.append(buf, n);
+    }
+
+private:
+    int m_fd;
+    std::string m_data;
+};
+
+/* 缓存的文件在检查间隔内被截断，sendfile发送不完整，服务器应关闭连接而不是继续
+ * 等待下一个请求
+ */
+void check_send_fail() {
+    Client client;
+    std::string data = file_content(s_files[1].size, 'a');
+    SYLAR_ASSERT(client.request("GET", "/static/medium.bin").body == data);
+    write_file("medium.bin", "");
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd               = socket(AF_INET, SOCK_STREAM, 0);
+    SYLAR_ASSERT(connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    timeval tv = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    std::string req =
+        "GET /static/medium.bin HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    SYLAR_ASSERT(send(fd, req.c_str(), req.size(), MSG_NOSIGNAL) ==
+                 (ssize_t)req.size());
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+    }
+    //连接被关闭而不是超时
+    SYLAR_ASSERT(n == 0);
+    close(fd);
+
+    write_file("medium.bin", data);
+}
+
+void check() {
+    Client client;
+    std::string data = file_content(s_files[0].size, 'a');
+
+    Response rsp = client.request("GET", "/static/small.txt");
+    SYLAR_ASSERT(rsp.status == 200 && rsp.body == data);
+    SYLAR_ASSERT(rsp.headers["content-type"] == "text/plain");
+    SYLAR_ASSERT(rsp.headers["accept-ranges"] == "bytes");
+    std::string etag          = rsp.headers["etag"];
+    std::string last_modified = rsp.headers["last-modified"];
+    SYLAR_ASSERT(!etag.empty() && !last_modified.empty());
+    SYLAR_LOG_INFO(g_logger) << "etag=" << etag
+                             << " last-modified=" << last_modified;
+
+    //条件请求
+    rsp = client.request("GET", "/static/small.txt",
+                         "If-None-Match: \"x\", W/" + etag + "\r\n");
+    SYLAR_ASSERT(rsp.status == 304 && rsp.body.empty());
+    rsp = client.request("GET", "/static/small.txt",
+                         "If-Modified-Since: " + last_modified + "\r\n");
+    SYLAR_ASSERT(rsp.status == 304);
+    rsp = client.request("GET", "/static/small.txt",
+                         "If-Modified-Since: Thu, 01 Jan 1970 00:00:00 GMT\r\n");
+    SYLAR_ASSERT(rsp.status == 200 && rsp.body == data);
+
+    // Range
+    rsp = client.request("GET", "/static/small.txt", "Range: bytes=100-199\r\n");
+    SYLAR_ASSERT(rsp.status == 206 && rsp.body == data.substr(100, 100));
+    SYLAR_ASSERT(rsp.headers["content-range"] == "bytes 100-199/4096");
+    rsp = client.request("GET", "/static/small.txt", "Range: bytes=-10\r\n");
+    SYLAR_ASSERT(rsp.status == 206 && rsp.body == data.substr(4086));
+    rsp = client.request("GET", "/static/small.txt", "Range: bytes=4000-\r\n");
+    SYLAR_ASSERT(rsp.status == 206 && rsp.body == data.substr(4000));
+    rsp = client.request("GET", "/static/small.txt", "Range: bytes=5000-\r\n");
+    SYLAR_ASSERT(rsp.status == 416);
+    SYLAR_ASSERT(rsp.headers["content-range"] == "bytes */4096");
+    rsp = client.request("GET", "/static/small.txt",
+                         "Range: bytes=0-1\r\nIf-Range: \"old\"\r\n");
+    SYLAR_ASSERT(rsp.status == 200 && rsp.body == data);
+
+    // HEAD、方法、路径检查
+    rsp = client.request("HEAD", "/static/small.txt");
+    SYLAR_ASSERT(rsp.status == 200 && rsp.headers["content-length"] == "4096");
+    rsp = client.request("POST", "/static/small.txt");
+    SYLAR_ASSERT(rsp.status == 405);
+    rsp = client.request("GET", "/static/../small.txt");
+    SYLAR_ASSERT(rsp.status == 403);
+    rsp = client.request("GET", "/static/missing.txt");
+    SYLAR_ASSERT(rsp.status == 404);
+
+    //文件被替换后重新打开
+    sylar::ConfigManager::LookUp<uint32_t>("http.static_file.check_interval")
+        ->setValue(0);
+    std::string data2 = file_content(100, 'A');
+    write_file("small.txt", data2);
+    rsp = client.request("GET", "/static/small.txt");
+    SYLAR_ASSERT(rsp.status == 200 && rsp.body == data2);
+    SYLAR_ASSERT(rsp.headers["etag"] != etag);
+    write_file("small.txt", data);
+    rsp = client.request("GET", "/static/small.txt");
+    SYLAR_ASSERT(rsp.status == 200 && rsp.body == data);
+    sylar::ConfigManager::LookUp<uint32_t>("http.static_file.check_interval")
+        ->setValue(1000);
+
+    check_send_fail();
+}
+
+void bench() {
+    Client client;
+    for (auto &f : s_files) {
+        std::string data = file_content(f.size, 'a');
+        //先检查一次内容
+        SYLAR_ASSERT(client.request("GET", std::string("/static/") + f.name)
+                         .body == data);
+        SYLAR_ASSERT(client.request("GET", std::string("/read/") + f.name)
+                         .body == data);
+
+        const char *prefixes[] = {"/read/", "/static/"};
+        for (auto prefix : prefixes) {
+            std::string path = std::string(prefix) + f.name;
+            uint64_t begin   = now_ns();
+            for (int i = 0; i < f.count; ++i) {
+                Response rsp = client.request("GET", path, "", false);
+                SYLAR_ASSERT(rsp.status == 200);
+            }
+            uint64_t used = now_ns() - begin;
+            SYLAR_LOG_INFO(g_logger)
+                << (prefix == prefixes[0] ? "read+setBody" : "sendfile    ")
+                << " size=" << f.size / 1024 << "KB requests=" << f.count
+                << " req/s=" << (uint64_t)(f.count * 1e9 / used) << " MB/s="
+                << (uint64_t)(f.size * f.count * 1e9 / used / 1024 / 1024);
+        }
+    }
+}
+
+int main() {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+    SYLAR_LOG_NAME("tcpserver")->setLevel(sylar::LogLevel::WARN);
+    sylar::ConfigManager::LookUp<uint32_t>("scheduler.threads")->setValue(1);
+
+    char dir[] = "/tmp/sylar_static_XXXXXX";
+    SYLAR_ASSERT(mkdtemp(dir));
+    s_root = dir;
+    for (auto &f : s_files) {
+        write_file(f.name, file_content(f.size, 'a'));
+    }
+
+    sylar::http::HttpServer::ptr server(new sylar::http::HttpServer(true));
+    auto sd = server->getServletDispatch();
+    sd->addGlobServlet("/static/*",
+                       sylar::http::StaticFileServlet::ptr(
+                           new sylar::http::StaticFileServlet("/static/", dir)));
+    sd->addGlobServlet("/read/*", &read_file);
+    auto addr = sylar::IPAddress::Create("127.0.0.1", PORT);
+    SYLAR_ASSERT(server->bind(addr));
+    server->start();
+
+    sylar::Thread check_thread(&check, "check");
+    check_thread.join();
+    sylar::Thread bench_thread(&bench, "bench");
+    bench_thread.join();
+    server->stop();
+
+    for (auto &f : s_files) {
+        unlink((s_root + "/" + f.name).c_str());
+    }
+    rmdir(dir);
+    return 0;
+}
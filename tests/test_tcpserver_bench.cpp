@@ -0,0 +1,249 @@
+#include "sylar/sylar.h"
+#include "sylar/stack_allocator.h"
+#include "sylar/tcp_server.h"
+#include <arpa/inet.h>
+#include <map>
+#include <netinet/in.h>
+#include <string.h>
+#include <time.h>
+
+// TcpServer建连性能测试，本地多个线程作为客户端反复建立连接，服务器发送一个字节后关闭
+// 连接，统计每秒建立的连接数以及各调度线程处理的连接数，对比单个监听socket、批量accept
+// 及每个调度线程一个SO_REUSEPORT监听socket几种模式，以及多个服务器、多个监听地址共用
+// 一组外部调度器的情况
+// 另外模拟连接风暴，客户端一次发起大量连接，服务器处理较慢，对比限制连接数及待调度任务数
+// 前后同时存在的连接数、待调度任务数及协程栈个数的峰值
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int WORKER_THREADS  = 4;    //服务器调度线程数
+static const int CLIENT_THREADS  = 4;    //客户端线程数
+static const int CONN_PER_CLIENT = 5000; //每个客户端线程建立的连接数
+static const int STORM_CONNS     = 2000; //连接风暴时同时发起的连接数
+static const int SLOW_HANDLE_MS  = 10;   //慢服务器处理每个连接的耗时
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+static sylar::Mutex s_mutex;
+static std::map<int, int> s_handled; //每个调度线程处理的连接数
+
+class BenchServer : public sylar::TcpServer {
+public:
+    BenchServer(sylar::Scheduler *worker = nullptr,
+                sylar::Scheduler *accept_worker = nullptr)
+        : TcpServer(worker, accept_worker) {}
+
+protected:
+    void handleClient(sylar::Socket::ptr client) override {
+        client->send("x", 1);
+        client->close();
+        sylar::Mutex::Lock lock(s_mutex);
+        ++s_handled[sylar::GetThreadId()];
+    }
+};
+
+static std::atomic<int> s_failed{0};
+
+/* 依次连接[port, port + ports)中的端口 */
+void client_func(uint16_t port, int ports) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    for (int i = 0; i < CONN_PER_CLIENT; ++i) {
+        addr.sin_port = htons(port + i % ports);
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        //直接RST关闭，避免客户端大量TIME_WAIT耗尽本地端口
+        linger lg = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        char c;
+        if (connect(fd, (sockaddr *)&addr, sizeof(addr)) ||
+            recv(fd, &c, 1, 0) != 1) {
+            ++s_failed;
+        }
+        close(fd);
+    }
+}
+
+/* 运行客户端，返回耗时 */
+uint64_t run_clients(uint16_t port, int ports) {
+    s_handled.clear();
+    s_failed = 0;
+
+    uint64_t begin = now_ns();
+    std::vector<sylar::Thread::ptr> clients;
+    for (int i = 0; i < CLIENT_THREADS; ++i) {
+        clients.push_back(sylar::Thread::ptr(
+            new sylar::Thread(std::bind(&client_func, port, ports),
+                              "client_" + std::to_string(i))));
+    }
+    for (auto &i : clients) {
+        i->join();
+    }
+    return now_ns() - begin;
+}
+
+void report(const char *name, uint64_t used) {
+    int total = CLIENT_THREADS * CONN_PER_CLIENT;
+    std::stringstream ss;
+    for (auto &i : s_handled) {
+        ss << (ss.tellp() ? "/" : "") << i.second;
+    }
+    SYLAR_LOG_INFO(g_logger)
+        << name << " connections=" << total << " failed=" << s_failed
+        << " conn/s=" << (uint64_t)(total * 1e9 / used)
+        << " per_thread=" << ss.str();
+}
+
+void bench(const char *name, bool reuseport, uint32_t accept_batch,
+           uint16_t port) {
+    sylar::TcpServer::ptr server(new BenchServer);
+    server->setReusePort(reuseport);
+    server->setAcceptBatch(accept_batch);
+    auto addr = sylar::IPAddress::Create("127.0.0.1", port);
+    SYLAR_ASSERT(server->bind(addr));
+    server->start();
+
+    uint64_t used = run_clients(port, 1);
+    server->stop();
+    report(name, used);
+}
+
+/* 两个服务器各监听两个端口，共用一个处理连接的调度器和一个接受连接的调度器 */
+void bench_shared(uint16_t port) {
+    sylar::Scheduler worker("shared_worker", WORKER_THREADS);
+    sylar::Scheduler accept_worker("shared_accept", 1);
+    worker.start();
+    accept_worker.start();
+
+    std::vector<sylar::TcpServer::ptr> servers;
+    for (int i = 0; i < 2; ++i) {
+        sylar::TcpServer::ptr server(new BenchServer(&worker, &accept_worker));
+        std::vector<sylar::Address::ptr> addrs, fails;
+        for (int j = 0; j < 2; ++j) {
+            addrs.push_back(
+                sylar::IPAddress::Create("127.0.0.1", port + i * 2 + j));
+        }
+        SYLAR_ASSERT(server->bind(addrs, fails));
+        server->start();
+        servers.push_back(server);
+    }
+
+    uint64_t used = run_clients(port, 4);
+    for (auto &i : servers) {
+        i->stop();
+    }
+    accept_worker.stop();
+    worker.stop();
+    report("shared 2 servers*2 ports", used);
+}
+
+static std::atomic<uint64_t> s_peak_conns{0};
+static std::atomic<uint64_t> s_peak_queue{0};
+static std::atomic<uint64_t> s_peak_stacks{0};
+
+static void update_peak(std::atomic<uint64_t> &peak, uint64_t v) {
+    uint64_t old = peak;
+    while (v > old && !peak.compare_exchange_weak(old, v)) {
+    }
+}
+
+/* 处理较慢的服务器，记录连接数、待调度任务数及使用中的协程栈个数的峰值 */
+class SlowServer : public sylar::TcpServer {
+protected:
+    void handleClient(sylar::Socket::ptr client) override {
+        sylar::StackAllocStats stats =
+            sylar::StackAllocator::GetDefault()->getStats();
+        update_peak(s_peak_conns, getConnectionCount());
+        update_peak(s_peak_queue, getQueueDepth());
+        update_peak(s_peak_stacks, stats.allocs - stats.deallocs);
+        usleep(SLOW_HANDLE_MS * 1000);
+        client->send("x", 1);
+        client->close();
+    }
+};
+
+/* 先发起全部连接，握手由内核完成，之后再依次读取服务器的响应 */
+void storm_client(uint16_t port) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    std::vector<int> fds;
+    for (int i = 0; i < STORM_CONNS; ++i) {
+        int fd    = socket(AF_INET, SOCK_STREAM, 0);
+        linger lg = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        if (connect(fd, (sockaddr *)&addr, sizeof(addr))) {
+            ++s_failed;
+            close(fd);
+            continue;
+        }
+        fds.push_back(fd);
+    }
+    for (auto fd : fds) {
+        char c;
+        if (recv(fd, &c, 1, 0) != 1) {
+            ++s_failed;
+        }
+        close(fd);
+    }
+}
+
+void bench_storm(const char *name, uint32_t max_connections,
+                 uint32_t max_queue_depth, uint16_t port) {
+    s_failed      = 0;
+    s_peak_conns  = 0;
+    s_peak_queue  = 0;
+    s_peak_stacks = 0;
+
+    sylar::TcpServer::ptr server(new SlowServer);
+    server->setMaxConnections(max_connections);
+    server->setMaxQueueDepth(max_queue_depth);
+    auto addr = sylar::IPAddress::Create("127.0.0.1", port);
+    SYLAR_ASSERT(server->bind(addr));
+    server->start();
+
+    uint64_t begin = now_ns();
+    sylar::Thread client(std::bind(&storm_client, port), "storm_client");
+    client.join();
+    uint64_t used = now_ns() - begin;
+    uint64_t pauses = server->getAcceptPauseCount();
+    server->stop();
+
+    SYLAR_LOG_INFO(g_logger)
+        << name << " connections=" << STORM_CONNS << " failed=" << s_failed
+        << " used=" << used / 1000000 << "ms peak_connections=" << s_peak_conns
+        << " peak_queue_depth=" << s_peak_queue
+        << " peak_fiber_stacks=" << s_peak_stacks
+        << " accept_pauses=" << pauses;
+    if (max_connections) {
+        SYLAR_ASSERT(s_peak_conns <= max_connections);
+    }
+}
+
+int main() {
+    //关闭调度器的调试日志，避免日志输出影响测试结果
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+    SYLAR_LOG_NAME("tcpserver")->setLevel(sylar::LogLevel::WARN);
+    sylar::ConfigManager::LookUp<uint32_t>("scheduler.threads")
+        ->setValue(WORKER_THREADS);
+
+    bench("single acceptor         ", false, 1, 8300);
+    bench("single acceptor batch=32", false, 32, 8301);
+    bench("reuseport               ", true, 1, 8302);
+    bench("reuseport batch=32      ", true, 32, 8303);
+    bench_shared(8304);
+
+    bench_storm("storm unlimited          ", 0, 0, 8310);
+    bench_storm("storm max_connections=64 ", 64, 0, 8311);
+    bench_storm("storm max_queue_depth=16 ", 0, 16, 8312);
+    return 0;
+}
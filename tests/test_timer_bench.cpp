@@ -0,0 +1,138 @@
+#include "sylar/sylar.h"
+#include "sylar/timer.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+
+// 定时器性能测试
+// 1. 时间轮添加及取消1M个定时器的平均耗时
+// 2. 对比原来每个定时器一个timerfd的实现(timerfd_create+timerfd_settime+epoll_ctl+close)
+// 3. 调度器中大量定时器的超时误差
+// 4. 0ms的循环定时器每次只触发一次，不会卡住时间轮
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int TIMER_COUNT   = 1000000; //时间轮测试的定时器个数
+static const int TIMERFD_COUNT = 10000;   // timerfd测试的定时器个数
+static const int FIRE_COUNT    = 10000;   //超时误差测试的定时器个数
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+void bench_wheel() {
+    sylar::TimerManager manager;
+    std::vector<sylar::Timer::ptr> timers;
+    timers.reserve(TIMER_COUNT);
+    for (int i = 0; i < TIMER_COUNT; ++i) {
+        //超时时间分布在1ms~1小时，覆盖时间轮的各层
+        uint64_t timeout = 1 + rand() % (3600 * 1000);
+        timers.emplace_back(new sylar::Timer(timeout, [](void *) {}));
+    }
+    std::random_shuffle(timers.begin(), timers.end());
+
+    uint64_t begin = now_ns();
+    for (auto &i : timers) {
+        manager.addTimer(i);
+    }
+    uint64_t add_ns = now_ns() - begin;
+    SYLAR_ASSERT(manager.getTimerCount() == (size_t)TIMER_COUNT);
+
+    std::random_shuffle(timers.begin(), timers.end());
+    begin = now_ns();
+    for (auto &i : timers) {
+        i->cancel();
+    }
+    uint64_t cancel_ns = now_ns() - begin;
+    SYLAR_ASSERT(manager.getTimerCount() == 0);
+
+    SYLAR_LOG_INFO(g_logger)
+        << "timing wheel: timers=" << TIMER_COUNT
+        << " add=" << add_ns / TIMER_COUNT << "ns/op"
+        << " cancel=" << cancel_ns / TIMER_COUNT << "ns/op";
+}
+
+void bench_timerfd() {
+    int epfd = epoll_create(1);
+    SYLAR_ASSERT(epfd >= 0);
+
+    uint64_t begin = now_ns();
+    for (int i = 0; i < TIMERFD_COUNT; ++i) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        SYLAR_ASSERT(fd >= 0);
+        struct itimerspec ts = {};
+        ts.it_value.tv_sec   = 1 + i % 3600;
+        timerfd_settime(fd, 0, &ts, nullptr);
+        epoll_event ev;
+        ev.events  = EPOLLIN | EPOLLET;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+    }
+    uint64_t used = now_ns() - begin;
+    close(epfd);
+
+    SYLAR_LOG_INFO(g_logger) << "timerfd:      timers=" << TIMERFD_COUNT
+                             << " add+cancel=" << used / TIMERFD_COUNT
+                             << "ns/op";
+}
+
+static std::vector<uint64_t> s_lateness;
+static sylar::Mutex s_mutex;
+
+void bench_fire() {
+    s_lateness.clear();
+    s_lateness.reserve(FIRE_COUNT);
+    std::vector<uint64_t> expect(FIRE_COUNT); //预期的超时时间
+
+    sylar::Scheduler sc("timer_bench");
+    sc.start();
+    for (int i = 0; i < FIRE_COUNT; ++i) {
+        uint64_t timeout = 1 + rand() % 500;
+        expect[i] = now_ns() + timeout * 1000 * 1000;
+        sc.addTimer(timeout, [&expect, i](void *) {
+            uint64_t now = now_ns();
+            sylar::Mutex::Lock lock(s_mutex);
+            s_lateness.push_back(now > expect[i] ? now - expect[i] : 0);
+        });
+    }
+    sc.stop();
+
+    SYLAR_ASSERT(s_lateness.size() == (size_t)FIRE_COUNT);
+    std::sort(s_lateness.begin(), s_lateness.end());
+    SYLAR_LOG_INFO(g_logger)
+        << "fire: timers=" << FIRE_COUNT
+        << " lateness p50=" << s_lateness[FIRE_COUNT / 2] / 1000.0 << "us"
+        << " p99=" << s_lateness[FIRE_COUNT * 99 / 100] / 1000.0 << "us";
+}
+
+void check_zero_recurring() {
+    sylar::TimerManager manager;
+    sylar::Timer::ptr timer(new sylar::Timer(0, [](void *) {}, true));
+    manager.addTimer(timer);
+    for (int i = 0; i < 3; ++i) {
+        usleep(2 * 1000);
+        std::vector<sylar::ScheduleTask> tasks;
+        manager.listExpired(tasks);
+        SYLAR_ASSERT(tasks.size() == 1);
+    }
+    timer->cancel();
+    SYLAR_ASSERT(manager.getTimerCount() == 0);
+    SYLAR_LOG_INFO(g_logger) << "zero recurring timer ok";
+}
+
+int main() {
+    //关闭调度器的调试日志，避免日志输出影响测试结果
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+
+    check_zero_recurring();
+    bench_wheel();
+    bench_timerfd();
+    bench_fire();
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "sylar/sylar.h"
+#include <algorithm>
+#include <thread>
+#include <time.h>
+
+// 调度队列性能测试，对比全局std::list队列和调度线程本地工作窃取队列的每秒调度任务数
+// 及调度延迟(从schedule()到任务开始执行的时间)的p99
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int CHAIN_COUNT  = 64;   //任务链数
+static const int CHAIN_LENGTH = 4000; //每条任务链的任务数，任务在执行时调度下一个任务
+
+struct Chain {
+    int step = 0;
+    uint64_t enqueue_ns = 0;
+    std::vector<uint64_t> latency;
+};
+
+static std::vector<Chain> s_chains;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+void chain_task(void *arg) {
+    Chain *chain = (Chain *)arg;
+    chain->latency.push_back(now_ns() - chain->enqueue_ns);
+    if (++chain->step < CHAIN_LENGTH) {
+        chain->enqueue_ns = now_ns();
+        sylar::Scheduler::getThis()->schedule(&chain_task, arg);
+    }
+}
+
+void bench(bool work_stealing, size_t threads) {
+    sylar::ConfigManager::LookUp<bool>("scheduler.work_stealing")
+        ->setValue(work_stealing);
+
+    s_chains.clear();
+    s_chains.resize(CHAIN_COUNT);
+    for (auto &i : s_chains) {
+        i.latency.reserve(CHAIN_LENGTH);
+    }
+
+    sylar::Scheduler sc("bench", threads);
+    uint64_t begin = now_ns();
+    for (auto &i : s_chains) {
+        i.enqueue_ns = now_ns();
+        sc.schedule(&chain_task, &i);
+    }
+    sc.start();
+    sc.stop();
+    uint64_t used = now_ns() - begin;
+
+    std::vector<uint64_t> all;
+    all.reserve(CHAIN_COUNT * CHAIN_LENGTH);
+    for (auto &i : s_chains) {
+        all.insert(all.end(), i.latency.begin(), i.latency.end());
+    }
+    SYLAR_ASSERT(all.size() == (size_t)CHAIN_COUNT * CHAIN_LENGTH);
+    std::sort(all.begin(), all.end());
+
+    SYLAR_LOG_INFO(g_logger)
+        << (work_stealing ? "work stealing" : "std::list    ")
+        << " threads=" << threads
+        << " tasks/s=" << (uint64_t)(all.size() * 1e9 / used)
+        << " p50=" << all[all.size() / 2] / 1000.0 << "us"
+        << " p99=" << all[all.size() * 99 / 100] / 1000.0 << "us";
+}
+
+int main() {
+    //关闭调度器的调试日志，避免日志输出影响测试结果
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+
+    size_t threads = std::max(2u, std::thread::hardware_concurrency());
+    bench(false, threads);
+    bench(true, threads);
+    return 0;
+}